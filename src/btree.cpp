@@ -15,13 +15,479 @@
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/page_pinned_exception.h"
 #include <vector>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 //#define DEBUG
 
 namespace badgerdb
 {
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::readKey
+// -----------------------------------------------------------------------------
+
+template <class T>
+T BTreeIndex::readKey(const void* key)
+{
+    // attribute values inside a record need not be aligned
+    T value;
+    memcpy(&value, key, sizeof(T));
+    return value;
+}
+
+template <>
+StringKey BTreeIndex::readKey<StringKey>(const void* key)
+{
+    return StringKey((const char*)key);
+}
+
+// -----------------------------------------------------------------------------
+// STRING nodes
+// -----------------------------------------------------------------------------
+
+// Bytes a payload takes in an entry; a RecordId is stored without its padding
+template <class Payload>
+constexpr int STRINGPAYLOADSIZE = sizeof(Payload);
+template <>
+constexpr int STRINGPAYLOADSIZE<RecordId> = sizeof(PageId) + sizeof(SlotId);
+
+static void storePayload(char* dest, const RecordId& rid)
+{
+    memcpy(dest, &rid.page_number, sizeof(PageId));
+    memcpy(dest + sizeof(PageId), &rid.slot_number, sizeof(SlotId));
+}
+
+static void loadPayload(const char* src, RecordId& rid)
+{
+    memcpy(&rid.page_number, src, sizeof(PageId));
+    memcpy(&rid.slot_number, src + sizeof(PageId), sizeof(SlotId));
+    rid.padding = 0;
+}
+
+static void storePayload(char* dest, const PageId& pageNo)
+{
+    memcpy(dest, &pageNo, sizeof(PageId));
+}
+
+static void loadPayload(const char* src, PageId& pageNo)
+{
+    memcpy(&pageNo, src, sizeof(PageId));
+}
+
+// Characters of key after the first prefixLength, without the zero padding
+static int restLength(const StringKey& key, const int prefixLength)
+{
+    return std::max(0, (int)strnlen(key.data, STRINGSIZE) - prefixLength);
+}
+
+static int commonPrefixLength(const StringKey& k1, const StringKey& k2)
+{
+    int length = 0;
+    while (length < STRINGSIZE && k1.data[length] == k2.data[length]) {
+        length++;
+    }
+    return length;
+}
+
+// Bytes taken by the entry of key and its offset under a prefix of prefixLength characters
+template <class Payload>
+static int entrySize(const StringKey& key, const int prefixLength)
+{
+    return sizeof(std::uint16_t) + 1 + restLength(key, prefixLength) + STRINGPAYLOADSIZE<Payload>;
+}
+
+// Largest entry, for a key sharing nothing with the prefix
+template <class Payload>
+constexpr int MAXSTRINGENTRYSIZE = sizeof(std::uint16_t) + 1 + STRINGSIZE + STRINGPAYLOADSIZE<Payload>;
+
+template <class Payload>
+static std::uint16_t entryOffset(const StringNodeBody<Payload>& body, const int i)
+{
+    std::uint16_t offset;
+    memcpy(&offset, body.data + i * sizeof(std::uint16_t), sizeof(std::uint16_t));
+    return offset;
+}
+
+template <class Payload>
+static void setEntryOffset(StringNodeBody<Payload>& body, const int i, const std::uint16_t offset)
+{
+    memcpy(body.data + i * sizeof(std::uint16_t), &offset, sizeof(std::uint16_t));
+}
+
+template <class Payload>
+void StringNodeBody<Payload>::clear()
+{
+    heapStart = STRINGNODEDATASIZE;
+    prefixLength = 0;
+}
+
+template <class Payload>
+StringKey StringNodeBody<Payload>::key(const int i) const
+{
+    const char* entry = data + entryOffset(*this, i);
+    const int rest = (std::uint8_t)entry[0];
+    StringKey k;
+    memcpy(k.data, prefix, prefixLength);
+    memcpy(k.data + prefixLength, entry + 1, rest);
+    memset(k.data + prefixLength + rest, 0, STRINGSIZE - prefixLength - rest);
+    return k;
+}
+
+template <class Payload>
+Payload StringNodeBody<Payload>::payload(const int i) const
+{
+    const char* entry = data + entryOffset(*this, i);
+    Payload p;
+    loadPayload(entry + 1 + (std::uint8_t)entry[0], p);
+    return p;
+}
+
+template <class Payload>
+int StringNodeBody<Payload>::search(const StringKey& k, const int length, const bool upper) const
+{
+    // a key outside the prefix is below or above every key of the node
+    const int c = memcmp(k.data, prefix, prefixLength);
+    if (c != 0) {
+        return c < 0 ? 0 : length;
+    }
+    // the rest of the keys compare like strings, a shorter one first
+    const char* rest = k.data + prefixLength;
+    const int restLen = strnlen(rest, STRINGSIZE - prefixLength);
+    int low = 0;
+    int high = length;
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        const char* entry = data + entryOffset(*this, mid);
+        const int entryLen = (std::uint8_t)entry[0];
+        int order = memcmp(entry + 1, rest, std::min(entryLen, restLen));
+        if (order == 0) {
+            order = entryLen - restLen;
+        }
+        if (upper ? order <= 0 : order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+template <class Payload>
+int StringNodeBody<Payload>::usedSpace(const int length) const
+{
+    return length * sizeof(std::uint16_t) + (STRINGNODEDATASIZE - heapStart);
+}
+
+template <class Payload>
+int StringNodeBody<Payload>::freeSpace(const int length) const
+{
+    return heapStart - length * sizeof(std::uint16_t);
+}
+
+template <class Payload>
+int StringNodeBody<Payload>::worstInsertSpace(const int length) const
+{
+    return MAXSTRINGENTRYSIZE<Payload> + length * prefixLength;
+}
+
+template <class Payload>
+bool StringNodeBody<Payload>::canInsert(const StringKey& k, const int length) const
+{
+    if (length == 0) {
+        return true;
+    }
+    int shared = 0;
+    while (shared < prefixLength && k.data[shared] == prefix[shared]) {
+        shared++;
+    }
+    if (shared == prefixLength) {
+        return freeSpace(length) >= entrySize<Payload>(k, prefixLength);
+    }
+    // the prefix would shrink to the shared characters, and every key grow by the rest of it
+    int size = entrySize<Payload>(k, shared);
+    for (int i = 0; i < length; i++) {
+        size += entrySize<Payload>(key(i), shared);
+    }
+    return size <= STRINGNODEDATASIZE;
+}
+
+template <class Payload>
+bool StringNodeBody<Payload>::insert(const int i, const StringKey& k, const Payload& p, const int length)
+{
+    if (length == 0) {
+        // the first key is the prefix until a different one comes in
+        clear();
+        memcpy(prefix, k.data, STRINGSIZE);
+        prefixLength = STRINGSIZE;
+    }
+    if (memcmp(k.data, prefix, prefixLength) != 0) {
+        // the key only shares part of the prefix: lay the node out again around a shorter one
+        std::vector<StringKey> keys;
+        std::vector<Payload> payloads;
+        for (int j = 0; j < length; j++) {
+            keys.push_back(key(j));
+            payloads.push_back(payload(j));
+        }
+        keys.insert(keys.begin() + i, k);
+        payloads.insert(payloads.begin() + i, p);
+        auto keyAt = [&keys](const int j) { return keys[j]; };
+        if (encodedSize(length + 1, keyAt) > STRINGNODEDATASIZE) {
+            return false;
+        }
+        assign(length + 1, keyAt, [&payloads](const int j) { return payloads[j]; });
+        return true;
+    }
+
+    const int size = entrySize<Payload>(k, prefixLength);
+    if (freeSpace(length) < size) {
+        return false;
+    }
+    const int rest = restLength(k, prefixLength);
+    heapStart -= size - sizeof(std::uint16_t);
+    char* entry = data + heapStart;
+    entry[0] = (char)rest;
+    memcpy(entry + 1, k.data + prefixLength, rest);
+    storePayload(entry + 1 + rest, p);
+    memmove(data + (i + 1) * sizeof(std::uint16_t), data + i * sizeof(std::uint16_t), (length - i) * sizeof(std::uint16_t));
+    setEntryOffset(*this, i, heapStart);
+    return true;
+}
+
+template <class Payload>
+void StringNodeBody<Payload>::remove(const int i, const int length)
+{
+    // the entries below the one removed move up to close the gap
+    const std::uint16_t offset = entryOffset(*this, i);
+    const int size = 1 + (std::uint8_t)data[offset] + STRINGPAYLOADSIZE<Payload>;
+    memmove(data + heapStart + size, data + heapStart, offset - heapStart);
+    for (int j = 0; j < length; j++) {
+        const std::uint16_t other = entryOffset(*this, j);
+        if (other < offset) {
+            setEntryOffset(*this, j, other + size);
+        }
+    }
+    heapStart += size;
+    memmove(data + i * sizeof(std::uint16_t), data + (i + 1) * sizeof(std::uint16_t), (length - i - 1) * sizeof(std::uint16_t));
+}
+
+template <class Payload>
+template <class KeyAt>
+int StringNodeBody<Payload>::encodedSize(const int count, KeyAt keyAt)
+{
+    if (count == 0) {
+        return 0;
+    }
+    // sorted keys share the prefix their first and last key share
+    const int sharedLength = commonPrefixLength(keyAt(0), keyAt(count - 1));
+    int size = 0;
+    for (int j = 0; j < count; j++) {
+        size += entrySize<Payload>(keyAt(j), sharedLength);
+    }
+    return size;
+}
+
+template <class Payload>
+template <class KeyAt, class PayloadAt>
+void StringNodeBody<Payload>::assign(const int count, KeyAt keyAt, PayloadAt payloadAt)
+{
+    clear();
+    if (count == 0) {
+        return;
+    }
+    prefixLength = commonPrefixLength(keyAt(0), keyAt(count - 1));
+    memcpy(prefix, keyAt(0).data, prefixLength);
+    for (int j = 0; j < count; j++) {
+        const StringKey k = keyAt(j);
+        const int rest = restLength(k, prefixLength);
+        heapStart -= 1 + rest + STRINGPAYLOADSIZE<Payload>;
+        char* entry = data + heapStart;
+        entry[0] = (char)rest;
+        memcpy(entry + 1, k.data + prefixLength, rest);
+        storePayload(entry + 1 + rest, payloadAt(j));
+        setEntryOffset(*this, j, heapStart);
+    }
+}
+
+template <class Payload>
+template <class KeyAt>
+int StringNodeBody<Payload>::splitPoint(const int count, const int pushed, KeyAt keyAt)
+{
+    // cut where the keys on either side take about as many bytes, then move the cut until both sides
+    // fit; the side that gets a key sharing less with the others loses the most prefix
+    int total = 0;
+    for (int j = 0; j < count; j++) {
+        total += entrySize<Payload>(keyAt(j), 0);
+    }
+    int split = 0;
+    for (int size = 0; split < count - pushed - 1 && 2 * size < total; split++) {
+        size += entrySize<Payload>(keyAt(split), 0);
+    }
+    split = std::max(split, 1);
+    auto leftFits = [&](const int s) { return encodedSize(s, keyAt) <= STRINGNODEDATASIZE; };
+    auto rightFits = [&](const int s) {
+        return encodedSize(count - s - pushed, [&](const int j) { return keyAt(s + pushed + j); }) <= STRINGNODEDATASIZE;
+    };
+    while (split < count - pushed && !rightFits(split)) {
+        split++;
+    }
+    while (split > 0 && !leftFits(split)) {
+        split--;
+    }
+    return split;
+}
+
+bool NonLeafNode<StringKey>::hasRoom() const
+{
+    return body.freeSpace(length) >= body.worstInsertSpace(length);
+}
+
+bool NonLeafNode<StringKey>::insert(const int i, const StringKey& k, const PageId rightPageNo)
+{
+    if (!body.insert(i, k, rightPageNo, length)) {
+        return false;
+    }
+    length++;
+    return true;
+}
+
+void NonLeafNode<StringKey>::remove(const int i)
+{
+    body.remove(i, length);
+    length--;
+}
+
+bool NonLeafNode<StringKey>::setKey(const int i, const StringKey& k)
+{
+    std::vector<StringKey> keys;
+    std::vector<PageId> pageNos;
+    entries(keys, pageNos);
+    keys[i] = k;
+    if (!fits(keys.data(), length)) {
+        return false;
+    }
+    assign(keys.data(), pageNos.data(), length);
+    return true;
+}
+
+bool NonLeafNode<StringKey>::canRemove() const
+{
+    return body.usedSpace(length) - MAXSTRINGENTRYSIZE<PageId> >= STRINGNODEDATASIZE / 2;
+}
+
+bool NonLeafNode<StringKey>::underfull() const
+{
+    return body.usedSpace(length) < STRINGNODEDATASIZE / 2;
+}
+
+bool NonLeafNode<StringKey>::filled(const float fillFactor) const
+{
+    return body.usedSpace(length) >= STRINGNODEDATASIZE * fillFactor;
+}
+
+void NonLeafNode<StringKey>::entries(std::vector<StringKey>& keys, std::vector<PageId>& pageNos) const
+{
+    pageNos.push_back(firstPageNo);
+    for (int i = 0; i < length; i++) {
+        keys.push_back(body.key(i));
+        pageNos.push_back(body.payload(i));
+    }
+}
+
+bool NonLeafNode<StringKey>::fits(const StringKey* keys, const int count)
+{
+    return StringNodeBody<PageId>::encodedSize(count, [keys](const int j) { return keys[j]; }) <= STRINGNODEDATASIZE;
+}
+
+int NonLeafNode<StringKey>::splitPoint(const StringKey* keys, const int count)
+{
+    return StringNodeBody<PageId>::splitPoint(count, 1, [keys](const int j) { return keys[j]; });
+}
+
+void NonLeafNode<StringKey>::assign(const StringKey* keys, const PageId* pageNos, const int count)
+{
+    leaf = false;
+    length = count;
+    firstPageNo = pageNos[0];
+    body.assign(count, [keys](const int j) { return keys[j]; }, [pageNos](const int j) { return pageNos[j + 1]; });
+}
+
+void LeafNode<StringKey>::clear()
+{
+    leaf = true;
+    length = 0;
+    rightSibPageNo = 0;
+    body.clear();
+}
+
+bool LeafNode<StringKey>::insert(const int i, const StringKey& k, const RecordId& r)
+{
+    if (!body.insert(i, k, r, length)) {
+        return false;
+    }
+    length++;
+    return true;
+}
+
+void LeafNode<StringKey>::remove(const int i)
+{
+    body.remove(i, length);
+    length--;
+}
+
+bool LeafNode<StringKey>::canRemove() const
+{
+    return body.usedSpace(length) - MAXSTRINGENTRYSIZE<RecordId> >= STRINGNODEDATASIZE / 2;
+}
+
+bool LeafNode<StringKey>::underfull() const
+{
+    return body.usedSpace(length) < STRINGNODEDATASIZE / 2;
+}
+
+bool LeafNode<StringKey>::filled(const float fillFactor) const
+{
+    return body.usedSpace(length) >= STRINGNODEDATASIZE * fillFactor;
+}
+
+void LeafNode<StringKey>::copyRids(const int from, const int to, RecordId* out) const
+{
+    for (int i = from; i < to; i++) {
+        out[i - from] = body.payload(i);
+    }
+}
+
+void LeafNode<StringKey>::entries(std::vector<RIDKeyPair<StringKey> >& pairs) const
+{
+    for (int i = 0; i < length; i++) {
+        RIDKeyPair<StringKey> pair;
+        pair.set(body.payload(i), body.key(i));
+        pairs.push_back(pair);
+    }
+}
+
+bool LeafNode<StringKey>::fits(const RIDKeyPair<StringKey>* pairs, const int count)
+{
+    return StringNodeBody<RecordId>::encodedSize(count, [pairs](const int j) { return pairs[j].key; }) <= STRINGNODEDATASIZE;
+}
+
+int LeafNode<StringKey>::splitPoint(const RIDKeyPair<StringKey>* pairs, const int count)
+{
+    return StringNodeBody<RecordId>::splitPoint(count, 0, [pairs](const int j) { return pairs[j].key; });
+}
+
+void LeafNode<StringKey>::assign(const RIDKeyPair<StringKey>* pairs, const int count)
+{
+    leaf = true;
+    length = count;
+    body.assign(count, [pairs](const int j) { return pairs[j].key; }, [pairs](const int j) { return pairs[j].rid; });
+}
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
@@ -30,18 +496,18 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		std::string & outIndexName,
 		BufMgr *bufMgrIn,
 		const int attrByteOffset,
-		const Datatype attrType)
+		const Datatype attrType,
+		const BuildMode buildMode,
+		const float fillFactor,
+		const int runSize)
+	: scanCursor(this)
 {
     // Add your code below. Please do not remove this line.
 
     bufMgr = bufMgrIn;
     this->attrByteOffset = attrByteOffset;
     //std::cout<<"Attrbyteoffset: "<<attrByteOffset<<"\n";
-    attributeType = INTEGER; // attrType parameter ignored for this assignment
-    leafOccupancy = INTARRAYLEAFSIZE;
-    nodeOccupancy = INTARRAYNONLEAFSIZE;
-    //std::cout<<"leaf occupancy: "<<leafOccupancy<<"\n";
-    //std::cout<<"node occupancy: "<<nodeOccupancy<<"\n";
+    attributeType = attrType;
     // indexName is the name of the index file
     std::ostringstream idxStr;
     idxStr << relationName << '.' << attrByteOffset;
@@ -61,16 +527,24 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 	file = new BlobFile(indexName, !File::exists(indexName));
 	bufMgr->readPage(file, headerPageNum, headerPage);
         IndexMetaInfo* meta = (IndexMetaInfo*) headerPage; // cast type
+        // the file must have been built for the same attribute
+        bool matches = strncmp(meta->relationName, relationName.c_str(), sizeof(meta->relationName)) == 0
+                       && meta->attrByteOffset == attrByteOffset && meta->attrType == attrType;
         attributeType = meta->attrType;
         rootPageNum = meta->rootPageNo;
-        bufMgr->unPinPage(file,headerPageNum,true);
+        bufMgr->unPinPage(file,headerPageNum,false);
+        if (!matches) {
+            // drop the header frame so a later File at this address cannot hit it
+            bufMgr->flushFile(file);
+            delete file;
+            throw BadIndexInfoException("Index file " + indexName + " was built for a different attribute");
+        }
        	// no further action
     } else {
 	//Changed from above if statement - REMOVE?
 	file = new BlobFile(indexName, !File::exists(indexName));
 	//std::cout<<"File doesn't exist, creating file"<<"\n";
         // need to init metadata and root pages in file
-        // assumption of only integer keys is made
 	    Page* headerPage;
         Page* rootPage;
         bufMgr->allocPage(file, headerPageNum, headerPage);
@@ -80,51 +554,411 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 	//std::cout<<"Allocated root page number: "<<rootPageNum<<"\n";
         // init metadata page
         IndexMetaInfo* meta = (IndexMetaInfo*) headerPage; // cast type
-        strcpy(meta->relationName, relationName.c_str()); 
+        strncpy(meta->relationName, relationName.c_str(), sizeof(meta->relationName)); 
         meta->attrByteOffset = attrByteOffset;
         meta->attrType = attrType;
         meta->rootPageNo = rootPageNum;
         
-	// init root page? 
-        LeafNodeInt* root = (LeafNodeInt*) rootPage; // cast type
-        root->leaf = true;
-        root->length = 0;
-        // no leaves - insertEntry will handle this initial case
-        // insert entries for every tuple in relation
+	// init root page as an empty leaf, then fill the index
+        switch (attributeType) {
+        case INTEGER:
+            ((LeafNodeInt*)rootPage)->clear();
+            build<int>(relationName, indexName, buildMode, fillFactor, runSize);
+            break;
+        case DOUBLE:
+            ((LeafNodeDouble*)rootPage)->clear();
+            build<double>(relationName, indexName, buildMode, fillFactor, runSize);
+            break;
+        case STRING:
+            ((LeafNodeString*)rootPage)->clear();
+            build<StringKey>(relationName, indexName, buildMode, fillFactor, runSize);
+            break;
+        }
+        bufMgr->unPinPage(file, headerPageNum, true);
+        bufMgr->unPinPage(file, rootPageNum, true);
+    }
+
+    // return value
+    outIndexName = indexName;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::build
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::build(const std::string & relationName, const std::string & indexName, const BuildMode buildMode,
+		const float fillFactor, const int runSize)
+{
+    if (buildMode == BULK_LOAD) {
+        // sort every <key,rid> pair and pack the tree bottom-up
+        bulkLoad<T>(relationName, indexName, std::min(std::max(fillFactor, 0.5f), 1.0f), std::max(runSize, 1));
+        return;
+    }
+    if (buildMode == PARALLEL_BULK_LOAD) {
+        parallelBulkLoad<T>(relationName, indexName, std::min(std::max(fillFactor, 0.5f), 1.0f), std::max(runSize, 1));
+        return;
+    }
+    // no leaves - insertEntry will handle this initial case
+    // insert entries for every tuple in relation
+    FileScan fs(relationName, bufMgr);
+    try {
+        while(true) {
+            RecordId rid;
+            fs.scanNext(rid);
+            insertEntryKey(readKey<T>(fs.getRecordView().data() + attrByteOffset), rid);
+        }
+    }
+    catch(EndOfFileException &e) {
+    }
+}
+
+// -----------------------------------------------------------------------------
+// SortedRunMerger
+// -----------------------------------------------------------------------------
+
+template <class T>
+SortedRunMerger<T>::SortedRunMerger(const std::vector<std::string>& runNamesIn,
+		const std::vector<PageId>& runPageCounts,
+		std::vector<RIDKeyPair<T> >& memRunIn)
+    : runNames(runNamesIn), memRun(memRunIn)
+{
+    // one cursor per run file plus one for the in-memory run
+    cursors.resize(runNames.size() + 1);
+    for (size_t i = 0; i < runNames.size(); i++) {
+        cursors[i].file = new BlobFile(runNames[i], false);
+        cursors[i].numPages = runPageCounts[i];
+        cursors[i].pageNo = 0;
+        cursors[i].nextPair = 0;
+    }
+    RunCursor& mem = cursors[runNames.size()];
+    mem.file = NULL;
+    mem.numPages = 0;
+    mem.pageNo = 0;
+    mem.nextPair = 0;
+
+    // prime the heap with the first pair of every run
+    for (size_t i = 0; i < cursors.size(); i++) {
+        advanceRun(i);
+    }
+}
+
+template <class T>
+SortedRunMerger<T>::~SortedRunMerger()
+{
+    for (size_t i = 0; i < runNames.size(); i++) {
+        delete cursors[i].file;
+        File::remove(runNames[i]);
+    }
+}
+
+template <class T>
+void SortedRunMerger<T>::advanceRun(int run)
+{
+    RunCursor& cursor = cursors[run];
+    if (cursor.file == NULL) {
+        if (cursor.nextPair < (int)memRun.size()) {
+            heap.push(HeapEntry(memRun[cursor.nextPair], run));
+            cursor.nextPair++;
+        }
+        return;
+    }
+
+    RunPage<T>* runPage = (RunPage<T>*)&cursor.page;
+    if (cursor.pageNo == 0 || cursor.nextPair >= runPage->length) {
+        // current page used up, read the next one of the run
+        // run pages start right after the file header, at page number 1
+        if (cursor.pageNo >= cursor.numPages) {
+            return;
+        }
+        cursor.pageNo++;
+        cursor.page = cursor.file->readPage(cursor.pageNo);
+        cursor.nextPair = 0;
+    }
+    heap.push(HeapEntry(runPage->pairArray[cursor.nextPair], run));
+    cursor.nextPair++;
+}
+
+template <class T>
+bool SortedRunMerger<T>::next(RIDKeyPair<T>& outPair)
+{
+    if (heap.empty()) {
+        return false;
+    }
+    HeapEntry top = heap.top();
+    heap.pop();
+    outPair = top.first;
+    advanceRun(top.second);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::bulkLoad
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::bulkLoad(const std::string & relationName, const std::string & indexName, const float fillFactor,
+		const int runSize)
+{
+    std::vector<RIDKeyPair<T> > pairs;
+    std::vector<std::string> runNames;
+    std::vector<PageId> runPageCounts;
+
+    // gather <key,rid> pairs, spilling a sorted run whenever the buffer fills up
+    {
         FileScan fs(relationName, bufMgr);
         try {
             while(true) {
-	   	RecordId rid;
+                RecordId rid;
                 fs.scanNext(rid);
-                std::string record = fs.getRecord();
-		const char* recordPtr = record.c_str();
-		const void* key = (void *)(recordPtr + attrByteOffset);
-		
-		insertEntry(key, rid);
+                RIDKeyPair<T> pair;
+                pair.set(rid, readKey<T>(fs.getRecordView().data() + attrByteOffset));
+                pairs.push_back(pair);
+                if ((int)pairs.size() >= runSize) {
+                    spillRun(pairs, runNames, runPageCounts, indexName);
+                }
             }
         }
         catch(EndOfFileException &e) {
         }
-        bufMgr->unPinPage(file, headerPageNum, true);
-        bufMgr->unPinPage(file, rootPageNum, true);
     }
 
-    // init fields specific to scanning
-    scanExecuting = false;
-    nextEntry = -1;
-    currentPageNum = -1;
-    currentPageData = NULL;
-    lowValInt = -1;
-    highValInt = -1;
-    lowOp = GT;
-    highOp = LT;
-    
-    // scanning only supports int - fields for double/string not used
+    // the last run stays in memory and joins the merge directly
+    std::sort(pairs.begin(), pairs.end());
+    SortedRunMerger<T> merger(runNames, runPageCounts, pairs);
+    packTree(merger, fillFactor);
+}
 
-    // return value
-    outIndexName = indexName;
+// Runs task(0) to task(numTasks - 1), each on a thread of its own, and waits for all of them.
+static void runOnThreads(const int numTasks, const std::function<void(int)>& task)
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numTasks; i++) {
+        threads.push_back(std::thread(task, i));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+template <class T>
+void BTreeIndex::parallelBulkLoad(const std::string & relationName, const std::string & indexName, const float fillFactor,
+		const int runSize)
+{
+    const int workerRunSize = std::max(runSize / BULKLOADTHREADS, 1);
+    std::vector<std::vector<RIDKeyPair<T> > > workerPairs(BULKLOADTHREADS);
+    std::vector<std::vector<std::string> > workerRunNames(BULKLOADTHREADS);
+    std::vector<std::vector<PageId> > workerRunPageCounts(BULKLOADTHREADS);
+
+    // each worker gathers the pairs of the pages it scans and spills its own runs, under names of its own
+    {
+        ParallelFileScan pfs(relationName, bufMgr, BULKLOADTHREADS);
+        pfs.run([&](const std::uint32_t worker, const RecordId& rid, std::string_view record) {
+            RIDKeyPair<T> pair;
+            pair.set(rid, readKey<T>(record.data() + attrByteOffset));
+            workerPairs[worker].push_back(pair);
+            if ((int)workerPairs[worker].size() >= workerRunSize) {
+                spillRun(workerPairs[worker], workerRunNames[worker], workerRunPageCounts[worker],
+                         indexName + ".w" + std::to_string(worker));
+            }
+        });
+    }
+
+    // the buffers left are laid end to end, each sorted in place by a thread of its own
+    std::vector<RIDKeyPair<T> > pairs;
+    std::vector<size_t> bounds(1, 0);
+    for (std::vector<RIDKeyPair<T> >& buffer : workerPairs) {
+        pairs.insert(pairs.end(), buffer.begin(), buffer.end());
+        bounds.push_back(pairs.size());
+        std::vector<RIDKeyPair<T> >().swap(buffer);
+    }
+    runOnThreads(BULKLOADTHREADS, [&](const int segment) {
+        std::sort(pairs.begin() + bounds[segment], pairs.begin() + bounds[segment + 1]);
+    });
+
+    // merge neighbouring sorted segments pairwise, the merges of a round side by side
+    for (int width = 1; width < BULKLOADTHREADS; width *= 2) {
+        runOnThreads((BULKLOADTHREADS + 2 * width - 1) / (2 * width), [&](const int merge) {
+            const int first = 2 * width * merge;
+            std::inplace_merge(pairs.begin() + bounds[first],
+                               pairs.begin() + bounds[std::min(first + width, BULKLOADTHREADS)],
+                               pairs.begin() + bounds[std::min(first + 2 * width, BULKLOADTHREADS)]);
+        });
+    }
+
+    // the runs spilled by all the workers join the merged in-memory run; that last merge feeds packTree
+    // pair by pair, so it runs on this thread alone
+    std::vector<std::string> runNames;
+    std::vector<PageId> runPageCounts;
+    for (int worker = 0; worker < BULKLOADTHREADS; worker++) {
+        runNames.insert(runNames.end(), workerRunNames[worker].begin(), workerRunNames[worker].end());
+        runPageCounts.insert(runPageCounts.end(), workerRunPageCounts[worker].begin(), workerRunPageCounts[worker].end());
+    }
+    SortedRunMerger<T> merger(runNames, runPageCounts, pairs);
+    packTree(merger, fillFactor);
 }
 
+template <class T>
+void BTreeIndex::spillRun(std::vector<RIDKeyPair<T> >& pairs, std::vector<std::string>& runNames,
+		std::vector<PageId>& runPageCounts, const std::string & indexName)
+{
+    std::sort(pairs.begin(), pairs.end());
+
+    std::ostringstream runStr;
+    runStr << indexName << ".run" << runNames.size();
+    std::string runName = runStr.str();
+    if (File::exists(runName)) {
+        // left behind by an interrupted build
+        File::remove(runName);
+    }
+
+    // runs bypass the buffer pool: they are written once and read back once
+    BlobFile runFile(runName, true);
+    PageId numPages = 0;
+    for (size_t i = 0; i < pairs.size(); i += RUNPAGESIZE<T>) {
+        PageId pageNo;
+        Page page = runFile.allocatePage(pageNo);
+        RunPage<T>* runPage = (RunPage<T>*)&page;
+        runPage->length = std::min((int)(pairs.size() - i), RUNPAGESIZE<T>);
+        std::copy(pairs.begin() + i, pairs.begin() + i + runPage->length, runPage->pairArray);
+        runFile.writePage(pageNo, page);
+        numPages++;
+    }
+
+    runNames.push_back(runName);
+    runPageCounts.push_back(numPages);
+    pairs.clear();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::packTree
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::packTree(SortedRunMerger<T>& merger, const float fillFactor)
+{
+    // (page, separator below the subtree) for every node of the level just built
+    std::vector<PageKeyPair<T> > level;
+
+    // leaf level - the first leaf is packed aside and only gets a page of its own once a second one is
+    // needed, since a single leaf is written straight into the root page
+    Page firstPage;
+    Page* page = &firstPage;
+    PageId pageNo = Page::INVALID_NUMBER;
+    Page* prevPage = NULL;
+    PageId prevPageNo = Page::INVALID_NUMBER;
+    LeafNode<T>* leaf = (LeafNode<T>*)page;
+    leaf->clear();
+    PageKeyPair<T> entry;
+    entry.set(Page::INVALID_NUMBER, T());
+    level.push_back(entry);
+    RIDKeyPair<T> pair;
+    while (merger.next(pair)) {
+        if (leaf->length > 0 && (leaf->filled(fillFactor) || !leaf->canInsert(pair.key))) {
+            if (pageNo == Page::INVALID_NUMBER) {
+                bufMgr->allocPage(file, pageNo, page);
+                *page = firstPage;
+                level[0].pageNo = pageNo;
+            }
+            // chain the leaf to the next one, and let the one before it go
+            Page* nextPage;
+            PageId nextPageNo;
+            bufMgr->allocPage(file, nextPageNo, nextPage);
+            LeafNode<T>* prevLeaf = (LeafNode<T>*)page;
+            prevLeaf->rightSibPageNo = nextPageNo;
+            entry.set(nextPageNo, separatorKey(prevLeaf->key(prevLeaf->length - 1), pair.key));
+            level.push_back(entry);
+            if (prevPage != NULL) {
+                bufMgr->unPinPage(file, prevPageNo, true);
+            }
+            prevPage = page;
+            prevPageNo = pageNo;
+            page = nextPage;
+            pageNo = nextPageNo;
+            leaf = (LeafNode<T>*)page;
+            leaf->clear();
+        }
+        leaf->append(pair.key, pair.rid);
+    }
+
+    if (pageNo == Page::INVALID_NUMBER) {
+        Page* rootPage;
+        bufMgr->readPage(file, rootPageNum, rootPage);
+        *rootPage = firstPage;
+        bufMgr->unPinPage(file, rootPageNum, true);
+        return;
+    }
+    // the last leaf takes half of the one before it if it ended up underfull
+    LeafNode<T>* prevLeaf = (LeafNode<T>*)prevPage;
+    if (leaf->underfull()) {
+        std::vector<RIDKeyPair<T> > pairs;
+        prevLeaf->entries(pairs);
+        leaf->entries(pairs);
+        const int split = LeafNode<T>::splitPoint(pairs.data(), pairs.size());
+        prevLeaf->assign(pairs.data(), split);
+        leaf->assign(pairs.data() + split, pairs.size() - split);
+        level.back().key = separatorKey(pairs[split - 1].key, pairs[split].key);
+    }
+    bufMgr->unPinPage(file, prevPageNo, true);
+    bufMgr->unPinPage(file, pageNo, true);
+
+    // non-leaf levels, until the separators of a level fit in one node (the root)
+    while (true) {
+        // separator i bounds the keys under child i+1 from below
+        std::vector<T> keys;
+        std::vector<PageId> pageNos;
+        for (size_t child = 0; child < level.size(); child++) {
+            if (child > 0) {
+                keys.push_back(level[child].key);
+            }
+            pageNos.push_back(level[child].pageNo);
+        }
+        if (NonLeafNode<T>::fits(keys.data(), keys.size())) {
+            Page* rootPage;
+            bufMgr->readPage(file, rootPageNum, rootPage);
+            ((NonLeafNode<T>*)rootPage)->assign(keys.data(), pageNos.data(), keys.size());
+            bufMgr->unPinPage(file, rootPageNum, true);
+            return;
+        }
+
+        std::vector<PageKeyPair<T> > parents;
+        NonLeafNode<T>* node = NULL;
+        NonLeafNode<T>* prevNode = NULL;
+        for (size_t child = 0; child < level.size(); child++) {
+            if (node != NULL && !node->filled(fillFactor) && node->append(level[child].key, level[child].pageNo)) {
+                continue;
+            }
+            if (prevNode != NULL) {
+                bufMgr->unPinPage(file, prevPageNo, true);
+            }
+            prevNode = node;
+            prevPageNo = pageNo;
+            bufMgr->allocPage(file, pageNo, page);
+            node = (NonLeafNode<T>*)page;
+            node->assign(NULL, &level[child].pageNo, 0);
+            entry.set(pageNo, level[child].key);
+            parents.push_back(entry);
+        }
+
+        // as with the leaves, the last node takes half of the one before it if it ended up underfull; the
+        // separator between the two comes down between their keys, and the one at the new split goes up
+        if (node->underfull()) {
+            std::vector<T> nodeKeys;
+            std::vector<PageId> nodePageNos;
+            prevNode->entries(nodeKeys, nodePageNos);
+            nodeKeys.push_back(parents.back().key);
+            node->entries(nodeKeys, nodePageNos);
+            const int count = nodeKeys.size();
+            const int split = NonLeafNode<T>::splitPoint(nodeKeys.data(), count);
+            prevNode->assign(nodeKeys.data(), nodePageNos.data(), split);
+            node->assign(nodeKeys.data() + split + 1, nodePageNos.data() + split + 1, count - split - 1);
+            parents.back().key = nodeKeys[split];
+        }
+        bufMgr->unPinPage(file, prevPageNo, true);
+        bufMgr->unPinPage(file, pageNo, true);
+        level.swap(parents);
+    }
+}
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::~BTreeIndex -- destructor
@@ -134,174 +968,70 @@ BTreeIndex::~BTreeIndex()
 {
     // Add your code below. Please do not remove this line.
 
-    if (scanExecuting) {
-        endScan();
+    if (scanCursor.scanExecuting) {
+        scanCursor.endScan();
     }
+    // no cursor is left to pin the pages deleteEntry could not give back yet
+    releasePages(std::vector<PageId>());
     bufMgr->flushFile(file);
     delete file;
 }
 
+// Slot of child pageNo of node, the one whose keys key falls among. Separators equal to key may sit on
+// either side of it, so the search lands at or right of the child and walks back to it.
+template <class T>
+static int childSlot(const NonLeafNode<T>* node, const T& key, const PageId pageNo)
+{
+    int i = node->search(key, true);
+    while (i > 0 && node->pageNo(i) != pageNo) {
+        i--;
+    }
+    return i;
+}
+
 //DELETE THE RIGHT PAGE NO INPUT -> TESTING TO MAKE SURE IT IS EQUAL TO THE NODE ID
-int BTreeIndex::splitNonLeaf(int my_key, PageId nodeId, PageId inputLeftId, PageId inputRightId, PageId &leftPageNo, PageId &rightPageNo){
-    //std::cout<<"splitting non leaf\n";
+template <class T>
+T BTreeIndex::splitNonLeaf(const T& my_key, PageId nodeId, PageId inputLeftId, PageId inputRightId, PageId &leftPageNo, PageId &rightPageNo){
     Page* node;
     bufMgr->readPage(file,nodeId,node);
- 
-    //Cast to NonLeafNode to check length
-    NonLeafNodeInt* curr = (NonLeafNodeInt*) node;
+    NonLeafNode<T>* curr = (NonLeafNode<T>*) node;
 
     assert((curr->leaf==false));
 
-    int splitIndex = (int)(curr->length/2);
-    int pushedValue = curr->keyArray[splitIndex];
-    //std::cout<<"pushed value: "<<pushedValue<<"\n";
+    //The keys and children of the node with the new <key,leftPage,rightPage> in place
+    std::vector<T> keys;
+    std::vector<PageId> pageNos;
+    curr->entries(keys, pageNos);
+    int insertIndex = childSlot(curr, my_key, inputLeftId);
+    keys.insert(keys.begin() + insertIndex, my_key);
+    pageNos[insertIndex] = inputLeftId;
+    pageNos.insert(pageNos.begin() + insertIndex + 1, inputRightId);
+    int constLength = keys.size();
+    int splitIndex = NonLeafNode<T>::splitPoint(keys.data(), constLength);
+    T pushedValue = keys[splitIndex];
 
-    //The left and right pages are leaves because the split node was a leaf.
     Page* rightPage;
     Page* leftPage;
-    NonLeafNodeInt* rightNode;
-    NonLeafNodeInt* leftNode;
 
     //If this is root, need to allocate two pages for left/right
     if(nodeId == rootPageNum){
     	bufMgr->allocPage(file, leftPageNo, leftPage);
 	bufMgr->allocPage(file, rightPageNo, rightPage);
-	rightNode = (NonLeafNodeInt*) rightPage;
-	leftNode = (NonLeafNodeInt*) leftPage;
-	//Set parameters on new pages
-	rightNode->leaf=false;
-	leftNode->leaf=false;
-	rightNode->length=0;
-	leftNode->length=0;
-	int constLength = curr->length;
-	//Insert curr <key,pageId> to left/right pages
-	for(int i=0;i<splitIndex;i++){
-	    leftNode->keyArray[i] = curr->keyArray[i];
-	    leftNode->pageNoArray[i] = curr->pageNoArray[i];
-	    leftNode->length += 1;
-	}
-	//Insert the last pageNo to the leftNode
-	leftNode->pageNoArray[leftNode->length] = curr->pageNoArray[splitIndex];
-	//Do NOT include the pushedValue/split index in the left/right pages
-	for(int i=splitIndex+1;i<constLength;i++){
-	    rightNode->keyArray[i-(splitIndex+1)] = curr->keyArray[i];
-	    rightNode->pageNoArray[i-(splitIndex+1)] = curr->pageNoArray[i];
-	    rightNode->length += 1;
-	}
-	//Set last page no to the rightNode
-	rightNode->pageNoArray[rightNode->length] = curr->pageNoArray[constLength];
-	for(int i=0;i<rightNode->length;i++){
-	    //std::cout<<"right node key array[i]: "<<rightNode->keyArray[i]<<" pageNoArray[i]: "<<rightNode->pageNoArray[i]<<"\n";
-	}
-	//std::cout<<"last page no right: "<<rightNode->pageNoArray[rightNode->length]<<"\n";
-	for(int i=0;i<leftNode->length;i++){
-            //std::cout<<"left node key array[i]: "<<leftNode->keyArray[i]<<" pageNoArray[i]: "<<leftNode->pageNoArray[i]<<"\n";
-        }
-	//std::cout<<"last page no left: "<<leftNode->pageNoArray[leftNode->length]<<"\n";
 	//Unpin/save curr(root)
 	bufMgr->unPinPage(file, nodeId, true);
     }
-
     else{
-    	//Allocate a new page for the right page, move the elements in the left page to the right page.
+	//Allocate a new page for the right node; the node keeps its page as the left one
    	bufMgr->allocPage(file,rightPageNo,rightPage);
-	rightNode = (NonLeafNodeInt*)rightPage;
-
-	leftNode = curr;
-	//Reuse the inputted page as the right page -> move values to the left page from right
+	leftPage = node;
 	leftPageNo = nodeId;
-	//std::cout<<"left page no: "<<leftPageNo<<" right page no: "<<rightPageNo<<"\n";
-	//Set parameters for left/right nodes
-	rightNode->leaf = false;
-	leftNode->leaf = false;
-	rightNode->length = 0;
-
-	int constLength = leftNode->length;
-	//Move the last page no in the left node to the right node
-	rightNode->pageNoArray[splitIndex] = leftNode->pageNoArray[leftNode->length];
-	//Do not include the pushed key in the left or right pages
-        for(int i=splitIndex+1;i<constLength;i++){
-	    rightNode->keyArray[i-(splitIndex+1)] = leftNode->keyArray[i];
-	    rightNode->pageNoArray[i-(splitIndex+1)] = leftNode->pageNoArray[i];
-	    rightNode->length+=1;
-	    leftNode->length -=1;
-	}
-	//Do not include the pushed index in the left leaf, so decrement the left leaf by one.
-	leftNode->length-=1;
-    }
-    
-    //Insert the <key,leftPage,rightPage> into this non-leaf node.  Either the left OR right
-    int insertIndex = -1;
-    if(my_key < rightNode->keyArray[0]){
-
-        //Insert in the left leaf
-        for(int i=0;i<leftNode->length;i++){
-            if(my_key<leftNode->keyArray[i]){
-                insertIndex = i;
-                break;
-            }
-        }
-        //key is largest in the leaf node
-        if(insertIndex==-1){
-            leftNode->keyArray[leftNode->length] = my_key;
-            leftNode->pageNoArray[leftNode->length] = inputLeftId;
-	    leftNode->pageNoArray[leftNode->length+1] = inputRightId;
-	    leftNode->length+=1;
-        }
-        //Make room for the new insert by moving all nodes with keys > my_key down one index.
-        //Need to maintain sorted order for all keys
-        else{
-	    //Move the last pageNo down one index
-	    leftNode->pageNoArray[leftNode->length+1] = leftNode->pageNoArray[rightNode->length];
-            //Move the <key,pageNo> indecies down one to make room for new insert
-            for(int i=leftNode->length-1;i>=insertIndex;i--){
-                leftNode->keyArray[i+1] = leftNode->keyArray[i];
-                leftNode->pageNoArray[i+1] = leftNode->pageNoArray[i];
-	    }
-            //Move in the new key 
-            leftNode->keyArray[insertIndex] = my_key;
-            leftNode->pageNoArray[insertIndex] = inputLeftId;
-	    //This shouldn't do anything - DELETE
-	    //std::cout<<leftNode->pageNoArray[insertIndex+1]<<" should equal: "<<inputRightId<<"\n";
-	    leftNode->pageNoArray[insertIndex+1] = inputRightId;
-            leftNode->length+=1;
-        }
-    }     
-    else{
-        //Insert into the right leaf
-        //Insert in the left leaf
-        for(int i=0;i<rightNode->length;i++){
-            if(my_key<rightNode->keyArray[i]){
-                insertIndex = i;
-                break;
-            }
-        }
-        //key is largest in the leaf node
-        if(insertIndex==-1){
-            rightNode->keyArray[rightNode->length] = my_key;
-            rightNode->pageNoArray[rightNode->length] = inputLeftId;
-	    rightNode->pageNoArray[rightNode->length+1] = inputRightId;
-	    rightNode->length+=1;
-        }
-        //Make room for the new insert by moving all nodes with keys > my_key down one index.
-        //Need to maintain sorted order for all keys
-        else{
-	    //Move the last pageNo down one index
-	    rightNode->pageNoArray[rightNode->length+1] = rightNode->pageNoArray[rightNode->length];
-            //Move the <key,pageNo> indecies down one to make room for new insert
-            for(int i=rightNode->length-1;i>=insertIndex;i--){
-                rightNode->keyArray[i+1] = rightNode->keyArray[i];
-                rightNode->pageNoArray[i+1] = rightNode->pageNoArray[i];
-            }
-            //Move in the new key 
-            rightNode->keyArray[insertIndex] = my_key;
-            rightNode->pageNoArray[insertIndex] = inputLeftId;
-	    //This should do anything -DELETE
-	    rightNode->pageNoArray[insertIndex+1] = inputRightId;
-            rightNode->length+=1;
-        }
     }
 
+    //Do NOT include the pushedValue/split index in the left/right pages
+    ((NonLeafNode<T>*)leftPage)->assign(keys.data(), pageNos.data(), splitIndex);
+    ((NonLeafNode<T>*)rightPage)->assign(keys.data() + splitIndex + 1, pageNos.data() + splitIndex + 1,
+                                        constLength - splitIndex - 1);
+
     //UNALLOCATE PAGES LEFT AND RIGHT
     bufMgr->unPinPage(file, leftPageNo, true);
     bufMgr->unPinPage(file, rightPageNo, true);
@@ -310,20 +1040,26 @@ int BTreeIndex::splitNonLeaf(int my_key, PageId nodeId, PageId inputLeftId, Page
 
 //Returns pushed key value
 //leftPageNo is returned through reference to leftPageNo, rightPageNo
-int BTreeIndex::splitLeaf(const void* key, const RecordId rid, PageId nodeId, PageId &leftPageNo, PageId &rightPageNo){
-    int my_key = *(int*)key;
+template <class T>
+T BTreeIndex::splitLeaf(const T& my_key, const RecordId rid, PageId nodeId, PageId &leftPageNo, PageId &rightPageNo){
 
     Page* node;
     bufMgr->readPage(file,nodeId,node);
-    LeafNodeInt* currLeaf = (LeafNodeInt*) node;
+    LeafNode<T>* currLeaf = (LeafNode<T>*) node;
     
     assert(currLeaf->leaf);
 
-    int splitIndex = (int)(currLeaf->length/2);
-    int pushedValue = currLeaf->keyArray[splitIndex];
+    //The entries of the leaf with the new <key,rid> in place
+    std::vector<RIDKeyPair<T> > pairs;
+    currLeaf->entries(pairs);
+    RIDKeyPair<T> pair;
+    pair.set(rid, my_key);
+    pairs.insert(pairs.begin() + currLeaf->search(my_key, true), pair);
+    int constLength = pairs.size();
+    int splitIndex = LeafNode<T>::splitPoint(pairs.data(), constLength);
 
-    LeafNodeInt* rightLeaf;
-    LeafNodeInt* leftLeaf;
+    LeafNode<T>* rightLeaf;
+    LeafNode<T>* leftLeaf;
 
     Page* rightPage; 
     Page* leftPage;
@@ -333,284 +1069,143 @@ int BTreeIndex::splitLeaf(const void* key, const RecordId rid, PageId nodeId, Pa
 	//Allocate two pages for the left and right
 	bufMgr->allocPage(file, leftPageNo, leftPage);
 	bufMgr->allocPage(file, rightPageNo, rightPage);
-	rightLeaf = (LeafNodeInt*)rightPage;
-	leftLeaf = (LeafNodeInt*)leftPage;
-        //Set parameters for leaves
-	rightLeaf->leaf = true;
-	leftLeaf->leaf = true;
-	rightLeaf->length = 0;
-	leftLeaf->length = 0;
-	leftLeaf->rightSibPageNo = rightPageNo;
-	rightLeaf->rightSibPageNo = 0;
-	for(int i=0;i<splitIndex;i++){
-	    leftLeaf->keyArray[i] = currLeaf->keyArray[i];
-	    leftLeaf->ridArray[i] = currLeaf->ridArray[i];
-	    leftLeaf->length+=1;
-	}
-	for(int i=splitIndex;i<currLeaf->length;i++){
-	    rightLeaf->keyArray[i - splitIndex] = currLeaf->keyArray[i];
-	    rightLeaf->ridArray[i - splitIndex] = currLeaf->ridArray[i];
-	    rightLeaf->length+=1;
-	}
-	
+	rightLeaf = (LeafNode<T>*)rightPage;
+	leftLeaf = (LeafNode<T>*)leftPage;
+	rightLeaf->clear();
+	leftLeaf->clear();
 	//Unpin the root page
 	bufMgr->unPinPage(file, nodeId, true);
     }
     else{
-        //The left and right pages are leaves because the split node was a leaf.
-        //The inputted node needs to be changed to the rightLeaf by moving the 
-        //indexes smaller than splitIndex to the left node.  This maintains pageIds
+        //The left leaf keeps the page of the inputted node, so references to it stay valid,
+        //and the entries from the split index on move to a newly allocated right page
 	bufMgr->allocPage(file, rightPageNo, rightPage);
-	rightLeaf = (LeafNodeInt*)rightPage;
+	rightLeaf = (LeafNode<T>*)rightPage;
+	rightLeaf->clear();
 
 	leftLeaf = currLeaf;
         leftPageNo = nodeId; 
-	
-        //Set parameters for leaf nodes
-        leftLeaf->leaf=true;
-        rightLeaf->leaf=true;
-    
-        rightLeaf->length = 0;
-        //Connect left page to right page
-        //Right page was allocated, and part of left page is moved to right page
-	//so the right sibling to the left page is the new right sibling to the right page,
-	//and the right sibling of the left page is the right page.
+	//The right sibling of the left page is the new right sibling to the right page
 	rightLeaf->rightSibPageNo = leftLeaf->rightSibPageNo;
-	leftLeaf->rightSibPageNo = rightPageNo;
-  
-        //Updated version - Moves keys from the left page to the right page
-        //up to the split index.  This allows the rightPageNo to be reused 
-        //as the current page no, and references to the originial Page No will
-        //still be valid through the use of the rightPageNo
-        int constLength = currLeaf->length;
-        for(int i=splitIndex;i<constLength;i++){
-	    //Move the first elements (to the split index) from the right page to the left page
-            rightLeaf->keyArray[i-splitIndex] = leftLeaf->keyArray[i];
-            rightLeaf->ridArray[i-splitIndex] = leftLeaf->ridArray[i];
-            rightLeaf->length+=1;
-            leftLeaf->length-=1;
-        }
-    }
-    //Insert the new <key,rid> into the left OR right page
-    int insertIndex = -1; 
-    if(my_key < rightLeaf->keyArray[0]){
-
-   	//Insert in the left leaf
-	for(int i=0;i<leftLeaf->length;i++){
-	    if(my_key<leftLeaf->keyArray[i]){
-		insertIndex = i;
-		break;
-	    }
-	}
-	//key is largest in the leaf node
-        if(insertIndex==-1){
-            leftLeaf->keyArray[leftLeaf->length] = my_key;
-            leftLeaf->ridArray[leftLeaf->length] = rid;
-	    leftLeaf->length+=1;
-            rightLeaf->rightSibPageNo = 0;
-	}
-        //Make room for the new insert by moving all nodes with keys > my_key down one index.
-        //Need to maintain sorted order for all keys
-        else{
-            //Move the <key,pageNo> indecies down one to make room for new insert
-            for(int i=leftLeaf->length-1;i>=insertIndex;i--){
-                leftLeaf->keyArray[i+1] = leftLeaf->keyArray[i];
-                leftLeaf->ridArray[i+1] = leftLeaf->ridArray[i];
-            }
-            //Move in the new key 
-            leftLeaf->keyArray[insertIndex] = my_key;
-            leftLeaf->ridArray[insertIndex] = rid;
-            leftLeaf->length+=1;
-        }
-    }
-    else{
-	//Insert into the right leaf
-	//Insert in the left leaf
-        for(int i=0;i<rightLeaf->length;i++){
-            if(my_key<rightLeaf->keyArray[i]){
-                insertIndex = i;
-                break;
-            }
-        }
-        //key is largest in the leaf node
-        if(insertIndex==-1){
-            rightLeaf->keyArray[rightLeaf->length] = my_key;
-            rightLeaf->ridArray[rightLeaf->length] = rid;
-            rightLeaf->length+=1;
-        }
-        //Make room for the new insert by moving all nodes with keys > my_key down one index.
-        //Need to maintain sorted order for all keys
-        else{
-            //Move the <key,pageNo> indecies down one to make room for new insert
-            for(int i=rightLeaf->length-1;i>=insertIndex;i--){
-                rightLeaf->keyArray[i+1] = rightLeaf->keyArray[i];
-                rightLeaf->ridArray[i+1] = rightLeaf->ridArray[i];
-            }
-            //Move in the new key 
-            rightLeaf->keyArray[insertIndex] = my_key;
-            rightLeaf->ridArray[insertIndex] = rid;
-            rightLeaf->length+=1;
-        }
     }
+    leftLeaf->rightSibPageNo = rightPageNo;
+    leftLeaf->assign(pairs.data(), splitIndex);
+    rightLeaf->assign(pairs.data() + splitIndex, constLength - splitIndex);
+
+    //Push up the shortest key that still separates the two leaves
+    T pushedValue = separatorKey(pairs[splitIndex - 1].key, pairs[splitIndex].key);
     bufMgr->unPinPage(file, rightPageNo, true);
     bufMgr->unPinPage(file, leftPageNo, true);
-    //return
-    //rightPageNo = rightTmpNo;
-    //leftPageNo = leftTmpNo;
     return pushedValue;
 }
-void BTreeIndex::splitRec(int pushedKey, PageId leftPageNo, PageId rightPageNo, int traversalIndex, std::vector<PageId> traversal){
+template <class T>
+void BTreeIndex::splitRec(const T& pushedKey, PageId leftPageNo, PageId rightPageNo, int traversalIndex, std::vector<PageId> traversal){
     PageId currId = traversal[traversalIndex];
     Page* currPage;
     bufMgr->readPage(file, currId, currPage);
-    NonLeafNodeInt* curr = (NonLeafNodeInt*)currPage;
+    NonLeafNode<T>* curr = (NonLeafNode<T>*)currPage;
 
-    //Base case 1: Root must be a non-leaf (and is full)
-    //can only get here once after the root is split
     //Base case 1:  Root is a leaf
     if(curr->leaf && currId==rootPageNum){
-	//std::cout<<"\nBASE CASE 1: Root is a leaf and has been split\n";
-	curr->keyArray[0] = pushedKey;
-	curr->pageNoArray[0] = leftPageNo;
-	curr->pageNoArray[1] = rightPageNo;
-	curr->length = 1;
-	//std::cout<<"Setting pageNo: "<<currId<<" with length: "<<curr->length<<"\n";
-	curr->leaf = false;
-        bufMgr->unPinPage(file, currId, currPage);
-       	return;
-    }
-    //Base case 2: Root is not a leaf, but is full
-    if(currId == rootPageNum && curr->length >= nodeOccupancy){
-	//std::cout<<"\nBASE CASE 2: Root is not a leaf but is full\n";
-    	//Split root node 
-	PageId splitLeftId;
-	PageId splitRightId;
-	int rootPushedKey = splitNonLeaf(pushedKey,currId,leftPageNo,rightPageNo,splitLeftId,splitRightId);
-    	curr->keyArray[0] = rootPushedKey;
-        curr->pageNoArray[0] = splitLeftId;
-        curr->pageNoArray[1] = splitRightId;
-
-	//std::cout<<"root left page no: "<<splitLeftId<<" right page no: "<<splitRightId<<"\n";
-	curr->length = 1;
-        //std::cout<<"Setting pageNo: "<<currId<<" with length: "<<curr->length<<"\n";
-        curr->leaf = false;
-	bufMgr->unPinPage(file, currId, true);
-        return;
-    }
-    //Base case 3: Current has room 
-    if(curr->length < nodeOccupancy){
-	int insertIndex = -1;
-        //Parent has room -> Find location
-        for(int i=0;i<curr->length;i++){
-	    if(pushedKey<curr->keyArray[i]){
-                insertIndex = i;
-                break;
-            }
-        }
-        //key is largest in the leaf node
-        if(insertIndex==-1){
-            curr->keyArray[curr->length] = pushedKey;
-            curr->pageNoArray[curr->length] = leftPageNo;
-	    curr->pageNoArray[curr->length+1] = rightPageNo;
-	    curr->length+=1;
-        }
-        //Make room for the new insert by moving all nodes with keys > my_key down one index.
-        //Need to maintain sorted order for all keys
-        else{
-	    //Move the last page no down one index
-	    curr->pageNoArray[curr->length+1] = curr->pageNoArray[curr->length];
-            //Move the <key,pageNo> indecies down one to make room for new insert
-            for(int i=curr->length-1;i>=insertIndex;i--){
-                curr->keyArray[i+1] = curr->keyArray[i];
-                curr->pageNoArray[i+1] = curr->pageNoArray[i];
-            }
-            //Move in the new key 
-            curr->keyArray[insertIndex] = pushedKey;
-            curr->pageNoArray[insertIndex] = leftPageNo;
-	    curr->pageNoArray[insertIndex+1] = rightPageNo;
-	    curr->length+=1;
-        }
+	const PageId children[2] = {leftPageNo, rightPageNo};
+	curr->assign(&pushedKey, children, 1);
+        bufMgr->unPinPage(file, currId, true);
+       	return;
+    }
+    //Base case 2: Current has room -> insert next to the split child
+    if(curr->insert(childSlot(curr, pushedKey, leftPageNo), pushedKey, rightPageNo)){
 	bufMgr->unPinPage(file, currId, true);
+	return;
     }
-    else{
-	//std::cout<<"\nRecursive case: Split current node and push value,pageIds to parent\n";
-	int nextPushedValue;
-	PageId splitLeftNo;
-	PageId splitRightNo;
-	//split and insert the current page into a pushed value, and a left/right PageId
-	nextPushedValue = splitNonLeaf(pushedKey, currId, leftPageNo, rightPageNo, splitLeftNo, splitRightNo);
-	bufMgr->unPinPage(file,currId,true);
-	//std::cout<<"next pushed value: "<<nextPushedValue<<" splitLeftNo: "<<splitLeftNo<<" splitRightNo: "<<splitRightNo<<" currId: "<<currId<<"\n";
-	//Recursively push up the pushedValue from the split to the parent level, along with the PageIds to the now split current page
-	//std::cout<<"Current traversal page no: "<<traversal[traversalIndex]<<"\n";
-	//std::cout<<"current traversal index: "<<traversalIndex<<"\n";
-	//std::cout<<"Next traversal page no: "<<traversal[traversalIndex-1]<<"\n";
-	splitRec(nextPushedValue, splitLeftNo, splitRightNo, traversalIndex - 1, traversal);
+    //Base case 3: Root is not a leaf, but is full
+    if(currId == rootPageNum){
+    	//Split root node 
+	PageId splitLeftId;
+	PageId splitRightId;
+	T rootPushedKey = splitNonLeaf(pushedKey,currId,leftPageNo,rightPageNo,splitLeftId,splitRightId);
+	const PageId children[2] = {splitLeftId, splitRightId};
+	curr->assign(&rootPushedKey, children, 1);
+	bufMgr->unPinPage(file, currId, true);
+        return;
     }
+    //Recursive case: Split current node and push value,pageIds to parent
+    T nextPushedValue;
+    PageId splitLeftNo;
+    PageId splitRightNo;
+    //split and insert the current page into a pushed value, and a left/right PageId
+    nextPushedValue = splitNonLeaf(pushedKey, currId, leftPageNo, rightPageNo, splitLeftNo, splitRightNo);
+    bufMgr->unPinPage(file,currId,true);
+    //Recursively push up the pushedValue from the split to the parent level, along with the PageIds to the now split current page
+    splitRec(nextPushedValue, splitLeftNo, splitRightNo, traversalIndex - 1, traversal);
 }
 
 // Private helper - tree traversal
-PageId BTreeIndex::traverseTree(const int key, std::vector<PageId>& traversal)
+template <class T>
+PageId BTreeIndex::traverseTree(const T& key, std::vector<PageId>& traversal, const bool exclusive,
+                                std::vector<std::pair<PageId, Page*> >& latched, const bool lowerBound,
+                                const bool forDelete, const bool keepPath)
 {
 
     // std::cout << "Started tree traversal with key " << key << "." << std::endl;
 
     // retrieve root
-    Page* rootPage;
-    bufMgr->readPage(file, rootPageNum, rootPage);
-    NonLeafNodeInt* root = (NonLeafNodeInt*) rootPage; // cast type
+    Page* currPage;
+    PageId currPageNo = rootPageNum;
+    bufMgr->readPage(file, currPageNo, currPage);
+    bufMgr->latchPage(currPage, exclusive);
+    NonLeafNode<T>* curr = (NonLeafNode<T>*) currPage; // cast type
 
     // init traversal vector
     traversal.clear();
-    if(root->length==1){
-	//std::cout<<"root lenght one.  left page no: "<<root->pageNoArray[0]<<" right page no: "<<root->pageNoArray[1]<<"\n";
-    }
+    latched.clear();
+    latched.push_back(std::make_pair(currPageNo, currPage));
+
     // find leaf page L where key belongs
-    if (root->leaf) {
-        // root is the leaf, just return the root
-        // traversal list contains no non-leaf pageIds
-        bufMgr->unPinPage(file, rootPageNum, false);
-        
-	traversal.push_back(rootPageNum);
+    if (curr->leaf) {
+        // root is the leaf, it stays latched
+        traversal.push_back(rootPageNum);
 
         // std::cout << ">>> Traversal done: returned root node." << std::endl;
         return rootPageNum;
-    } else {
-        // general case
-        Page* currPage = rootPage;
-        NonLeafNodeInt* curr = root;
-        PageId currPageNo = rootPageNum;
-        while (!curr->leaf) {
-            // save traversal path
-            traversal.push_back(currPageNo);
-
-	    int found = 0;
-            for (int i=0; i<curr->length; i++) {
-               if (key < curr->keyArray[i]) {
-                   // go to next non-leaf node
-                   PageId nextPageNo = curr->pageNoArray[i];
-                   bufMgr->readPage(file, nextPageNo, currPage);
-                   curr = (NonLeafNodeInt*) currPage;
-                   bufMgr->unPinPage(file, currPageNo, false);
-                   currPageNo = nextPageNo;
-                   found = 1;
-		   break;
-               } 
-            }
+    }
+    while (!curr->leaf) {
+        // save traversal path
+        traversal.push_back(currPageNo);
 
-            // if the key ended up larger than any key in the list
-            if (found==0 && key >= curr->keyArray[curr->length - 1]) {
-               PageId nextPageNo = curr->pageNoArray[curr->length];
-               bufMgr->readPage(file, nextPageNo, currPage);
-               curr = (NonLeafNodeInt*) currPage;
-               bufMgr->unPinPage(file, currPageNo, false);
-               currPageNo = nextPageNo;
-            }
+        // child i holds the keys below key(i); the last child holds the rest
+        PageId nextPageNo = curr->pageNo(curr->search(key, !lowerBound));
+        bufMgr->readPage(file, nextPageNo, currPage);
+        bufMgr->latchPage(currPage, exclusive);
+        curr = (NonLeafNode<T>*) currPage;
+
+        // the latched ancestors can be let go once a split (or for a delete, an underflow)
+        // can no longer propagate up to them
+        bool safe = true;
+        if (keepPath) {
+            safe = false;
+        } else if (exclusive && forDelete) {
+            safe = curr->leaf ? ((LeafNode<T>*)currPage)->canRemove() : curr->canRemove();
+        } else if (exclusive) {
+            safe = curr->leaf ? ((LeafNode<T>*)currPage)->canInsert(key) : curr->hasRoom();
+        }
+        if (safe) {
+            releaseLatches(latched, exclusive, false);
         }
-        bufMgr->unPinPage(file, currPageNo, false);
-        // std::cout << ">>> Traversal done: found leaf at depth " << traversal.size() << std::endl;
-        return currPageNo;
+        latched.push_back(std::make_pair(nextPageNo, currPage));
+        currPageNo = nextPageNo;
+    }
+    // std::cout << ">>> Traversal done: found leaf at depth " << traversal.size() << std::endl;
+    return currPageNo;
+}
+
+// Private helper - release the pages latched by traverseTree
+void BTreeIndex::releaseLatches(std::vector<std::pair<PageId, Page*> >& latched, const bool exclusive, const bool dirty)
+{
+    for (std::size_t i = 0; i < latched.size(); i++) {
+        bufMgr->unLatchPage(latched[i].second, exclusive);
+        bufMgr->unPinPage(file, latched[i].first, dirty);
     }
+    latched.clear();
 }
 
 // -----------------------------------------------------------------------------
@@ -618,101 +1213,474 @@ PageId BTreeIndex::traverseTree(const int key, std::vector<PageId>& traversal)
 // -----------------------------------------------------------------------------
 
 
-//Check for boundary condition:  make sure the entire page is full before splitting.
 void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
 {
     // Add your code below. Please do not remove this line.
-    int my_key = *(int*)key;
+    switch (attributeType) {
+    case INTEGER:
+        insertEntryKey(readKey<int>(key), rid);
+        break;
+    case DOUBLE:
+        insertEntryKey(readKey<double>(key), rid);
+        break;
+    case STRING:
+        insertEntryKey(readKey<StringKey>(key), rid);
+        break;
+    }
+}
+
+//Check for boundary condition:  make sure the entire page is full before splitting.
+template <class T>
+void BTreeIndex::insertEntryKey(const T& my_key, const RecordId rid) 
+{
 
     PageId leafPageNo;
     std::vector<PageId> traversal;
-    leafPageNo = traverseTree(my_key, traversal);
-    //Find the leaf page & leafPageNo from the B+Tree
-    //search(my_key, leafPageNo);
+    std::vector<std::pair<PageId, Page*> > latched;
+    //Find the leaf page & leafPageNo from the B+Tree. The leaf and every ancestor the
+    //insert may split are returned latched exclusively.
+    leafPageNo = traverseTree(my_key, traversal, true, latched);
     
-    //Read in leaf
-    Page* leafPage;
-    bufMgr->readPage(file,leafPageNo,leafPage);
-    LeafNodeInt* leaf = (LeafNodeInt*)leafPage; 
-    // try to insert key,rid pair in L
-    if (leaf->length < leafOccupancy) {
-	int insertIndex = -1;
-	//Changed:  Now moves all the indexes smaller than the my_key value down 1 index,
-	//and makes room for the new <key,rid> pair to be inserted into this leaf node.
-	for(int i=0;i<leaf->length;i++) {
-	    //Find the location where the new <key,rid> pair will be inserted in the leaf node.
-	    if(my_key < leaf->keyArray[i]) {
-		insertIndex = i;
-		break;
-	    }
-	}
-	//All keys in the keyArray are smaller than the inserted node -> insert as the last element
-	if(insertIndex == -1){
-	    leaf->keyArray[leaf->length] = my_key;
-	    leaf->ridArray[leaf->length] = rid;
-	    leaf->length = leaf->length + 1;
-	}
-	//Move down all elements following insertIndex to make room for the new key,rid.
-	else{
-	    //Move all the elements after and including the element in the insertIndex down 1 index to make
-	    //room for the new <key,rid> elemnent that is inserted into the keyArray, ridArray.
-	    for(int i=leaf->length-1;i>=insertIndex;i--){
-	        leaf->keyArray[i+1] = leaf->keyArray[i];
-	        leaf->ridArray[i+1] = leaf->ridArray[i];
-	    }
-	    //Insert the new element in the newly created spot
-	    leaf->keyArray[insertIndex] = my_key;
-	    leaf->ridArray[insertIndex] = rid;
-	    //Add one element to maintain length in the leaf node.
-            leaf->length += 1;
-	}
-    }
-    //Leaf node needs to be split->pushed to parent node
-    else {
+    Page* leafPage = latched.back().second;
+    LeafNode<T>* leaf = (LeafNode<T>*)leafPage; 
+    // try to insert key,rid pair in L, after any entries with the same key
+    if (!leaf->insert(leaf->search(my_key, true), my_key, rid)) {
+	//Leaf node needs to be split->pushed to parent node
 	PageId leftPageNo;
 	PageId rightPageNo;
 	
-	int pushedValue = splitLeaf(key, rid, leafPageNo, leftPageNo, rightPageNo);
+	T pushedValue = splitLeaf(my_key, rid, leafPageNo, leftPageNo, rightPageNo);
 
 	//Recursively push the middle value into the B+ Tree
 	//This will only happen once, when the root was first split, there were
 	//two pages allocated as its left/right children, so root is already the parent
 	//to be split recursively (This situation is base case 1 in splitRec)
+	//splitRec stops at the first node with room, which is the topmost page still latched.
 	splitRec(pushedValue, leftPageNo, rightPageNo, traversal.size()-1, traversal);
     }
-    bufMgr->unPinPage(file, leafPageNo, true);
+    releaseLatches(latched, true, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::deleteEntry(const void *key, const RecordId rid)
+{
+    switch (attributeType) {
+    case INTEGER:
+        deleteEntryKey(readKey<int>(key), rid);
+        break;
+    case DOUBLE:
+        deleteEntryKey(readKey<double>(key), rid);
+        break;
+    case STRING:
+        deleteEntryKey(readKey<StringKey>(key), rid);
+        break;
+    }
+}
+
+template <class T>
+void BTreeIndex::deleteEntryKey(const T& my_key, const RecordId rid)
+{
+    // position of <my_key,rid> in a leaf, or of the first larger key if it is not there
+    auto findEntry = [&](LeafNode<T>* leaf) {
+        int entry = leaf->search(my_key, false);
+        while (entry < leaf->length && leaf->key(entry) == my_key && !(leaf->rid(entry) == rid)) {
+            entry++;
+        }
+        return entry;
+    };
+
+    std::vector<PageId> traversal;
+    std::vector<std::pair<PageId, Page*> > latched;
+    std::vector<PageId> freedPages;
+    //The leaf an insert of my_key would go to. Unless my_key has duplicates spread over
+    //several leaves, the entry is there, and the leaf and every ancestor an underflow may
+    //reach are returned latched exclusively.
+    traverseTree(my_key, traversal, true, latched, false, true);
+    LeafNode<T>* leaf = (LeafNode<T>*)latched.back().second;
+    int entry = findEntry(leaf);
+    if (entry < leaf->length && leaf->key(entry) == my_key) {
+        leaf->remove(entry);
+        rebalance<T>(latched, freedPages);
+        releaseLatches(latched, true, true);
+        releasePages(freedPages);
+        return;
+    }
+    releaseLatches(latched, true, false);
+
+    //The entry is in a leaf further left, among duplicates of my_key. Walk the leaves from the
+    //leftmost one that may hold it with the whole path from the root latched, so that the leaf the
+    //entry is found in can be rebalanced like above. Duplicates spanning leaves are rare.
+    traverseTree(my_key, traversal, true, latched, true, true, true);
+    bool found = false;
+    while (true) {
+        leaf = (LeafNode<T>*)latched.back().second;
+        entry = findEntry(leaf);
+        if (entry < leaf->length) {
+            found = leaf->key(entry) == my_key;
+            break;
+        }
+        if (!nextLeafOnPath<T>(latched)) {
+            break;
+        }
+    }
+    if (!found) {
+        releaseLatches(latched, true, false);
+        throw NoSuchKeyFoundException();
+    }
+    leaf->remove(entry);
+    rebalance<T>(latched, freedPages);
+    releaseLatches(latched, true, true);
+    releasePages(freedPages);
+}
+
+// Private helper - move a fully latched path over to the next leaf
+template <class T>
+bool BTreeIndex::nextLeafOnPath(std::vector<std::pair<PageId, Page*> >& latched)
+{
+    //Climb to the deepest node with a child right of the path
+    int level = latched.size() - 1;
+    int childIndex = 0;
+    NonLeafNode<T>* parent = NULL;
+    for (; level > 0; level--) {
+        parent = (NonLeafNode<T>*)latched[level - 1].second;
+        childIndex = 0;
+        while (parent->pageNo(childIndex) != latched[level].first) {
+            childIndex++;
+        }
+        if (childIndex < parent->length) {
+            break;
+        }
+    }
+    if (level == 0) {
+        return false;
+    }
+
+    //Let go of the nodes below it, then descend along the leftmost children of that child
+    for (int i = latched.size() - 1; i >= level; i--) {
+        bufMgr->unLatchPage(latched[i].second, true);
+        bufMgr->unPinPage(file, latched[i].first, false);
+    }
+    latched.resize(level);
+    PageId pageNo = parent->pageNo(childIndex + 1);
+    while (true) {
+        Page* page;
+        bufMgr->readPage(file, pageNo, page);
+        bufMgr->latchPage(page, true);
+        latched.push_back(std::make_pair(pageNo, page));
+        NonLeafNode<T>* node = (NonLeafNode<T>*)page;
+        if (node->leaf) {
+            return true;
+        }
+        pageNo = node->pageNo(0);
+    }
+}
+
+// Private helper - fix up underflowing nodes after a delete
+template <class T>
+void BTreeIndex::rebalance(std::vector<std::pair<PageId, Page*> >& latched, std::vector<PageId>& freedPages)
+{
+    for (int level = latched.size() - 1; level > 0; level--) {
+        PageId nodePageNo = latched[level].first;
+        Page* nodePage = latched[level].second;
+        NonLeafNode<T>* node = (NonLeafNode<T>*)nodePage; // leaf and length sit at the same place in a leaf
+        NonLeafNode<T>* parent = (NonLeafNode<T>*)latched[level - 1].second;
+        bool underfull = node->leaf ? ((LeafNode<T>*)nodePage)->underfull() : node->underfull();
+        if (!underfull || parent->length == 0) {
+            break;
+        }
+
+        //Pair the node with its right sibling under the same parent, or with its left one if it is
+        //the last child. Leaves are latched left to right by scans, so the node is let go while its
+        //left sibling gets latched; the parent keeps other writers away meanwhile.
+        int childIndex = 0;
+        while (parent->pageNo(childIndex) != nodePageNo) {
+            childIndex++;
+        }
+        int sepIndex = childIndex < parent->length ? childIndex : childIndex - 1;
+        PageId siblingPageNo = parent->pageNo(childIndex < parent->length ? childIndex + 1 : childIndex - 1);
+        Page* siblingPage;
+        bufMgr->readPage(file, siblingPageNo, siblingPage);
+        if (childIndex < parent->length) {
+            bufMgr->latchPage(siblingPage, true);
+        } else {
+            bufMgr->unLatchPage(nodePage, true);
+            bufMgr->latchPage(siblingPage, true);
+            bufMgr->latchPage(nodePage, true);
+        }
+        Page* leftPage = childIndex < parent->length ? nodePage : siblingPage;
+        Page* rightPage = childIndex < parent->length ? siblingPage : nodePage;
+        PageId rightPageNo = childIndex < parent->length ? siblingPageNo : nodePageNo;
+
+        bool merged = node->leaf ? rebalanceLeaves(parent, sepIndex, (LeafNode<T>*)leftPage, (LeafNode<T>*)rightPage)
+                                 : rebalanceNonLeaves(parent, sepIndex, (NonLeafNode<T>*)leftPage, (NonLeafNode<T>*)rightPage);
+        if (merged) {
+            // a scan still on the right page sees it is no longer a leaf and descends again
+            ((NonLeafNode<T>*)rightPage)->leaf = false;
+            ((NonLeafNode<T>*)rightPage)->length = 0;
+            freedPages.push_back(rightPageNo);
+        }
+        bufMgr->unLatchPage(siblingPage, true);
+        bufMgr->unPinPage(file, siblingPageNo, true);
+    }
+
+    //A root left with a single child takes over its contents; the root stays at rootPageNum
+    Page* rootPage = latched[0].second;
+    NonLeafNode<T>* root = (NonLeafNode<T>*)rootPage;
+    if (latched[0].first != rootPageNum || root->leaf || root->length > 0) {
+        return;
+    }
+    PageId childPageNo = root->pageNo(0);
+    bool childLatched = latched.size() > 1 && latched[1].first == childPageNo;
+    Page* childPage;
+    if (childLatched) {
+        childPage = latched[1].second;
+    } else {
+        bufMgr->readPage(file, childPageNo, childPage);
+        bufMgr->latchPage(childPage, true);
+    }
+    *rootPage = *childPage;
+    ((NonLeafNode<T>*)childPage)->leaf = false;
+    ((NonLeafNode<T>*)childPage)->length = 0;
+    freedPages.push_back(childPageNo);
+    if (!childLatched) {
+        bufMgr->unLatchPage(childPage, true);
+        bufMgr->unPinPage(file, childPageNo, true);
+    }
+}
+
+// Private helper - merge or balance two sibling leaves
+template <class T>
+bool BTreeIndex::rebalanceLeaves(NonLeafNode<T>* parent, const int sepIndex, LeafNode<T>* left, LeafNode<T>* right)
+{
+    std::vector<RIDKeyPair<T> > pairs;
+    left->entries(pairs);
+    right->entries(pairs);
+    const int count = pairs.size();
+    if (LeafNode<T>::fits(pairs.data(), count)) {
+        //Merge: the entries of right go after those of left, and right drops out of the leaf chain
+        left->assign(pairs.data(), count);
+        left->rightSibPageNo = right->rightSibPageNo;
+        parent->remove(sepIndex);
+        return true;
+    }
+
+    //Balance: split the entries of both leaves anew. Should the new separator not fit in a STRING
+    //parent, both leaves are left as they are; they are only underfull, not wrong.
+    const int split = LeafNode<T>::splitPoint(pairs.data(), count);
+    if (!parent->setKey(sepIndex, separatorKey(pairs[split - 1].key, pairs[split].key))) {
+        return false;
+    }
+    left->assign(pairs.data(), split);
+    right->assign(pairs.data() + split, count - split);
+    return false;
+}
+
+// Private helper - merge or balance two sibling non-leaf nodes
+template <class T>
+bool BTreeIndex::rebalanceNonLeaves(NonLeafNode<T>* parent, const int sepIndex, NonLeafNode<T>* left, NonLeafNode<T>* right)
+{
+    //The separator comes down between the keys of left and those of right
+    std::vector<T> keys;
+    std::vector<PageId> pageNos;
+    left->entries(keys, pageNos);
+    keys.push_back(parent->key(sepIndex));
+    right->entries(keys, pageNos);
+    const int count = keys.size();
+    if (NonLeafNode<T>::fits(keys.data(), count)) {
+        //Merge
+        left->assign(keys.data(), pageNos.data(), count);
+        parent->remove(sepIndex);
+        return true;
+    }
+
+    //Balance: rotate children through the separator until both nodes hold about half of the keys
+    const int split = NonLeafNode<T>::splitPoint(keys.data(), count);
+    if (!parent->setKey(sepIndex, keys[split])) {
+        return false;
+    }
+    left->assign(keys.data(), pageNos.data(), split);
+    right->assign(keys.data() + split + 1, pageNos.data() + split + 1, count - split - 1);
+    return false;
+}
+
+// Private helper - give unlinked pages back to the file
+void BTreeIndex::releasePages(const std::vector<PageId>& freedPages)
+{
+    std::lock_guard<std::mutex> guard(unreleasedPagesLatch);
+    unreleasedPages.insert(unreleasedPages.end(), freedPages.begin(), freedPages.end());
+    std::vector<PageId> stillPinned;
+    for (std::size_t i = 0; i < unreleasedPages.size(); i++) {
+        try {
+            bufMgr->disposePage(file, unreleasedPages[i]);
+        } catch (const PagePinnedException &e) {
+            // a scan has not moved off the page yet
+            stillPinned.push_back(unreleasedPages[i]);
+        }
+    }
+    unreleasedPages.swap(stillPinned);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::Cursor::Cursor -- Constructor
+// -----------------------------------------------------------------------------
+
+BTreeIndex::Cursor::Cursor(BTreeIndex *index)
+{
+    this->index = index;
+
+    // init fields specific to scanning
+    scanExecuting = false;
+    nextEntry = -1;
+    currentPageNum = -1;
+    currentPageData = NULL;
+    leavesUntilReadAhead = 0;
+    lowValInt = -1;
+    highValInt = -1;
+    lowOp = GT;
+    highOp = LT;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::Cursor::~Cursor -- destructor
+// -----------------------------------------------------------------------------
+
+BTreeIndex::Cursor::~Cursor()
+{
+    if (scanExecuting) {
+        endScan();
+    }
 }
 
+// Scan fields by key type
+template <> int& BTreeIndex::Cursor::lowVal<int>() { return lowValInt; }
+template <> int& BTreeIndex::Cursor::highVal<int>() { return highValInt; }
+template <> int& BTreeIndex::Cursor::nextKey<int>() { return nextKeyInt; }
+template <> double& BTreeIndex::Cursor::lowVal<double>() { return lowValDouble; }
+template <> double& BTreeIndex::Cursor::highVal<double>() { return highValDouble; }
+template <> double& BTreeIndex::Cursor::nextKey<double>() { return nextKeyDouble; }
+template <> StringKey& BTreeIndex::Cursor::lowVal<StringKey>() { return lowValString; }
+template <> StringKey& BTreeIndex::Cursor::highVal<StringKey>() { return highValString; }
+template <> StringKey& BTreeIndex::Cursor::nextKey<StringKey>() { return nextKeyString; }
+
 // Private helper - move the scan to the next entry
-void BTreeIndex::advanceScan()
+template <class T>
+bool BTreeIndex::Cursor::advanceScan()
 {
-    LeafNodeInt* currLeaf = (LeafNodeInt*)currentPageData;
-    if (nextEntry >= currLeaf->length-1) {
+    LeafNode<T>* currLeaf = (LeafNode<T>*)currentPageData;
+    // leaves emptied by deletes are stepped over
+    while (nextEntry >= currLeaf->length-1) {
         // need to go to a new page
         PageId nextPageNum = currLeaf->rightSibPageNo;
         if (nextPageNum == 0) { // sentinel value: no more pages left
-            // set flag values to signal no nextEntry is available
+            // signal no nextEntry is available; the last leaf stays pinned until endScan
             nextEntry = -1;
-            currentPageNum = 0;
-            currentPageData = NULL;
-            throw IndexScanCompletedException();
+            return false;
         }
-        bufMgr->readPage(file, nextPageNum, currentPageData);
+        Page* nextPageData;
+        index->bufMgr->readPage(index->file, nextPageNum, nextPageData);
+        index->bufMgr->latchPage(nextPageData, false);
         //std::cout<<"new page no: "<<nextPageNum<<"\n";
-    	// unpin old
-        bufMgr->unPinPage(file, currentPageNum, false);
+    	// unlatch and unpin old
+        index->bufMgr->unLatchPage(currentPageData, false);
+        index->bufMgr->unPinPage(index->file, currentPageNum, false);
     	currentPageNum = nextPageNum;
+        currentPageData = nextPageData;
+        currLeaf = (LeafNode<T>*)currentPageData;
         //Will be incremented below
 	nextEntry = -1;
+
+        // keep the leaves ahead of a long scan staged in the buffer pool
+        if (leavesUntilReadAhead == 0) {
+            index->bufMgr->readAhead(index->file, currentPageNum, BufMgr::READ_AHEAD_PAGES, nextLeaf<T>);
+            leavesUntilReadAhead = BufMgr::READ_AHEAD_PAGES / 2;
+        }
+        leavesUntilReadAhead--;
     }
     ++nextEntry;
+    return true;
+}
+
+template <class T>
+PageId BTreeIndex::Cursor::nextLeaf(const Page& page)
+{
+    const LeafNode<T>* leaf = (const LeafNode<T>*)&page;
+    // a right sibling of 0 marks the last leaf, as Page::INVALID_NUMBER marks the end of the chain
+    return leaf->leaf ? leaf->rightSibPageNo : Page::INVALID_NUMBER;
+}
+
+// Private helper - find the scan position again after the current leaf was latched
+template <class T>
+bool BTreeIndex::Cursor::relocateScan()
+{
+    const T& key = nextKey<T>();
+    LeafNode<T>* currLeaf = (LeafNode<T>*)currentPageData;
+    if (currLeaf->leaf && nextEntry < currLeaf->length
+        && currLeaf->key(nextEntry) == key && currLeaf->rid(nextEntry) == nextRid) {
+        // nothing moved
+        return true;
+    }
+    // the scan was on the root leaf, which has been split, or on a leaf merged away by a delete
+    bool descend = !currLeaf->leaf;
+    bool ownLeaf = !descend;
+    while (true) {
+        if (descend) {
+            index->bufMgr->unLatchPage(currentPageData, false);
+            index->bufMgr->unPinPage(index->file, currentPageNum, false);
+            std::vector<PageId> traversal;
+            std::vector<std::pair<PageId, Page*> > latched;
+            currentPageNum = index->traverseTree(key, traversal, false, latched, true);
+            currentPageData = latched.back().second;
+            descend = false;
+        }
+        currLeaf = (LeafNode<T>*)currentPageData;
+        // skip the keys below the recorded one, then look for its rid among the equal keys;
+        // deletes shift entries left, so the search starts from the beginning of the leaf
+        nextEntry = currLeaf->search(key, false);
+        const bool atLeafStart = nextEntry == 0;
+        for (; nextEntry < currLeaf->length; nextEntry++) {
+            const T entryKey = currLeaf->key(nextEntry);
+            if (entryKey == key && currLeaf->rid(nextEntry) == nextRid) {
+                return true;
+            }
+            if (entryKey > key) {
+                break;
+            }
+        }
+        // a delete may have moved the first entries of the scan's leaf into its left sibling: if the
+        // recorded entry could be among them, look for it again from the leftmost leaf that may hold it
+        if (ownLeaf && atLeafStart) {
+            ownLeaf = false;
+            descend = true;
+            continue;
+        }
+        ownLeaf = false;
+        if (nextEntry < currLeaf->length) {
+            // the entry is gone; carry on from the first larger key
+            return true;
+        }
+        // keep searching on the right sibling; advanceScan moves on since nextEntry is past the end
+        nextEntry = currLeaf->length - 1;
+        if (!advanceScan<T>()) {
+            return false;
+        }
+    }
+}
+
+// Private helper - check the entry at nextEntry against the high end of the range
+template <class T>
+bool BTreeIndex::Cursor::belowHighVal(const T& key)
+{
+    return (highOp == LT && key < highVal<T>()) || (highOp == LTE && key <= highVal<T>());
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::startScan
+// BTreeIndex::Cursor::startScan
 // -----------------------------------------------------------------------------
 
-void BTreeIndex::startScan(const void* lowValParm,
+void BTreeIndex::Cursor::startScan(const void* lowValParm,
 				   const Operator lowOpParm,
 				   const void* highValParm,
 				   const Operator highOpParm)
@@ -730,94 +1698,153 @@ void BTreeIndex::startScan(const void* lowValParm,
         highOp = LT;
         throw BadOpcodesException();
     }
-    lowValInt = *(int*)lowValParm;
-    highValInt = *(int*)highValParm;
+    switch (index->attributeType) {
+    case INTEGER:
+        startScanKeys<int>(lowValParm, highValParm);
+        break;
+    case DOUBLE:
+        startScanKeys<double>(lowValParm, highValParm);
+        break;
+    case STRING:
+        startScanKeys<StringKey>(lowValParm, highValParm);
+        break;
+    }
+}
+
+template <class T>
+void BTreeIndex::Cursor::startScanKeys(const void* lowValParm, const void* highValParm)
+{
+    T& low = lowVal<T>();
+    low = readKey<T>(lowValParm);
+    highVal<T>() = readKey<T>(highValParm);
     //Make sure low val < high val
-    if(lowValInt > highValInt){
-	lowValInt = -1;
-        highValInt = -1;
+    if(low > highVal<T>()){
 	throw BadScanrangeException();
     }
     scanExecuting = true;
-    lowOp = lowOpParm;
-    highOp = highOpParm;
+    leavesUntilReadAhead = 0;
 
-    //Find the leaf that would contain low val int key
+    //Find the leaf that would contain low val key. For GTE, equal keys may
+    //start in a leaf left of the separator equal to the low val.
     std::vector<PageId> traversal;
-    currentPageNum = traverseTree(lowValInt, traversal);
-
-    bufMgr->readPage(file, currentPageNum, currentPageData);
-
-    LeafNodeInt* currLeaf = (LeafNodeInt*)currentPageData;
-    // locate the first entry that matches criteria
-    nextEntry = 0;
-    while ((lowOp == GT && !(currLeaf->keyArray[nextEntry] > lowValInt))
-           || (lowOp == GTE && !(currLeaf->keyArray[nextEntry] >= lowValInt))) {
+    std::vector<std::pair<PageId, Page*> > latched;
+    currentPageNum = index->traverseTree(low, traversal, false, latched, lowOp == GTE);
+    currentPageData = latched.back().second;
 
-        try {
-            advanceScan();
-    	    if ((highOp == LT && !(currLeaf->keyArray[nextEntry] < highValInt))
-                || (highOp == LTE && !(currLeaf->keyArray[nextEntry] <= highValInt))) {
-                // hit values too large while searching for start of scan!
-                throw NoSuchKeyFoundException();
-            }
-        }
-        catch (IndexScanCompletedException &e) {
-            // hit end of index while searching for start of scan!
-            throw NoSuchKeyFoundException();
+    LeafNode<T>* currLeaf = (LeafNode<T>*)currentPageData;
+    // locate the first entry that matches criteria; only an empty root leaf has no entries
+    nextEntry = currLeaf->search(low, lowOp == GT);
+    bool found = true;
+    while (found && nextEntry == currLeaf->length) {
+        // every key of the leaf is too small: go on to the right sibling
+        // hit end of index while searching for start of scan!
+        nextEntry = currLeaf->length - 1;
+        found = advanceScan<T>();
+        currLeaf = (LeafNode<T>*)currentPageData;
+        if (found) {
+            nextEntry = currLeaf->search(low, lowOp == GT);
         }
     }
+    // hit values too large while searching for start of scan!
+    if (!found || !belowHighVal(currLeaf->key(nextEntry))) {
+        index->bufMgr->unLatchPage(currentPageData, false);
+        endScan();
+        throw NoSuchKeyFoundException();
+    }
     // successfully started to scan; nextEntry from scanNext will be first in range
-    scanExecuting = true;
+    nextKey<T>() = currLeaf->key(nextEntry);
+    nextRid = currLeaf->rid(nextEntry);
+    index->bufMgr->unLatchPage(currentPageData, false);
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::scanNext
+// BTreeIndex::Cursor::scanNext
 // -----------------------------------------------------------------------------
 
-void BTreeIndex::scanNext(RecordId& outRid) 
+void BTreeIndex::Cursor::scanNext(RecordId& outRid) 
 {
     // Add your code below. Please do not remove this line.
+    if (scanNextBatch(&outRid, 1) == 0) {
+	throw IndexScanCompletedException();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::Cursor::scanNextBatch
+// -----------------------------------------------------------------------------
+
+int BTreeIndex::Cursor::scanNextBatch(RecordId* outRids, const int maxRids)
+{
     if (!scanExecuting) {
         throw ScanNotInitializedException();
     }
 
-    // pull next entry rid, if we have one
-    if (nextEntry == -1) {
-	throw IndexScanCompletedException();
+    // nextEntry is -1 once the end of the range or of the index was reached
+    if (nextEntry == -1 || maxRids <= 0) {
+	return 0;
+    }
+    switch (index->attributeType) {
+    case INTEGER:
+        return scanNextBatchKeys<int>(outRids, maxRids);
+    case DOUBLE:
+        return scanNextBatchKeys<double>(outRids, maxRids);
+    case STRING:
+        return scanNextBatchKeys<StringKey>(outRids, maxRids);
     }
-    LeafNodeInt* currLeaf = (LeafNodeInt*)currentPageData;
+    return 0;
+}
 
-    // if highValInt reached, also exception
-    if ((highOp == LT && !(currLeaf->keyArray[nextEntry] < highValInt))
-        || (highOp == LTE && !(currLeaf->keyArray[nextEntry] <= highValInt))) {
-	throw IndexScanCompletedException();
+template <class T>
+int BTreeIndex::Cursor::scanNextBatchKeys(RecordId* outRids, const int maxRids)
+{
+    index->bufMgr->latchPage(currentPageData, false);
+    if (!relocateScan<T>()) {
+        // the entries left were moved past the end of the index
+        index->bufMgr->unLatchPage(currentPageData, false);
+        return 0;
     }
 
-    // alright, no fail conditions hit, return the value
-    outRid = currLeaf->ridArray[nextEntry];
-    
-    // prepare next entry
-    try {
-        advanceScan();
+    int numRids = 0;
+    while (numRids < maxRids) {
+        LeafNode<T>* currLeaf = (LeafNode<T>*)currentPageData;
+        int endEntry = std::min(currLeaf->length, nextEntry + (maxRids - numRids));
+        // the whole run is in range if its last key is; otherwise stop at the first key past the high val
+        bool pastHighVal = !belowHighVal(currLeaf->key(endEntry - 1));
+        if (pastHighVal) {
+            endEntry = std::max(nextEntry, std::min(endEntry, currLeaf->search(highVal<T>(), highOp == LTE)));
+        }
+        currLeaf->copyRids(nextEntry, endEntry, outRids + numRids);
+        numRids += endEntry - nextEntry;
+        if (pastHighVal) {
+            nextEntry = -1;
+            break;
+        }
+        // prepare next entry; advanceScan moves to the right sibling when the leaf is used up
+        nextEntry = endEntry - 1;
+        if (!advanceScan<T>()) {
+            break;
+        }
     }
-    catch (IndexScanCompletedException &e) {
-        // nextEntry will be -1: next time we scan, will except
+    if (nextEntry != -1) {
+        LeafNode<T>* currLeaf = (LeafNode<T>*)currentPageData;
+        nextKey<T>() = currLeaf->key(nextEntry);
+        nextRid = currLeaf->rid(nextEntry);
     }
-    currLeaf = (LeafNodeInt*)currentPageData;
+    index->bufMgr->unLatchPage(currentPageData, false);
+    return numRids;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::endScan
+// BTreeIndex::Cursor::endScan
 // -----------------------------------------------------------------------------
 //
-void BTreeIndex::endScan() 
+void BTreeIndex::Cursor::endScan() 
 {
     // Add your code below. Please do not remove this line.
     if (!scanExecuting) {
         throw ScanNotInitializedException();
     }
-    bufMgr->unPinPage(file, currentPageNum, false);
+    index->bufMgr->unPinPage(index->file, currentPageNum, false);
    
     // clear fields 
     scanExecuting = false;
@@ -831,4 +1858,196 @@ void BTreeIndex::endScan()
 
 }
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::startScan
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::startScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+    scanCursor.startScan(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNext
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::scanNext(RecordId& outRid) 
+{
+    scanCursor.scanNext(outRid);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNextBatch
+// -----------------------------------------------------------------------------
+
+int BTreeIndex::scanNextBatch(RecordId* outRids, const int maxRids)
+{
+    return scanCursor.scanNextBatch(outRids, maxRids);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::endScan
+// -----------------------------------------------------------------------------
+//
+void BTreeIndex::endScan() 
+{
+    scanCursor.endScan();
+}
+// -----------------------------------------------------------------------------
+// BTreeIndex::parallelScan
+// -----------------------------------------------------------------------------
+
+std::vector<std::vector<RecordId> > BTreeIndex::parallelScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm,
+				   const int numPartitions)
+{
+    if ((lowOpParm != GT && lowOpParm != GTE)
+         || (highOpParm != LT && highOpParm != LTE)) {
+        throw BadOpcodesException();
+    }
+    switch (attributeType) {
+    case INTEGER:
+        return parallelScanKeys<int>(lowValParm, lowOpParm, highValParm, highOpParm, numPartitions);
+    case DOUBLE:
+        return parallelScanKeys<double>(lowValParm, lowOpParm, highValParm, highOpParm, numPartitions);
+    case STRING:
+        return parallelScanKeys<StringKey>(lowValParm, lowOpParm, highValParm, highOpParm, numPartitions);
+    }
+    return std::vector<std::vector<RecordId> >();
+}
+
+template <class T>
+std::vector<std::vector<RecordId> > BTreeIndex::parallelScanKeys(const void* lowValParm, const Operator lowOp,
+				   const void* highValParm, const Operator highOp, const int numPartitions)
+{
+    const T low = readKey<T>(lowValParm);
+    const T high = readKey<T>(highValParm);
+    if (low > high) {
+        throw BadScanrangeException();
+    }
+    std::vector<T> separators;
+    rangeSeparators(low, high, std::max(numPartitions, 1) - 1, separators);
+
+    // sub-range p runs from separator p - 1 (included) to separator p (excluded); the first and the last
+    // keep the bounds of the whole range. A StringKey is read back through its characters, which come first.
+    const int numRanges = (int)separators.size() + 1;
+    std::vector<std::vector<RecordId> > partitions(numRanges);
+    std::exception_ptr error;
+    std::mutex errorLatch;
+    std::vector<std::thread> workers;
+    for (int p = 0; p < numRanges; p++) {
+        const void* rangeLow = p == 0 ? lowValParm : (const void*)&separators[p - 1];
+        const Operator rangeLowOp = p == 0 ? lowOp : GTE;
+        const void* rangeHigh = p == numRanges - 1 ? highValParm : (const void*)&separators[p];
+        const Operator rangeHighOp = p == numRanges - 1 ? highOp : LT;
+        std::vector<RecordId>& rids = partitions[p];
+        workers.push_back(std::thread([this, rangeLow, rangeLowOp, rangeHigh, rangeHighOp, &rids, &error, &errorLatch]() {
+            const int batchSize = 1024;
+            try {
+                Cursor cursor(this);
+                try {
+                    cursor.startScan(rangeLow, rangeLowOp, rangeHigh, rangeHighOp);
+                } catch (const NoSuchKeyFoundException&) {
+                    return;
+                }
+                int numRids;
+                do {
+                    const std::size_t size = rids.size();
+                    rids.resize(size + batchSize);
+                    numRids = cursor.scanNextBatch(rids.data() + size, batchSize);
+                    rids.resize(size + numRids);
+                } while (numRids == batchSize);
+            } catch (...) {
+                std::lock_guard<std::mutex> errorGuard(errorLatch);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    bool found = false;
+    for (const std::vector<RecordId>& rids : partitions) {
+        found = found || !rids.empty();
+    }
+    if (!found) {
+        throw NoSuchKeyFoundException();
+    }
+    return partitions;
+}
+
+template <class T>
+void BTreeIndex::rangeSeparators(const T& low, const T& high, const int maxSeparators, std::vector<T>& separators)
+{
+    separators.clear();
+    if (maxSeparators <= 0) {
+        return;
+    }
+
+    // the root stays at rootPageNum; a split or a merge rewrites it in place under its latch, which is
+    // held while the children are read so that none of them is merged away meanwhile (latch coupling)
+    std::vector<PageId> children;
+    Page* rootPage;
+    bufMgr->readPage(file, rootPageNum, rootPage);
+    bufMgr->latchPage(rootPage, false);
+    NonLeafNode<T>* root = (NonLeafNode<T>*)rootPage;
+    if (!root->leaf) {
+        for (int i = 0; i <= root->length; i++) {
+            // child i holds the keys in [key(i - 1), key(i))
+            if (i < root->length && low < root->key(i) && root->key(i) < high) {
+                separators.push_back(root->key(i));
+            }
+            if ((i == 0 || root->key(i - 1) <= high) && (i == root->length || low < root->key(i))) {
+                children.push_back(root->pageNo(i));
+            }
+        }
+    }
+
+    // one level down, unless the root alone already cuts the range finely enough
+    if ((int)separators.size() <= maxSeparators) {
+        for (PageId childPageNo : children) {
+            Page* childPage;
+            bufMgr->readPage(file, childPageNo, childPage);
+            bufMgr->latchPage(childPage, false);
+            NonLeafNode<T>* child = (NonLeafNode<T>*)childPage;
+            const bool leafLevel = child->leaf;
+            if (!leafLevel) {
+                for (int i = 0; i < child->length; i++) {
+                    if (low < child->key(i) && child->key(i) < high) {
+                        separators.push_back(child->key(i));
+                    }
+                }
+            }
+            bufMgr->unLatchPage(childPage, false);
+            bufMgr->unPinPage(file, childPageNo, false);
+            if (leafLevel) {
+                break;
+            }
+        }
+    }
+    bufMgr->unLatchPage(rootPage, false);
+    bufMgr->unPinPage(file, rootPageNum, false);
+
+    // the keys of the two levels interleave, and a key may sit on both
+    std::sort(separators.begin(), separators.end());
+    separators.erase(std::unique(separators.begin(), separators.end()), separators.end());
+    if ((int)separators.size() > maxSeparators) {
+        std::vector<T> chosen;
+        for (int j = 1; j <= maxSeparators; j++) {
+            chosen.push_back(separators[(std::size_t)j * separators.size() / (maxSeparators + 1)]);
+        }
+        separators.swap(chosen);
+    }
+}
+
 }
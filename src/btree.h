@@ -17,43 +17,130 @@
 #include "file.h"
 #include "buffer.h"
 #include <vector>
+#include <queue>
+#include <utility>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace badgerdb
 {
 
 /**
- * @brief Datatype enumeration type.
+ * @brief Index build enumeration. Passed to BTreeIndex constructor to choose how a new index file is populated.
  */
-enum Datatype
+enum BuildMode
 {
-	INTEGER = 0,
-	DOUBLE = 1,
-	STRING = 2
+	INSERT_BUILD,	/* Insert every tuple of the relation through insertEntry */
+	BULK_LOAD,		/* Sort all <key,rid> pairs and pack the pages bottom-up */
+	PARALLEL_BULK_LOAD	/* BULK_LOAD with the relation read, sorted and merged by BULKLOADTHREADS threads */
 };
 
+
 /**
- * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
+ * @brief Number of characters of a STRING attribute stored in the index.
  */
-enum Operator
-{ 
-	LT, 	/* Less Than */
-	LTE,	/* Less Than or Equal to */
-	GTE,	/* Greater Than or Equal to */
-	GT		/* Greater Than */
+const int STRINGSIZE = 10;
+
+/**
+ * @brief Key type of a STRING index: the first STRINGSIZE characters of the attribute, padded with zeros.
+ * Keys compare like strncmp over STRINGSIZE characters, so a prefix sorts before any longer string.
+*/
+struct StringKey{
+	char data[ STRINGSIZE ];
+
+	StringKey() = default;
+
+	explicit StringKey( const char* str )
+	{
+		strncpy( data, str, STRINGSIZE );
+	}
 };
 
+inline bool operator<( const StringKey& k1, const StringKey& k2 ) { return memcmp( k1.data, k2.data, STRINGSIZE ) < 0; }
+inline bool operator>( const StringKey& k1, const StringKey& k2 ) { return k2 < k1; }
+inline bool operator<=( const StringKey& k1, const StringKey& k2 ) { return !( k2 < k1 ); }
+inline bool operator>=( const StringKey& k1, const StringKey& k2 ) { return !( k1 < k2 ); }
+inline bool operator==( const StringKey& k1, const StringKey& k2 ) { return memcmp( k1.data, k2.data, STRINGSIZE ) == 0; }
+inline bool operator!=( const StringKey& k1, const StringKey& k2 ) { return !( k1 == k2 ); }
+
+/**
+ * @brief Separator to push up when a leaf splits between leftKey, the last key staying on the left, and
+ * rightKey, the first key moving right. Any key in (leftKey, rightKey] keeps the tree ordered; for most
+ * key types that is rightKey itself.
+*/
+template <class T>
+inline T separatorKey( const T& leftKey, const T& rightKey )
+{
+	return rightKey;
+}
+
+/**
+ * @brief Separator for STRING keys, cut down to the shortest prefix of rightKey that is still above
+ * leftKey (suffix truncation). Keys sharing a long prefix then meet short separators in the upper levels,
+ * and the zero padding ends each memcmp at the first differing character.
+*/
+inline StringKey separatorKey( const StringKey& leftKey, const StringKey& rightKey )
+{
+	if( !( leftKey < rightKey ) )
+		return rightKey;
+	StringKey sep;
+	int i = 0;
+	while( leftKey.data[i] == rightKey.data[i] )
+		i++;
+	memcpy( sep.data, rightKey.data, i + 1 );
+	memset( sep.data + i + 1, 0, STRINGSIZE - i - 1 );
+	return sep;
+}
+
+/**
+ * @brief Number of key slots in B+Tree leaf for key type T.
+ */
+//                                                      sibling ptr         length          flag                 key               rid
+template <class T>
+constexpr int ARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) - sizeof( int ) - sizeof( bool ) ) / ( sizeof( T ) + sizeof( RecordId ) );
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for key type T.
+ */
+//                                                         flag      extra pageNo            length              key        pageNo
+template <class T>
+constexpr int ARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( bool ) - sizeof( PageId ) - sizeof( int ) ) / ( sizeof( T ) + sizeof( PageId ) );
 
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr         length          flag                 key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) - sizeof( int ) - sizeof( bool ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+const  int INTARRAYLEAFSIZE = ARRAYLEAFSIZE<int>;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+const  int DOUBLEARRAYLEAFSIZE = ARRAYLEAFSIZE<double>;
+
+/**
+ * @brief Number of key slots a B+Tree leaf for STRING key would have with fixed width keys. STRING leaves are
+ * prefix compressed instead (see StringNodeBody), and hold more entries unless their keys share no prefix.
+ */
+const  int STRINGARRAYLEAFSIZE = ARRAYLEAFSIZE<StringKey>;
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     flag      extra pageNo            length              key        pageNo
-const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( bool ) - sizeof( PageId ) - sizeof( int ) ) / ( sizeof( int ) + sizeof( PageId ) );
+const  int INTARRAYNONLEAFSIZE = ARRAYNONLEAFSIZE<int>;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+const  int DOUBLEARRAYNONLEAFSIZE = ARRAYNONLEAFSIZE<double>;
+
+/**
+ * @brief Number of key slots a B+Tree non-leaf for STRING key would have with fixed width keys.
+ */
+const  int STRINGARRAYNONLEAFSIZE = ARRAYNONLEAFSIZE<StringKey>;
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
@@ -87,6 +174,23 @@ public:
 	}
 };
 
+/**
+ * @brief Default number of <key,rid> pairs the bulk loader sorts in memory before spilling them to a sorted run file.
+ */
+const int BULKLOADRUNSIZE = 1 << 20;
+
+/**
+ * @brief Number of threads reading and sorting the relation in a PARALLEL_BULK_LOAD.
+ */
+const int BULKLOADTHREADS = 4;
+
+/**
+ * @brief Number of <key,rid> pair slots in one page of a bulk load sort run for key type T.
+ */
+//                                                 length                 key+rid
+template <class T>
+constexpr int RUNPAGESIZE = ( Page::SIZE - sizeof( int ) ) / sizeof( RIDKeyPair<T> );
+
 /**
  * @brief Overloaded operator to compare the key values of two rid-key pairs
  * and if they are the same compares to see if the first pair has
@@ -131,17 +235,80 @@ struct IndexMetaInfo{
 	PageId rootPageNo;
 };
 
+/**
+ * @brief Position of key among the sorted keys of a node: the number of keys below key, or with upper set,
+ * the number of keys not above key. With upper set this is the first slot holding a larger key, which is
+ * where an insert goes and which child of a non-leaf node covers key.
+ * The search is a binary search without data dependent branches: each step keeps one half through a
+ * conditional move, so the cost is log2(length) compares whatever the keys are.
+ * @param keyArray	Sorted keys of the node
+ * @param length		Number of keys in keyArray
+ * @param key				Key to look for
+ * @param upper			Count the keys equal to key as well
+ * @return	Slot in [0, length]
+*/
+template <class T>
+inline int searchNode(const T* keyArray, const int length, const T& key, const bool upper)
+{
+	if( length == 0 )
+		return 0;
+	const T* base = keyArray;
+	int n = length;
+	while( n > 1 )
+	{
+		int half = n / 2;
+		base = ( upper ? !( key < base[half] ) : base[half] < key ) ? base + half : base;
+		n -= half;
+	}
+	return ( base - keyArray ) + ( upper ? !( key < *base ) : *base < key );
+}
+
+#ifdef __AVX2__
+/**
+ * @brief searchNode for INTEGER keys on AVX2 builds. The binary search stops once 16 keys are left,
+ * which are then counted in two compares of 8 keys each.
+*/
+inline int searchNode(const int* keyArray, const int length, const int& key, const bool upper)
+{
+	const int* base = keyArray;
+	int n = length;
+	while( n > 16 )
+	{
+		int half = n / 2;
+		base = ( upper ? base[half] <= key : base[half] < key ) ? base + half : base;
+		n -= half;
+	}
+	// every key left of base is below key, every key from base + n on is above it
+	const __m256i keys = _mm256_set1_epi32( key );
+	const __m256i lanes = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+	int count = 0;
+	for( int i = 0; i < n; i += 8 )
+	{
+		__m256i inNode = _mm256_cmpgt_epi32( _mm256_set1_epi32( n - i ), lanes );
+		__m256i values = _mm256_maskload_epi32( base + i, inNode );
+		__m256i hits = upper ? _mm256_andnot_si256( _mm256_cmpgt_epi32( values, keys ), inNode )
+		                     : _mm256_and_si256( _mm256_cmpgt_epi32( keys, values ), inNode );
+		count += __builtin_popcount( _mm256_movemask_ps( _mm256_castsi256_ps( hits ) ) );
+	}
+	return ( base - keyArray ) + count;
+}
+#endif
+
+
 /*
 Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
 These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
 node they are. The leaf member is always false for non-leaf nodes, always true for leaf nodes. The length member is the number of
-indices in the key array which have been initialized with keys. The leaf nodes have an additional sibling pointer.
+keys in the node. The leaf nodes have an additional sibling pointer. Both members come first in every layout.
+The tree code reads and changes a node only through the member functions below, which every layout provides: INTEGER and DOUBLE
+nodes keep their keys in fixed slot arrays, STRING nodes keep them prefix compressed (see StringNodeBody).
 */
 
 /**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all non-leaf nodes, for key type T.
 */
-struct NonLeafNodeInt{
+template <class T>
+struct NonLeafNode{
   /**
    * Flag if this node is a leaf
    */
@@ -156,19 +323,114 @@ struct NonLeafNodeInt{
   /**
    * Stores keys.
    */
-	int keyArray[ INTARRAYNONLEAFSIZE ];
+	T keyArray[ ARRAYNONLEAFSIZE<T> ];
 
   /**
    * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
    */
-	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
+	PageId pageNoArray[ ARRAYNONLEAFSIZE<T> + 1 ];
+
+	T key( const int i ) const { return keyArray[i]; }
+
+  /**
+   * Child i, which holds the keys in [key(i - 1), key(i)).
+   */
+	PageId pageNo( const int i ) const { return pageNoArray[i]; }
+
+	int search( const T& k, const bool upper ) const { return searchNode( keyArray, length, k, upper ); }
+
+  /**
+   * True if any key can be inserted without a split.
+   */
+	bool hasRoom() const { return length < ARRAYNONLEAFSIZE<T>; }
+
+  /**
+   * Insert key at slot i, with the child to its right. The node is left unchanged if it has no room.
+   * @return false if the node has no room
+   */
+	bool insert( const int i, const T& k, const PageId rightPageNo )
+	{
+		if( !hasRoom() )
+			return false;
+		std::copy_backward( keyArray + i, keyArray + length, keyArray + length + 1 );
+		std::copy_backward( pageNoArray + i + 1, pageNoArray + length + 1, pageNoArray + length + 2 );
+		keyArray[i] = k;
+		pageNoArray[i + 1] = rightPageNo;
+		length++;
+		return true;
+	}
+
+	bool append( const T& k, const PageId rightPageNo ) { return insert( length, k, rightPageNo ); }
+
+  /**
+   * Remove key i together with the child to its right.
+   */
+	void remove( const int i )
+	{
+		std::copy( keyArray + i + 1, keyArray + length, keyArray + i );
+		std::copy( pageNoArray + i + 2, pageNoArray + length + 1, pageNoArray + i + 1 );
+		length--;
+	}
+
+  /**
+   * Replace key i. The node is left unchanged if the new key does not fit.
+   * @return false if the new key does not fit
+   */
+	bool setKey( const int i, const T& k )
+	{
+		keyArray[i] = k;
+		return true;
+	}
+
+  /**
+   * True if the node can lose any one key without underflowing.
+   */
+	bool canRemove() const { return length > ARRAYNONLEAFSIZE<T> / 2; }
+
+	bool underfull() const { return length < ARRAYNONLEAFSIZE<T> / 2; }
+
+  /**
+   * True once a bulk load has put fillFactor of the capacity to use.
+   */
+	bool filled( const float fillFactor ) const { return length + 1 >= std::max( 2, (int)( ( ARRAYNONLEAFSIZE<T> + 1 ) * fillFactor ) ); }
+
+  /**
+   * Append the keys and the children of the node to keys and pageNos.
+   */
+	void entries( std::vector<T>& keys, std::vector<PageId>& pageNos ) const
+	{
+		keys.insert( keys.end(), keyArray, keyArray + length );
+		pageNos.insert( pageNos.end(), pageNoArray, pageNoArray + length + 1 );
+	}
+
+  /**
+   * True if count sorted keys fit in one node.
+   */
+	static bool fits( const T* keys, const int count ) { return count <= ARRAYNONLEAFSIZE<T>; }
+
+  /**
+   * Key to push up when a node holding the count sorted keys splits: keys before it stay left, keys after it go right.
+   */
+	static int splitPoint( const T* keys, const int count ) { return count / 2; }
+
+  /**
+   * Make this a non-leaf node holding count keys and the count + 1 children around them, which must fit.
+   */
+	void assign( const T* keys, const PageId* pageNos, const int count )
+	{
+		leaf = false;
+		length = count;
+		std::copy( keys, keys + count, keyArray );
+		std::copy( pageNos, pageNos + count + 1, pageNoArray );
+	}
 };
 
 
 /**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all leaf nodes, for key type T.
 */
-struct LeafNodeInt{
+template <class T>
+struct LeafNode{
 
   /**
    * Flag if this node is a leaf
@@ -184,71 +446,374 @@ struct LeafNodeInt{
   /**
    * Stores keys.
    */
-	int keyArray[ INTARRAYLEAFSIZE ];
+	T keyArray[ ARRAYLEAFSIZE<T> ];
 
   /**
    * Stores RecordIds.
    */
-	RecordId ridArray[ INTARRAYLEAFSIZE ];
+	RecordId ridArray[ ARRAYLEAFSIZE<T> ];
 
   /**
    * Page number of the leaf on the right side.
 	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
    */
 	PageId rightSibPageNo;
+
+  /**
+   * Make this an empty leaf without a right sibling.
+   */
+	void clear()
+	{
+		leaf = true;
+		length = 0;
+		rightSibPageNo = 0;
+	}
+
+	T key( const int i ) const { return keyArray[i]; }
+
+	RecordId rid( const int i ) const { return ridArray[i]; }
+
+	int search( const T& k, const bool upper ) const { return searchNode( keyArray, length, k, upper ); }
+
+  /**
+   * True if k can be inserted without a split.
+   */
+	bool canInsert( const T& k ) const { return length < ARRAYLEAFSIZE<T>; }
+
+  /**
+   * Insert <k,r> at slot i. The leaf is left unchanged if it has no room.
+   * @return false if the leaf has no room
+   */
+	bool insert( const int i, const T& k, const RecordId& r )
+	{
+		if( !canInsert( k ) )
+			return false;
+		std::copy_backward( keyArray + i, keyArray + length, keyArray + length + 1 );
+		std::copy_backward( ridArray + i, ridArray + length, ridArray + length + 1 );
+		keyArray[i] = k;
+		ridArray[i] = r;
+		length++;
+		return true;
+	}
+
+	bool append( const T& k, const RecordId& r ) { return insert( length, k, r ); }
+
+	void remove( const int i )
+	{
+		std::copy( keyArray + i + 1, keyArray + length, keyArray + i );
+		std::copy( ridArray + i + 1, ridArray + length, ridArray + i );
+		length--;
+	}
+
+  /**
+   * True if the leaf can lose any one entry without underflowing.
+   */
+	bool canRemove() const { return length > ARRAYLEAFSIZE<T> / 2; }
+
+	bool underfull() const { return length < ARRAYLEAFSIZE<T> / 2; }
+
+  /**
+   * True once a bulk load has put fillFactor of the capacity to use.
+   */
+	bool filled( const float fillFactor ) const { return length >= std::max( 1, (int)( ARRAYLEAFSIZE<T> * fillFactor ) ); }
+
+  /**
+   * Copy the record ids of the entries in [from, to) to out.
+   */
+	void copyRids( const int from, const int to, RecordId* out ) const { std::copy( ridArray + from, ridArray + to, out ); }
+
+  /**
+   * Append the entries of the leaf to pairs.
+   */
+	void entries( std::vector<RIDKeyPair<T> >& pairs ) const
+	{
+		for( int i = 0; i < length; i++ )
+		{
+			RIDKeyPair<T> pair;
+			pair.set( ridArray[i], keyArray[i] );
+			pairs.push_back( pair );
+		}
+	}
+
+  /**
+   * True if count sorted pairs fit in one leaf.
+   */
+	static bool fits( const RIDKeyPair<T>* pairs, const int count ) { return count <= ARRAYLEAFSIZE<T>; }
+
+  /**
+   * First pair to go right when a leaf holding the count sorted pairs splits.
+   */
+	static int splitPoint( const RIDKeyPair<T>* pairs, const int count ) { return count / 2; }
+
+  /**
+   * Make this a leaf holding count sorted pairs, which must fit. The right sibling is kept.
+   */
+	void assign( const RIDKeyPair<T>* pairs, const int count )
+	{
+		leaf = true;
+		length = count;
+		for( int i = 0; i < count; i++ )
+		{
+			keyArray[i] = pairs[i].key;
+			ridArray[i] = pairs[i].rid;
+		}
+	}
+};
+
+/**
+ * @brief Bytes of a STRING node taken up by its entries and their offsets.
+ */
+const int STRINGNODEDATASIZE = Page::SIZE - 32;
+
+/**
+ * @brief Keys of a STRING node with what each key points to (a RecordId in a leaf, the child to the right of
+ * the key in a non-leaf), stored prefix compressed: the prefix shared by all the keys is kept once, and each
+ * key only by the rest of its characters, without the zero padding. Entries are packed from the end of data
+ * towards its start, and their offsets, in key order, from the start of data. The keys of a node are sorted,
+ * so they share the common prefix of the first and the last one; an insert that does not share the prefix
+ * shortens it, and a delete leaves it as it is. Defined in btree.cpp.
+*/
+template <class Payload>
+struct StringNodeBody{
+  /**
+   * Offset in data of the first entry; the entries fill data from there to the end.
+   */
+	std::uint16_t heapStart;
+
+  /**
+   * Number of leading characters shared by all keys.
+   */
+	std::uint8_t prefixLength;
+
+	char prefix[ STRINGSIZE ];
+
+  /**
+   * Entry offsets, 2 bytes each, then free space, then the entries: a byte holding the length of
+   * the rest of the key, those characters, then the payload.
+   */
+	char data[ STRINGNODEDATASIZE ];
+
+	void clear();
+	StringKey key( const int i ) const;
+	Payload payload( const int i ) const;
+	int search( const StringKey& k, const int length, const bool upper ) const;
+	int usedSpace( const int length ) const;
+	int freeSpace( const int length ) const;
+
+  /**
+   * Bytes an entry for any key may take beyond the free space, counting the longer rest of
+   * every key if the prefix has to be dropped.
+   */
+	int worstInsertSpace( const int length ) const;
+	bool canInsert( const StringKey& k, const int length ) const;
+	bool insert( const int i, const StringKey& k, const Payload& p, const int length );
+	void remove( const int i, const int length );
+
+	template <class KeyAt>
+	static int encodedSize( const int count, KeyAt keyAt );
+	template <class KeyAt, class PayloadAt>
+	void assign( const int count, KeyAt keyAt, PayloadAt payloadAt );
+	template <class KeyAt>
+	static int splitPoint( const int count, const int pushed, KeyAt keyAt );
+};
+
+/**
+ * @brief Non-leaf node for STRING keys. Child 0 is kept in the header, child i + 1 with key i.
+*/
+template <>
+struct NonLeafNode<StringKey>{
+	bool leaf;
+	int length;
+	PageId firstPageNo;
+	StringNodeBody<PageId> body;
+
+	StringKey key( const int i ) const { return body.key( i ); }
+	PageId pageNo( const int i ) const { return i == 0 ? firstPageNo : body.payload( i - 1 ); }
+	int search( const StringKey& k, const bool upper ) const { return body.search( k, length, upper ); }
+	bool hasRoom() const;
+	bool insert( const int i, const StringKey& k, const PageId rightPageNo );
+	bool append( const StringKey& k, const PageId rightPageNo ) { return insert( length, k, rightPageNo ); }
+	void remove( const int i );
+	bool setKey( const int i, const StringKey& k );
+	bool canRemove() const;
+	bool underfull() const;
+	bool filled( const float fillFactor ) const;
+	void entries( std::vector<StringKey>& keys, std::vector<PageId>& pageNos ) const;
+	static bool fits( const StringKey* keys, const int count );
+	static int splitPoint( const StringKey* keys, const int count );
+	void assign( const StringKey* keys, const PageId* pageNos, const int count );
+};
+
+/**
+ * @brief Leaf node for STRING keys.
+*/
+template <>
+struct LeafNode<StringKey>{
+	bool leaf;
+	int length;
+	PageId rightSibPageNo;
+	StringNodeBody<RecordId> body;
+
+	void clear();
+	StringKey key( const int i ) const { return body.key( i ); }
+	RecordId rid( const int i ) const { return body.payload( i ); }
+	int search( const StringKey& k, const bool upper ) const { return body.search( k, length, upper ); }
+	bool canInsert( const StringKey& k ) const { return body.canInsert( k, length ); }
+	bool insert( const int i, const StringKey& k, const RecordId& r );
+	bool append( const StringKey& k, const RecordId& r ) { return insert( length, k, r ); }
+	void remove( const int i );
+	bool canRemove() const;
+	bool underfull() const;
+	bool filled( const float fillFactor ) const;
+	void copyRids( const int from, const int to, RecordId* out ) const;
+	void entries( std::vector<RIDKeyPair<StringKey> >& pairs ) const;
+	static bool fits( const RIDKeyPair<StringKey>* pairs, const int count );
+	static int splitPoint( const RIDKeyPair<StringKey>* pairs, const int count );
+	void assign( const RIDKeyPair<StringKey>* pairs, const int count );
 };
 
+/**
+ * @brief Node structures when the key is of INTEGER, DOUBLE or STRING type.
+*/
+typedef NonLeafNode<int> NonLeafNodeInt;
+typedef LeafNode<int> LeafNodeInt;
+typedef NonLeafNode<double> NonLeafNodeDouble;
+typedef LeafNode<double> LeafNodeDouble;
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+typedef LeafNode<StringKey> LeafNodeString;
+
+static_assert( sizeof( NonLeafNodeInt ) <= Page::SIZE && sizeof( LeafNodeInt ) <= Page::SIZE, "INTEGER nodes do not fit in a page" );
+static_assert( sizeof( NonLeafNodeDouble ) <= Page::SIZE && sizeof( LeafNodeDouble ) <= Page::SIZE, "DOUBLE nodes do not fit in a page" );
+static_assert( sizeof( NonLeafNodeString ) <= Page::SIZE && sizeof( LeafNodeString ) <= Page::SIZE, "STRING nodes do not fit in a page" );
+
+
+
 
 /**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
+ * @brief Structure for the pages of a sorted run file written by the bulk loader, for key type T.
 */
-class BTreeIndex {
+template <class T>
+struct RunPage{
+  /**
+   * Number of pairs stored in the page
+   */
+	int length;
+
+  /**
+   * Stores <key,rid> pairs in sorted order.
+   */
+	RIDKeyPair<T> pairArray[ RUNPAGESIZE<T> ];
+};
+
+
+/**
+ * @brief Merges the sorted runs produced by the bulk loader into a single stream of <key,rid> pairs
+ * in ascending order. Spilled runs are read back one page at a time; the run still held in memory
+ * takes part in the merge without ever being written out. Run files are removed by the destructor.
+*/
+template <class T>
+class SortedRunMerger {
 
  private:
 
   /**
-   * File object for the index file.
+   * Read position inside one sorted run. A run with a NULL file is the in-memory run.
    */
-	File		*file;
+	struct RunCursor{
+		BlobFile	*file;
+		PageId		pageNo;
+		PageId		numPages;
+		int			nextPair;
+		Page		page;
+	};
 
   /**
-   * Buffer Manager Instance.
+   * Heap entry: the smallest unmerged pair of a run together with the index of that run.
    */
-	BufMgr	*bufMgr;
+	typedef std::pair<RIDKeyPair<T>, int> HeapEntry;
 
   /**
-   * Page number of meta page.
+   * Orders heap entries so that the smallest pair is on top.
    */
-	PageId	headerPageNum;
+	struct HeapEntryGreater{
+		bool operator()( const HeapEntry& e1, const HeapEntry& e2 ) const
+		{
+			return e2.first < e1.first;
+		}
+	};
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Names of the run files being merged.
    */
-	PageId	rootPageNum;
+	std::vector<std::string>	runNames;
 
   /**
-   * Datatype of attribute over which index is built.
+   * Sorted pairs which were never spilled.
    */
-	Datatype	attributeType;
+	std::vector<RIDKeyPair<T> >	&memRun;
 
   /**
-   * Offset of attribute, over which index is built, inside records. 
+   * One cursor per run file, followed by the cursor of the in-memory run.
    */
-	int 		attrByteOffset;
+	std::vector<RunCursor>	cursors;
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Next unmerged pair of every run which is not exhausted.
    */
-	int			leafOccupancy;
+	std::priority_queue<HeapEntry, std::vector<HeapEntry>, HeapEntryGreater>	heap;
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Moves the cursor of the given run forward and pushes its next pair into the heap, if any.
+   * @param run		index of the run in cursors
    */
-	int			nodeOccupancy;
+	void advanceRun(int run);
 
+ public:
 
-	// MEMBERS SPECIFIC TO SCANNING
+  /**
+   * Sets up a merge over the given run files and the in-memory run.
+   * @param runNamesIn	names of the BlobFiles holding the spilled runs, each one written page after page by BTreeIndex::spillRun
+   * @param runPageCounts	number of pages in each of those runs
+   * @param memRunIn	last run, kept in memory, already sorted
+   */
+	SortedRunMerger(const std::vector<std::string>& runNamesIn, const std::vector<PageId>& runPageCounts,
+					std::vector<RIDKeyPair<T> >& memRunIn);
+
+  /**
+   * Closes and removes all run files.
+   */
+	~SortedRunMerger();
+
+  /**
+   * Fetch the next pair in ascending order.
+   * @param outPair	next pair returned in this
+   * @return	false once all runs have been merged
+   */
+	bool next(RIDKeyPair<T>& outPair);
+};
+
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+ * relation. Any number of scans can be open at once, each through its own Cursor.
+*/
+class BTreeIndex {
+
+ public:
+
+/**
+ * @brief A range scan over a BTreeIndex. Each cursor keeps its own bounds and its own pinned leaf,
+ * so several cursors can scan one index at the same time, from one thread or from many.
+ * A single cursor must not be used by two threads at once, and must not outlive its index.
+*/
+class Cursor {
+ friend class BTreeIndex;
+
+ private:
+  /**
+   * Index being scanned.
+   */
+	BTreeIndex	*index;
 
   /**
    * True if an index scan has been started.
@@ -260,6 +825,27 @@ class BTreeIndex {
    */
 	int			nextEntry;
 
+  /**
+   * Key of the entry at nextEntry, for an INTEGER index. The current leaf is only pinned between calls
+   * to scanNext, not latched, so inserts may move that entry; the scan uses this key and nextRid to find it again.
+   */
+	int			nextKeyInt;
+
+  /**
+   * Key of the entry at nextEntry, for a DOUBLE index.
+   */
+	double	nextKeyDouble;
+
+  /**
+   * Key of the entry at nextEntry, for a STRING index.
+   */
+	StringKey	nextKeyString;
+
+  /**
+   * RecordId of the entry at nextEntry.
+   */
+	RecordId	nextRid;
+
   /**
    * Page number of current page being scanned.
    */
@@ -270,6 +856,11 @@ class BTreeIndex {
    */
 	Page		*currentPageData;
 
+  /**
+   * Leaves left to scan before the scan asks the buffer manager to stage the leaves ahead of it again.
+   */
+	std::uint32_t	leavesUntilReadAhead;
+
   /**
    * Low INTEGER value for scan.
    */
@@ -283,7 +874,7 @@ class BTreeIndex {
   /**
    * Low STRING value for scan.
    */
-	std::string	lowValString;
+	StringKey	lowValString;
 
   /**
    * High INTEGER value for scan.
@@ -298,7 +889,7 @@ class BTreeIndex {
   /**
    * High STRING value for scan.
    */
-	std::string highValString;
+	StringKey	highValString;
 	
   /**
    * Low Operator. Can only be GT(>) or GTE(>=).
@@ -310,13 +901,206 @@ class BTreeIndex {
    */
 	Operator	highOp;
 
+  /**
+   * Scan fields holding keys of type T: the low and high values and the key of the entry at nextEntry.
+   * Defined for int, double and StringKey.
+   */
+	template <class T> T& lowVal();
+	template <class T> T& highVal();
+	template <class T> T& nextKey();
+
+   /**
+   * Private helper function to isolate logic of moving scan forward.
+   * Handles updating scan state without needing logic of scan bounds (lowVal/highVal).
+   * The current leaf must be latched (shared); when the scan moves on to the right sibling, the
+   * sibling is latched before the current leaf is released, so it is left latched instead.
+   * @return false if reaches end of index (nextEntry is then -1)
+   */ 
+	template <class T>
+	bool advanceScan();
+
+   /**
+   * Leaf chain followed by BufMgr::readAhead: the right sibling of a leaf, Page::INVALID_NUMBER after
+   * the last leaf or when the page is no longer a leaf, having been merged away.
+   * @param page	page of the index, latched shared
+   */
+	template <class T>
+	static PageId nextLeaf(const Page& page);
+
+   /**
+   * Move nextEntry back onto the entry recorded in nextKey/nextRid after the current leaf was latched
+   * again. Inserts only shift entries to the right, within the leaf or into new right siblings, so the
+   * entry is searched for from the current leaf rightwards; the scan continues from the first larger key
+   * if the entry is gone. Deletes may move entries into the left sibling, or merge the leaf away, and a
+   * split moves the entries of a root leaf to new leaves; in those cases the scan descends again.
+   * The current leaf must be latched (shared) and stays latched, possibly as a different page.
+   * @return false if no entry is left at or after the recorded one (nextEntry is then -1)
+   */
+	template <class T>
+	bool relocateScan();
+
+   /**
+   * Check a key against the high end of the scan range.
+   * @param key	key to check
+   * @return true if key is below the high value (LT) or not above it (LTE)
+   */
+	template <class T>
+	bool belowHighVal(const T& key);
+
+   /**
+   * startScan for an index with keys of type T, once the operators have been checked.
+   * @param lowValParm	Low value of range
+   * @param highValParm	High value of range
+   */
+	template <class T>
+	void startScanKeys(const void* lowValParm, const void* highValParm);
+
+   /**
+   * scanNextBatch for an index with keys of type T.
+   */
+	template <class T>
+	int scanNextBatchKeys(RecordId* outRids, const int maxRids);
+
+ public:
+  /**
+   * Create a cursor on an index. No scan is open until startScan is called.
+   * @param index	Index to scan
+   */
+	Cursor(BTreeIndex *index);
+
+  /**
+   * End the scan if one is still open.
+   */
+	~Cursor();
+
+	Cursor(const Cursor&) = delete;
+	Cursor& operator=(const Cursor&) = delete;
+
+	/**
+	 * Begin a filtered scan of the index. Same contract as BTreeIndex::startScan; a scan already open
+	 * on this cursor is ended first, other cursors are not affected.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	**/
+	void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	void scanNext(RecordId& outRid);
+
+  /**
+	 * Fetch the record ids of up to maxRids next index entries that match the scan, copied a leaf at a time.
+	 * Reaching the end of the scan is not an error: fewer than maxRids ids, or none, are returned.
+   * @param outRids	Array of at least maxRids record ids, filled from the start
+   * @param maxRids	Maximum number of record ids to return
+   * @return	Number of record ids returned; 0 once the scan is complete
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	int scanNextBatch(RecordId* outRids, const int maxRids);
+
+  /**
+	 * Terminate the scan. Unpin any pinned pages. Reset scan specific variables.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	void endScan();
+};
+
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+	PageId	rootPageNum;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+	Datatype	attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records. 
+   */
+	int 		attrByteOffset;
+
+
+  /**
+   * Cursor behind startScan, scanNext and endScan.
+   */
+	Cursor		scanCursor;
+
+  /**
+   * Pages unlinked from the tree by deleteEntry that a scan still had pinned. They are given back to the
+   * file by a later deleteEntry, or by the destructor.
+   */
+	std::vector<PageId>	unreleasedPages;
+
+  /**
+   * Guards unreleasedPages.
+   */
+	std::mutex	unreleasedPagesLatch;
+
    /**
    * BTree Traversal Method
-   * Used to traverse the tree to find the correct leaf or node that contains the key
+   * Used to traverse the tree to find the correct leaf or node that contains the key.
+   * Nodes are latched top-down, and a node is only let go once its child is latched (latch coupling).
+   * Readers release the parent straight away, so only the leaf is left latched in shared mode.
+   * Writers latch exclusively and keep every node from the deepest one that still has room for one
+   * more entry down to the leaf, since a split of the leaf can reach up to that node. For a delete,
+   * the nodes kept are those from the deepest one that can lose an entry without underflowing.
    * @param key        key that is used to find the correct leaf
    * @param traversal    variable used for saving where in the traversal process one is    
+   * @param exclusive    true to latch the path for an insert or delete, false for a read
+   * @param latched      pages left pinned and latched on return, from the top down; the leaf is last
+   * @param lowerBound   descend to the leftmost leaf that may hold key (instead of the rightmost one)
+   * @param forDelete    keep the path a delete may rebalance rather than the one an insert may split
+   * @param keepPath     keep every node from the root down latched (see nextLeafOnPath)
    */	
-	PageId traverseTree(const int key, std::vector<PageId>& traversal);
+	template <class T>
+	PageId traverseTree(const T& key, std::vector<PageId>& traversal, const bool exclusive,
+						std::vector<std::pair<PageId, Page*> >& latched, const bool lowerBound = false,
+						const bool forDelete = false, const bool keepPath = false);
+
+   /**
+   * Move a path latched exclusively from the root down to a leaf over to the next leaf on the right.
+   * The nodes the two paths do not share are let go, and those of the new path latched top-down.
+   * @param latched      path returned by traverseTree with keepPath set
+   * @return false, with the path left as it is, if the leaf is the rightmost one
+   */
+	template <class T>
+	bool nextLeafOnPath(std::vector<std::pair<PageId, Page*> >& latched);
+
+   /**
+   * Unlatch and unpin the pages left latched by traverseTree, and empty the list.
+   * @param latched      pages returned by traverseTree
+   * @param exclusive    mode the pages were latched in
+   * @param dirty        true if the pages may have been modified
+   */
+	void releaseLatches(std::vector<std::pair<PageId, Page*> >& latched, const bool exclusive, const bool dirty);
 
    /**
    * Split method for when a split is required
@@ -326,7 +1110,8 @@ class BTreeIndex {
    * @param leftPageNo      pointer to the left sibling
    * @param rightPageNo     pointer to the right sibling
    */
-	void splitRec(int pushedKey, PageId leftPageNo, PageId rightPageNo, int traversalIndex, std::vector<PageId> traversal);
+	template <class T>
+	void splitRec(const T& pushedKey, PageId leftPageNo, PageId rightPageNo, int traversalIndex, std::vector<PageId> traversal);
 
    /**
    * Should split leaf node to allow adding of another key
@@ -336,7 +1121,8 @@ class BTreeIndex {
    * @param leftPageNo
    * @param rightPageNo
    */
-    int splitLeaf(const void* key, const RecordId rid, PageId nodeId, PageId &leftPageNo, PageId &rightPageNo);
+	template <class T>
+	T splitLeaf(const T& key, const RecordId rid, PageId nodeId, PageId &leftPageNo, PageId &rightPageNo);
 
    /**
    * Should split non leaf nodes to allow for adding of another key
@@ -348,14 +1134,149 @@ class BTreeIndex {
    * @param leftPageNo       Pagenumber of the left node just created
    * @param rightPageNo      Page number of the right node just created
    */
-  	int splitNonLeaf(int key, PageId nodeId,PageId inputLeftId, PageId inputRightId, PageId &leftPageNo, PageId &rightPageNo);
+	template <class T>
+	T splitNonLeaf(const T& key, PageId nodeId,PageId inputLeftId, PageId inputRightId, PageId &leftPageNo, PageId &rightPageNo);
+
 
    /**
-   * Private helper function to isolate logic of moving scan forward.
-   * Handles updating scan state without needing logic of scan bounds (lowVal/highVal).
-   * @throws IndexScanCompletedException if reaches end of index (this exception interpreted differently in startScan)
-   */ 
-	void advanceScan();
+   * Bulk load a newly created index: gather the <key,rid> pair of every tuple in the relation,
+   * sort them (spilling sorted runs to disk whenever runSize pairs are buffered), then
+   * build the tree bottom-up through packTree.
+   * @param relationName	name of the base relation
+   * @param indexName		name of the index file, used as prefix of the run file names
+   * @param fillFactor		fraction of every node filled by the loader
+   * @param runSize			number of pairs sorted in memory before a run is spilled
+   */
+	template <class T>
+	void bulkLoad(const std::string & relationName, const std::string & indexName, const float fillFactor,
+				  const int runSize);
+
+   /**
+   * Bulk load on BULKLOADTHREADS threads. The relation is read by a ParallelFileScan, so each thread gathers
+   * the pairs of its own pages, spilling its own runs whenever it holds its share of runSize pairs.
+   * The pairs left in memory are sorted one buffer per thread, then merged pairwise, the merges of a round
+   * running at once, until they form one sorted run. packTree then builds the tree from it and the spilled runs,
+   * merged on the calling thread as it goes.
+   * @param relationName	name of the base relation
+   * @param indexName		name of the index file, used as prefix of the run file names
+   * @param fillFactor		fraction of every node filled by the loader
+   * @param runSize			number of pairs sorted in memory, over all the threads, before they spill runs
+   */
+	template <class T>
+	void parallelBulkLoad(const std::string & relationName, const std::string & indexName, const float fillFactor,
+						  const int runSize);
+
+   /**
+   * Sort the buffered pairs and write them to a new run file, then empty the buffer.
+   * @param pairs			buffered pairs
+   * @param runNames		name of the new run file is appended here
+   * @param runPageCounts	number of pages written to the new run file is appended here
+   * @param indexName		name of the index file, used as prefix of the run file name
+   */
+	template <class T>
+	void spillRun(std::vector<RIDKeyPair<T> >& pairs, std::vector<std::string>& runNames,
+					std::vector<PageId>& runPageCounts, const std::string & indexName);
+
+   /**
+   * Build the tree bottom-up from a sorted stream of pairs. Leaves are packed left to right and
+   * chained through rightSibPageNo, then each non-leaf level is packed from the (page, lowest key)
+   * pairs of the level below, until the separators of a level fit in a single node, which is written
+   * to the root page. A node is closed once it is filled to fillFactor or the next entry does not fit
+   * (STRING nodes hold a varying number of keys); the last node of a level is balanced with the one
+   * before it if it is left underfull. A single leaf is written straight to the root page.
+   * @param merger		source of the sorted pairs
+   * @param fillFactor	fraction of every node filled
+   */
+	template <class T>
+	void packTree(SortedRunMerger<T>& merger, const float fillFactor);
+
+   /**
+   * insertEntry for an index with keys of type T.
+   * @param key			Key to insert
+   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+   */
+	template <class T>
+	void insertEntryKey(const T& key, const RecordId rid);
+
+   /**
+   * deleteEntry for an index with keys of type T.
+   * @param key			Key to delete
+   * @param rid			Record ID of the entry
+   */
+	template <class T>
+	void deleteEntryKey(const T& key, const RecordId rid);
+
+   /**
+   * Fix up the nodes left underflowing by a delete, from the leaf upwards. An underflowing node takes
+   * entries from a sibling under the same parent, or is merged with it when both fit in one node; a
+   * merge removes a separator from the parent, which may underflow in turn. A root left with a single
+   * child takes over the contents of that child.
+   * @param latched		path returned by traverseTree for the delete, all latched exclusively
+   * @param freedPages	pages unlinked from the tree are appended here; they stay latched until released
+   */
+	template <class T>
+	void rebalance(std::vector<std::pair<PageId, Page*> >& latched, std::vector<PageId>& freedPages);
+
+   /**
+   * Merge or balance the leaves left and right, children sepIndex and sepIndex + 1 of parent.
+   * @return true if right was merged into left and removed from parent
+   */
+	template <class T>
+	bool rebalanceLeaves(NonLeafNode<T>* parent, const int sepIndex, LeafNode<T>* left, LeafNode<T>* right);
+
+   /**
+   * Merge or balance the non-leaf nodes left and right, children sepIndex and sepIndex + 1 of parent.
+   * @return true if right was merged into left and removed from parent
+   */
+	template <class T>
+	bool rebalanceNonLeaves(NonLeafNode<T>* parent, const int sepIndex, NonLeafNode<T>* left, NonLeafNode<T>* right);
+
+   /**
+   * Give pages unlinked from the tree back to the file through BufMgr::disposePage. A page still pinned
+   * by a scan is kept in unreleasedPages and tried again on the next call.
+   * @param freedPages	pages no longer reachable from the root or the leaf chain, neither latched nor pinned
+   */
+	void releasePages(const std::vector<PageId>& freedPages);
+
+   /**
+   * Fill the root leaf of a new index file from the relation, through bulkLoad, parallelBulkLoad or insertEntry.
+   * @param relationName	name of the base relation
+   * @param indexName		name of the index file
+   * @param buildMode		how the entries are added
+   * @param fillFactor		fraction of every node filled by bulkLoad and parallelBulkLoad
+   * @param runSize			number of pairs bulkLoad and parallelBulkLoad sort in memory before they spill runs
+   */
+	template <class T>
+	void build(const std::string & relationName, const std::string & indexName, const BuildMode buildMode,
+			   const float fillFactor, const int runSize);
+
+   /**
+   * Cut points for parallelScan: the keys of the root strictly between low and high, plus those of the
+   * non-leaf children of the root whose subtrees overlap the range. Every leaf under the range is read
+   * by the scan anyway, so a second level costs one page per fan-out leaves. When more keys turn up than
+   * are needed, evenly spaced ones are kept.
+   * @param low				low end of the range
+   * @param high			high end of the range
+   * @param maxSeparators	most separators to return
+   * @param separators		set to the cut points, in increasing order
+   */
+	template <class T>
+	void rangeSeparators(const T& low, const T& high, const int maxSeparators, std::vector<T>& separators);
+
+   /**
+   * parallelScan for an index with keys of type T, once the operators have been checked.
+   */
+	template <class T>
+	std::vector<std::vector<RecordId> > parallelScanKeys(const void* lowValParm, const Operator lowOp,
+									const void* highValParm, const Operator highOp, const int numPartitions);
+
+   /**
+   * Key of type T read from an attribute value or a scan bound: an int or double is copied,
+   * a string is cut to its first STRINGSIZE characters.
+   * @param key			Pointer to integer / double / char string
+   */
+	template <class T>
+	static T readKey(const void* key);
 
  public:
 
@@ -363,16 +1284,24 @@ class BTreeIndex {
    * BTreeIndex Constructor. 
 	 * Check to see if the corresponding index file exists. If so, open the file.
 	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+	 * With BULK_LOAD the entries are sorted first and the pages are packed bottom-up, each node filled
+	 * to fillFactor of its capacity; PARALLEL_BULK_LOAD does the same on several threads. With INSERT_BUILD every
+	 * tuple goes through insertEntry.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
-   * @param attrType						Datatype of attribute over which index is built
+   * @param attrType						Datatype of attribute over which index is built. STRING keys are the first STRINGSIZE characters of the attribute.
+   * @param buildMode					How a new index file is populated. Ignored if the index file already exists.
+   * @param fillFactor					Fraction of each node filled by BULK_LOAD and PARALLEL_BULK_LOAD, clamped to [0.5, 1.0]
+   * @param runSize						Number of <key,rid> pairs BULK_LOAD and PARALLEL_BULK_LOAD sort in memory before spilling them to run files
    * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
-						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const BuildMode buildMode = BULK_LOAD, const float fillFactor = 1.0,
+						const int runSize = BULKLOADRUNSIZE);
 	
 
   /**
@@ -390,19 +1319,37 @@ class BTreeIndex {
 	 * This splitting will require addition of new leaf page number entry into the parent non-leaf, which may in-turn get split.
 	 * This may continue all the way upto the root causing the root to get split. If root gets split, metapage needs to be changed accordingly.
 	 * Make sure to unpin pages as soon as you can.
+	 * Inserts may run concurrently with each other and with a scan: the path is latch coupled (see traverseTree).
    * @param key			Key to insert, pointer to integer/double/char string
    * @param rid			Record ID of a record whose entry is getting inserted into the index.
 	**/
 	void insertEntry(const void* key, const RecordId rid);
 
+  /**
+	 * Delete the entry <value,rid>.
+	 * The leaf losing the entry may underflow, below half full. It then takes entries from a sibling, or is merged
+	 * with it; merges remove an entry from the parent, which may underflow in turn, up to the root. A root left with
+	 * a single child takes over the contents of that child, so the tree gets one level shorter. Pages left out of
+	 * the tree go back to the index file for later splits to reuse.
+	 * Deletes may run concurrently with inserts, other deletes and scans. A scan does not return an entry deleted
+	 * before the scan gets to it.
+   * @param key			Key to delete, pointer to integer/double/char string
+   * @param rid			Record ID of the record whose entry is getting deleted from the index.
+	 * @throws  NoSuchKeyFoundException If the index holds no entry <value,rid>.
+	**/
+	void deleteEntry(const void* key, const RecordId rid);
+
 	
 	/**
 	 * Begin a filtered scan of the index.  For instance, if the method is called 
 	 * using ("a",GT,"d",LTE) then we should seek all entries with a value 
 	 * greater than "a" and less than or equal to "d".
-	 * If another scan is already executing, that needs to be ended here.
+	 * If another scan is already executing, that needs to be ended here. Scans through these methods all use
+	 * the index's own cursor; a separate BTreeIndex::Cursor is needed to keep several scans open.
 	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
 	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+	 * The page is only latched inside startScan and scanNext, so inserts by other threads are not held up
+	 * by an open scan. Entries inserted behind the scan position are not returned.
    * @param lowVal	Low value of range, pointer to integer / double / char string
    * @param lowOp		Low operator (GT/GTE)
    * @param highVal	High value of range, pointer to integer / double / char string
@@ -424,11 +1371,40 @@ class BTreeIndex {
 	void scanNext(RecordId& outRid);  // returned record id
 
 
+  /**
+	 * Fetch the record ids of up to maxRids next index entries that match the scan. Meant for long range scans:
+	 * whole runs of a leaf are copied at once, and the end of the scan is signalled by the count, not an exception.
+   * @param outRids	Array of at least maxRids record ids, filled from the start
+   * @param maxRids	Maximum number of record ids to return
+   * @return	Number of record ids returned; less than maxRids only when the scan is complete
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	int scanNextBatch(RecordId* outRids, const int maxRids);
+
+
   /**
 	 * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	**/
 	void endScan();
+
+  /**
+	 * Scan a range of the index on several threads at once. The range is cut into sub-ranges at separator keys
+	 * taken from the upper non-leaf levels (see rangeSeparators), and each sub-range is scanned by a thread of its
+	 * own through its own Cursor, so the scans share no state and latch only their own leaves. Entries with equal
+	 * keys all fall in one sub-range. Inserts and deletes may run meanwhile, with the same guarantees as startScan.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @param numPartitions	Most sub-ranges, and threads, to use; fewer if the upper levels hold fewer keys in range
+   * @return	Record ids of the entries in range, one vector per sub-range, in key order within and across the vectors
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	**/
+	std::vector<std::vector<RecordId> > parallelScan(const void* lowVal, const Operator lowOp,
+											const void* highVal, const Operator highOp, const int numPartitions);
 	
 };
 
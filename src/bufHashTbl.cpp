@@ -7,108 +7,152 @@
 
 #include <memory>
 #include <iostream>
+#include <utility>
 #include "buffer.h"
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
 #include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint64_t BufHashTbl::hash(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
+  // combine the address of the file object with the page number, then mix all the bits so that
+  // neighbouring pages and aligned file objects land far apart (the finalizer of MurmurHash3)
+  std::uint64_t value = (std::uint64_t)(std::uintptr_t)file ^ ((std::uint64_t)pageNo << 32 | pageNo);
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
   return value;
 }
 
 BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // room for twice the expected share of entries of each partition
+  std::uint32_t numSlots = 8;
+  while (numSlots < 2 * (std::uint32_t)htSize / BUFHASHPARTITIONS)
+    numSlots *= 2;
+
+  partitions = new hashPartition[BUFHASHPARTITIONS];
+  for (int i = 0; i < BUFHASHPARTITIONS; i++)
+  {
+    partitions[i].slots = new hashSlot[numSlots]();
+    partitions[i].mask = numSlots - 1;
+    partitions[i].count = 0;
+  }
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
-  delete [] ht;
+  for (int i = 0; i < BUFHASHPARTITIONS; i++)
+    delete [] partitions[i].slots;
+  delete [] partitions;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+std::mutex& BufHashTbl::partitionLatch(const File* file, const PageId pageNo)
 {
-  int index = hash(file, pageNo);
+  return partitionOf(hash(file, pageNo)).latch;
+}
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+void BufHashTbl::place(hashPartition& partition, std::uint64_t hashValue, hashSlot entry)
+{
+  // the low bits choose the partition, so the home slot comes from the high ones
+  std::uint32_t index = (std::uint32_t)(hashValue >> 32) & partition.mask;
+  entry.probeLength = 1;
+  while (partition.slots[index].probeLength != 0)
+  {
+    // the entry further from home keeps the slot, the other one moves on
+    if (partition.slots[index].probeLength < entry.probeLength)
+      std::swap(partition.slots[index], entry);
+    index = (index + 1) & partition.mask;
+    entry.probeLength++;
   }
+  partition.slots[index] = entry;
+  partition.count++;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+void BufHashTbl::grow(hashPartition& partition)
+{
+  hashSlot* oldSlots = partition.slots;
+  const std::uint32_t oldNumSlots = partition.mask + 1;
+
+  partition.slots = new hashSlot[2 * oldNumSlots]();
+  partition.mask = 2 * oldNumSlots - 1;
+  partition.count = 0;
+  for (std::uint32_t i = 0; i < oldNumSlots; i++)
+  {
+    if (oldSlots[i].probeLength != 0)
+      place(partition, hash(oldSlots[i].file, oldSlots[i].pageNo), oldSlots[i]);
+  }
+  delete [] oldSlots;
+}
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  FrameId presentFrameNo;
+  if (lookup(file, pageNo, presentFrameNo))
+    throw HashAlreadyPresentException(file->filename(), pageNo, presentFrameNo);
+
+  const std::uint64_t hashValue = hash(file, pageNo);
+  hashPartition& partition = partitionOf(hashValue);
+  if (4 * (partition.count + 1) > 3 * (partition.mask + 1))
+    grow(partition);
+
+  hashSlot entry;
+  entry.file = file;
+  entry.pageNo = pageNo;
+  entry.frameNo = frameNo;
+  place(partition, hashValue, entry);
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+bool BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo)
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  const std::uint64_t hashValue = hash(file, pageNo);
+  hashPartition& partition = partitionOf(hashValue);
+  std::uint32_t index = (std::uint32_t)(hashValue >> 32) & partition.mask;
+  for (std::uint32_t probeLength = 1; ; probeLength++)
+  {
+    const hashSlot& slot = partition.slots[index];
+    // an entry closer to its home than this key would be here means the key is absent
+    if (slot.probeLength < probeLength)
+      return false;
+    if (slot.file == file && slot.pageNo == pageNo)
     {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
+      frameNo = slot.frameNo; // return frameNo by reference
+      return true;
     }
-    tmpBuc = tmpBuc->next;
+    index = (index + 1) & partition.mask;
   }
-
-  throw HashNotFoundException(file->filename(), pageNo);
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
-    }
+  const std::uint64_t hashValue = hash(file, pageNo);
+  hashPartition& partition = partitionOf(hashValue);
+  std::uint32_t index = (std::uint32_t)(hashValue >> 32) & partition.mask;
+  for (std::uint32_t probeLength = 1; ; probeLength++)
+  {
+    const hashSlot& slot = partition.slots[index];
+    if (slot.probeLength < probeLength)
+      throw HashNotFoundException(file->filename(), pageNo);
+    if (slot.file == file && slot.pageNo == pageNo)
+      break;
+    index = (index + 1) & partition.mask;
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  // shift the entries after it back by one, up to an empty slot or an entry at home
+  std::uint32_t next = (index + 1) & partition.mask;
+  while (partition.slots[next].probeLength > 1)
+  {
+    partition.slots[index] = partition.slots[next];
+    partition.slots[index].probeLength--;
+    index = next;
+    next = (next + 1) & partition.mask;
+  }
+  partition.slots[index] = hashSlot();
+  partition.count--;
 }
 
 }
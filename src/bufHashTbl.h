@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <mutex>
 #include "file.h"
 
 namespace badgerdb {
@@ -14,11 +16,11 @@ namespace badgerdb {
 /**
 * @brief Declarations for buffer pool hash table
 */
-struct hashBucket {
+struct hashSlot {
 	/**
 	 * pointer a file object (more on this below)
 	 */
-	File *file;
+	const File *file;
 
 	/**
 	 * page number within a file
@@ -31,41 +33,106 @@ struct hashBucket {
 	FrameId frameNo;
 
 	/**
-	 * Next node in the hash table
+	 * One more than the distance of the slot from the slot the entry hashes to; 0 for an empty slot
 	 */
-	hashBucket*   next;
+	std::uint32_t probeLength;
+};
+
+/**
+ * @brief One partition of the buffer pool hash table: an open addressing table of its own, with
+ * its own latch.
+ */
+struct hashPartition {
+	/**
+	 * Slots of the partition; a power of two of them
+	 */
+	hashSlot* slots;
+
+	/**
+	 * Number of slots minus one
+	 */
+	std::uint32_t mask;
+
+	/**
+	 * Number of entries
+	 */
+	std::uint32_t count;
+
+	/**
+	 * Latch guarding the partition
+	 */
+	std::mutex latch;
 };
 
 
+/**
+ * @brief Number of partitions the buffer pool hash table is split into. Each partition has its own latch.
+ */
+const int BUFHASHPARTITIONS = 64;
+
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* The entries are split into BUFHASHPARTITIONS partitions, each guarded by its own latch, so that
+* threads working on pages in different partitions do not contend. The table does not take the
+* latches itself: callers must hold partitionLatch(file, pageNo) around insert, lookup and remove,
+* which lets the buffer manager make a lookup and a pin (or a check and a removal) one atomic step.
+*
+* Each partition is a flat array of slots searched by linear probing with Robin Hood ordering: an
+* entry being inserted takes the slot of any entry closer to its home slot, so probe lengths stay
+* short and even, and a lookup stops as soon as it passes the probe length the key would have. A
+* removal shifts the following entries back instead of leaving a tombstone. A partition doubles
+* when it is three quarters full. The partition and the home slot both come from one mixed hash of
+* the file and the page number.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
-	 */
-  int HTSIZE;
-	/**
-	 * Actual Hash table object
+	 * Partitions of the table
 	 */
-  hashBucket**  ht;
+  hashPartition* partitions;
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * returns a hash value computed using file and pageNo, well spread over all its bits
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  static std::uint64_t hash(const File* file, const PageId pageNo);
+
+	/**
+	 * returns the partition of the entry for (file, pageNo)
+	 *
+	 * @param hashValue	Hash value of the entry
+	 */
+  hashPartition& partitionOf(const std::uint64_t hashValue)
+  {
+    return partitions[hashValue % BUFHASHPARTITIONS];
+  }
+
+	/**
+	 * Places an entry known to be absent into a partition with room for it.
+	 *
+	 * @param partition	Partition to insert into
+	 * @param hashValue	Hash value of the entry
+	 * @param entry   	Entry to place; its probeLength is set as it moves
+	 */
+  static void place(hashPartition& partition, std::uint64_t hashValue, hashSlot entry);
+
+	/**
+	 * Doubles the number of slots of a partition.
+	 *
+	 * @param partition	Partition to grow
+	 */
+  static void grow(hashPartition& partition);
 
  public:
 	/**
    * Constructor of BufHashTbl class
+   *
+   * @param htSize  Number of entries the table is sized for; partitions grow past it if need be
 	 */
 	BufHashTbl(const int htSize);  // constructor
 
@@ -73,7 +140,16 @@ class BufHashTbl
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
-	
+
+	/**
+   * Returns the latch of the partition holding the entry for (file, pageNo).
+	 *
+	 * @param file   	File object
+	 * @param pageNo 	Page number in the file
+	 * @return  			Latch to hold while calling insert, lookup or remove for this entry.
+	 */
+  std::mutex& partitionLatch(const File* file, const PageId pageNo);
+
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
 	 *
@@ -81,29 +157,29 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
 	/**
    * Check if (file, pageNo) is currently in the buffer pool (ie. in
-   * the hash table).
+   * the hash table). A page that is not there is the common case of a buffer pool miss, so it
+   * is reported through the return value rather than an exception.
 	 *
 	 * @param file  	File object
 	 * @param pageNo	Page number in the file
-	 * @param frameNo Frame number reference
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+	 * @param frameNo Frame number reference, set if the page is found
+	 * @return  True if the page entry is found in the hash table
 	 */
-  void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
+  bool lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
 	 */
-  void remove(const File* file, const PageId pageNo);  
+  void remove(const File* file, const PageId pageNo);
 };
 
 }
@@ -5,8 +5,15 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
+#include <new>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
@@ -16,13 +23,24 @@
 
 namespace badgerdb { 
 
+/**
+ * Size of the huge pages the buffer pool is aligned to and made of
+ */
+static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static_assert(sizeof(Page) == Page::SIZE,
+              "Frames must be exactly one page long to stay aligned in the buffer pool.");
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
+BufMgr::BufMgr(std::uint32_t bufs, std::uint32_t ioThreads, Replacement replacement,
+               std::uint32_t writerInterval, const PoolMemory& memory)
 	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
+  // owned here until the constructor is done, so that a pool allocPool fails to map does not leak it
+  std::unique_ptr<BufDesc[]> descTable(new BufDesc[bufs]);
+	bufDescTable = descTable.get();
 
   for (FrameId i = 0; i < bufs; i++) 
   {
@@ -30,125 +48,370 @@ BufMgr::BufMgr(std::uint32_t bufs)
   	bufDescTable[i].valid = false;
   }
 
-  bufPool = new Page[bufs];
+  allocPool(memory);
 
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
   hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
 
-  clockHand = bufs - 1;
+  policy = ReplacementPolicy::create(replacement, bufs);
+
+  ioQueue = new IOQueue(std::max<std::uint32_t>(ioThreads, 1));
+
+  stoppingWriter = false;
+  if (writerInterval > 0)
+    writer = std::thread(&BufMgr::runWriter, this, std::chrono::milliseconds(writerInterval));
+  descTable.release();
 }
 
 
 BufMgr::~BufMgr() {
+  if (writer.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> writerGuard(writerLatch);
+      stoppingWriter = true;
+    }
+    writerWake.notify_one();
+    writer.join();
+  }
+
+  // let reads still in flight finish before the frames go away
+  delete ioQueue;
+
   //Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
   	BufDesc* tmpbuf = &(bufDescTable[i]);
   	if (tmpbuf->valid == true && tmpbuf->dirty == true)
 		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+			tmpbuf->file.load()->writePage(tmpbuf->pageNo, bufPool[i]);
   	}
   }
 
 	delete hashTable;
+  delete policy;
   delete [] bufDescTable;
-  delete [] bufPool;
+  for (std::uint32_t i = 0; i < numBufs; i++)
+    bufPool[i].~Page();
+  munmap(bufPool, poolBytes);
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+void BufMgr::allocPool(const PoolMemory& memory)
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  // whole huge pages, so the last frames get huge pages too
+  poolBytes = ((std::size_t)numBufs * sizeof(Page) + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  poolPages = memory.pages;
+
+  void* pool = MAP_FAILED;
+  if (poolPages == HUGETLB_POOL_PAGES)
+  {
+    pool = mmap(NULL, poolBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (pool == MAP_FAILED)
+      poolPages = TRANSPARENT_HUGE_POOL_PAGES;
+  }
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+  if (pool == MAP_FAILED)
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    // map one huge page more than needed, then trim both ends back to huge page boundaries, which
+    // the kernel needs to back the pool with transparent huge pages
+    void* mapped = mmap(NULL, poolBytes + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+      throw std::bad_alloc();
+    char* start = static_cast<char*>(mapped);
+    char* aligned = reinterpret_cast<char*>(
+        (reinterpret_cast<std::uintptr_t>(start) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    if (aligned > start)
+      munmap(start, aligned - start);
+    if (aligned < start + HUGE_PAGE_SIZE)
+      munmap(aligned + poolBytes, start + HUGE_PAGE_SIZE - aligned);
+    pool = aligned;
+
+    madvise(pool, poolBytes, poolPages == TRANSPARENT_HUGE_POOL_PAGES ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+  }
+
+  // the policy applies to the pages touched from now on, so set it before the frames are constructed;
+  // the kernel drops the nodes the process may not use from the mask, and a failure (no NUMA support,
+  // or a node that does not exist) leaves the pool where it is first touched
+  if (memory.placement == INTERLEAVE_PLACEMENT ||
+      (memory.placement == BIND_PLACEMENT && memory.node >= 0 && memory.node < (int)(8 * sizeof(unsigned long))))
+  {
+    const unsigned long nodeMask = memory.placement == INTERLEAVE_PLACEMENT ? ~0UL : 1UL << memory.node;
+    const int mode = memory.placement == INTERLEAVE_PLACEMENT ? MPOL_INTERLEAVE : MPOL_BIND;
+    syscall(SYS_mbind, pool, poolBytes, mode, &nodeMask, 8 * sizeof(nodeMask) + 1, 0);
+  }
+
+  bufPool = static_cast<Page*>(pool);
+  for (std::uint32_t i = 0; i < numBufs; i++)
+    new (&bufPool[i]) Page();
+}
+
+void BufMgr::allocBuf(FrameId & frame) 
+{
+  // reserve a frame the replacement policy offers: a free one as is, a valid one
+  // unless a reader pinned it or disposePage cleared it meanwhile
+  std::function<bool(FrameId)> reserve = [this](FrameId candidate) {
+    BufDesc* desc = &bufDescTable[candidate];
+
+    // pinned, or reserved by another thread loading into it
+    if (desc->pinCnt > 0)
+      return false;
 
     // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
+    if (! desc->valid)
+    {
+      desc->pinCnt = 1;
+      return true;
+    }
+
+    File* victimFile = desc->file;
+    const PageId victimPageNo = desc->pageNo;
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(victimFile, victimPageNo));
+    if (desc->pinCnt == 0 && desc->valid && desc->file == victimFile && desc->pageNo == victimPageNo)
+    {
+      desc->pinCnt = 1;
+      desc->evicting = true;
+      return true;
+    }
+    return false;
+  };
+
+  while (true)
+  {
+    bool found = false;
     {
-      break;
+      std::lock_guard<std::mutex> clockGuard(clockLatch);
+      found = policy->chooseVictim(reserve, frame);
     }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    // check for full buffer pool
+    if (!found)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      throw BufferExceededException();
+    }
+
+    // a free frame needs no eviction
+    BufDesc* desc = &bufDescTable[frame];
+    if (!desc->evicting)
+      return;
+
+    // flush any existing changes to disk if necessary
+    // the page stays in the hash table meanwhile, so readers still find the dirty copy
+    File* victimFile = desc->file;
+    const PageId victimPageNo = desc->pageNo;
+    if (desc->dirty)
+    {
+      desc->dirty = false;
+      bufStats.diskwrites++;
+      try
+      {
+        victimFile->writePage(victimPageNo, bufPool[frame]);
+      }
+      catch(...)
       {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
+        // the page was not written: leave it dirty and in the buffer pool, and give back the frame
+        desc->dirty = true;
+        bufStats.diskwrites--;
+        std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(victimFile, victimPageNo));
+        desc->pinCnt--;
+        desc->evicting = false;
+        throw;
       }
     }
-    else
+
+    // evict, unless someone pinned or dirtied the page while it was written
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
-    }
-  }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
-  {
-    throw BufferExceededException();
-  }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
-  {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
-  }
+      std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(victimFile, victimPageNo));
+      if (desc->pinCnt != 1 || desc->dirty)
+      {
+        desc->pinCnt--;
+        desc->evicting = false;
+        continue;
+      }
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+      // remove previous entry from hash table
+      hashTable->remove(victimFile, victimPageNo);
 
-  // return new frame number
-  frame = clockHand;
+      //Reset all the BufDesc entry for the frame, except for our pin, before returning the frame
+      desc->file = NULL;
+      desc->pageNo = Page::INVALID_NUMBER;
+      desc->refbit = false;
+      desc->valid = false;
+      desc->evicting = false;
+    }
+    policy->evicted(frame, victimFile, victimPageNo);
+    return;
+  }
 } // end allocBuf
 
+void BufMgr::releaseBuf(const FrameId frame)
+{
+  bufDescTable[frame].Clear();
+}
+
 	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+bool BufMgr::pinResident(File* file, const PageId pageNo, Page*& page)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
-	try
 	{
-  	hashTable->lookup(file, pageNo, frameNo);
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+  	if (!hashTable->lookup(file, pageNo, frameNo))
+      return false;
 
     // set the referenced bit
     bufDescTable[frameNo].refbit = true;
     bufDescTable[frameNo].pinCnt++;
     page = &bufPool[frameNo];
   }
-  catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
-  {
-    // alloc a new frame
-    allocBuf(frameNo);
 
-    // read the page into the new frame
+  // our pin keeps the page in the frame
+  bufStats.accesses++;
+  policy->accessed(frameNo);
+  return true;
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+{
+  // check to see if it is already in the buffer pool
+  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
+  if (pinResident(file, pageNo, page))
+    return;
+
+  //not in the buffer pool, must allocate a new page
+  FrameId frameNo = 0;
+  std::mutex& partition = hashTable->partitionLatch(file, pageNo);
+
+  // alloc a new frame
+  allocBuf(frameNo);
+
+  // read the page into the new frame
+  try
+  {
     bufStats.diskreads++;
     //status = file->readPage(pageNo, &bufPool[frameNo]);
     bufPool[frameNo] = file->readPage(pageNo);
+  }
+  catch(...)
+  {
+    releaseBuf(frameNo);
+    throw;
+  }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+  bufStats.accesses++;
+  bool loaded = false;
+  FrameId loadedFrameNo = 0;
+  {
+    std::lock_guard<std::mutex> partitionGuard(partition);
+    // another thread may have loaded the same page while we were reading it
+    if (hashTable->lookup(file, pageNo, loadedFrameNo))
+    {
+      releaseBuf(frameNo);
+      bufDescTable[loadedFrameNo].refbit = true;
+      bufDescTable[loadedFrameNo].pinCnt++;
+      page = &bufPool[loadedFrameNo];
+    }
+    else
+    {
+      // set up the entry properly
+      bufDescTable[frameNo].Set(file, pageNo);
+      page = &bufPool[frameNo];
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+      // insert in the hash table
+      hashTable->insert(file, pageNo, frameNo);
+      loaded = true;
+    }
+  }
+
+  if (loaded)
+    policy->loaded(frameNo, file, pageNo);
+  else
+    policy->accessed(loadedFrameNo);
+}
+
+
+std::future<Page*> BufMgr::readPageAsync(File* file, const PageId pageNo)
+{
+  Page* page = NULL;
+  if (pinResident(file, pageNo, page))
+  {
+    std::promise<Page*> resident;
+    resident.set_value(page);
+    return resident.get_future();
+  }
+
+  // the miss path of readPage rechecks the hash table, so a page loaded meanwhile is only pinned
+  return ioQueue->submit([this, file, pageNo]() {
+    Page* loaded = NULL;
+    readPage(file, pageNo, loaded);
+    return loaded;
+  });
+}
+
+
+void BufMgr::readAhead(File* file, const PageId pageNo, const std::uint32_t numPages,
+                       const std::function<PageId(const Page&)>& nextPageNo)
+{
+  {
+    std::lock_guard<std::mutex> readAheadGuard(readAheadLatch);
+    readingAhead.insert(std::make_pair(file, pageNo));
+  }
+
+  ioQueue->submit([this, file, pageNo, numPages, nextPageNo]() {
+    PageId stagePageNo = pageNo;
+    for (std::uint32_t i = 0; ; i++)
+    {
+      Page* page = NULL;
+      try
+      {
+        readPage(file, stagePageNo, page);
+      }
+      catch(...)
+      {
+        endReadAhead(file, stagePageNo);
+        return;
+      }
+
+      // enter the next page while this one still points to it
+      PageId next = Page::INVALID_NUMBER;
+      if (i < numPages)
+      {
+        latchPage(page, false);
+        next = nextPageNo(*page);
+        if (next != Page::INVALID_NUMBER)
+        {
+          std::lock_guard<std::mutex> readAheadGuard(readAheadLatch);
+          readingAhead.insert(std::make_pair(file, next));
+        }
+        unLatchPage(page, false);
+      }
+      unPinPage(file, stagePageNo, false);
+      endReadAhead(file, stagePageNo);
+
+      if (next == Page::INVALID_NUMBER)
+        return;
+      stagePageNo = next;
+    }
+  });
+}
+
+void BufMgr::endReadAhead(const File* file, const PageId pageNo)
+{
+  {
+    std::lock_guard<std::mutex> readAheadGuard(readAheadLatch);
+    readingAhead.erase(readingAhead.find(std::make_pair(file, pageNo)));
   }
+  readAheadDone.notify_all();
+}
+
+void BufMgr::waitForReadAhead(const File* file, const PageId pageNo)
+{
+  std::unique_lock<std::mutex> readAheadGuard(readAheadLatch);
+  readAheadDone.wait(readAheadGuard, [this, file, pageNo]() {
+    if (pageNo != Page::INVALID_NUMBER)
+      return readingAhead.count(std::make_pair(file, pageNo)) == 0;
+    auto first = readingAhead.lower_bound(std::make_pair(file, static_cast<PageId>(Page::INVALID_NUMBER)));
+    return first == readingAhead.end() || first->first != file;
+  });
 }
 
 
@@ -156,7 +419,9 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
 {
   // lookup in hashtable
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+  if (!hashTable->lookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
 
   if (dirty == true) bufDescTable[frameNo].dirty = dirty;
 
@@ -177,57 +442,219 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
 
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  try
+  {
+    bufPool[frameNo] = file->allocatePage(pageNo);
+  }
+  catch(...)
+  {
+    releaseBuf(frameNo);
+    throw;
+  }
   page = &bufPool[frameNo];
 
   // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
+  {
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    bufDescTable[frameNo].Set(file, pageNo);
 
-  // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+    // insert in the hash table
+    hashTable->insert(file, pageNo, frameNo);
+  }
+  bufStats.accesses++;
+  policy->loaded(frameNo, file, pageNo);
 }
 
 void BufMgr::flushFile(const File* file) 
 {
+  waitForReadAhead(file, Page::INVALID_NUMBER);
+
+  std::lock_guard<std::mutex> clockGuard(clockLatch);
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
+  	const PageId pageNo = tmpbuf->pageNo;
   	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
 		{
+      // a page reserved for eviction before we took the clock latch is being written out by allocBuf:
+      // wait for it to go, so the file is not used after the caller deletes it
+      while (tmpbuf->evicting)
+        std::this_thread::yield();
+      // a page of the file being loaded by readPage cannot be seen half set up under its partition latch
+      std::unique_lock<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+      waitForWriteBack(tmpbuf, partitionGuard);
+      if (tmpbuf->file != file || tmpbuf->pageNo != pageNo || !tmpbuf->valid)
+        continue;
 	    if (tmpbuf->pinCnt > 0)
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
 	    if (tmpbuf->dirty == true)
 			{
 				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+				tmpbuf->file.load()->writePage(tmpbuf->pageNo, bufPool[i]);
 				tmpbuf->dirty = false;
     	}
 
     	hashTable->remove(file,tmpbuf->pageNo);
     	tmpbuf->Clear();
   	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
+		else if (tmpbuf->valid == false && tmpbuf->pinCnt == 0 && tmpbuf->file == file)
   		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
   }
+
+  // the one durability point for the pages written above
+  file->sync();
+}
+
+void BufMgr::checkpointFile(File* file)
+{
+  for (FrameId i = 0; i < numBufs; i++)
+  {
+    if (bufDescTable[i].file == file)
+      writeBack(i, file, false);
+  }
+
+  file->sync();
+}
+
+bool BufMgr::writeBack(const FrameId frameNo, const File* file, const bool unpinnedOnly)
+{
+  BufDesc* desc = &bufDescTable[frameNo];
+  File* pageFile = desc->file;
+  const PageId pageNo = desc->pageNo;
+  if (pageFile == NULL || (file != NULL && pageFile != file))
+    return false;
+
+  // pin the page so that it stays in the frame; a page allocBuf is evicting is being written already
+  {
+    std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(pageFile, pageNo));
+    if (!desc->valid || desc->file != pageFile || desc->pageNo != pageNo || !desc->dirty
+        || desc->evicting || (unpinnedOnly && desc->pinCnt > 0))
+      return false;
+    desc->pinCnt++;
+    desc->writing++;
+  }
+
+  // a shared latch keeps out threads changing the page under an exclusive latch; the background
+  // writer does not wait for them
+  bool latched = true;
+  if (unpinnedOnly)
+    latched = desc->latch.try_lock_shared();
+  else
+    desc->latch.lock_shared();
+
+  // a change made while the page is written marks it dirty again when it is unpinned
+  if (latched)
+  {
+    desc->dirty = false;
+    bufStats.diskwrites++;
+    try
+    {
+      pageFile->writePage(pageNo, bufPool[frameNo]);
+    }
+    catch(...)
+    {
+      // the page was not written: leave it dirty, and give back the latch and pin
+      desc->dirty = true;
+      bufStats.diskwrites--;
+      desc->latch.unlock_shared();
+      std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(pageFile, pageNo));
+      desc->pinCnt--;
+      desc->writing--;
+      throw;
+    }
+    desc->latch.unlock_shared();
+  }
+
+  std::lock_guard<std::mutex> partitionGuard(hashTable->partitionLatch(pageFile, pageNo));
+  desc->pinCnt--;
+  desc->writing--;
+  return latched;
+}
+
+void BufMgr::waitForWriteBack(BufDesc* desc, std::unique_lock<std::mutex>& partitionGuard)
+{
+  while (desc->writing > 0)
+  {
+    partitionGuard.unlock();
+    std::this_thread::yield();
+    partitionGuard.lock();
+  }
+}
+
+void BufMgr::runWriter(const std::chrono::milliseconds interval)
+{
+  std::unique_lock<std::mutex> writerGuard(writerLatch);
+  while (!writerWake.wait_for(writerGuard, interval, [this]() { return stoppingWriter; }))
+  {
+    writerGuard.unlock();
+    // clean unpinned frames, so that allocBuf finds victims it can take without writing them
+    for (FrameId i = 0; i < numBufs; i++)
+    {
+      if (bufDescTable[i].dirty && bufDescTable[i].pinCnt == 0)
+      {
+        // nobody is there to hear of a failed write; the page stays dirty, and the next
+        // flushFile or checkpointFile of its file reports the failure
+        try
+        {
+          writeBack(i, NULL, true);
+        }
+        catch(...)
+        {
+        }
+      }
+    }
+    writerGuard.lock();
+  }
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
 	//Deallocate from file altogether
+  waitForReadAhead(file, pageNo);
+
   //See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  {
+    std::unique_lock<std::mutex> partitionGuard(hashTable->partitionLatch(file, pageNo));
+    FrameId frameNo = 0;
+    // if not in the buffer pool, only the file needs changing
+    if (hashTable->lookup(file, pageNo, frameNo))
+    {
+      waitForWriteBack(&bufDescTable[frameNo], partitionGuard);
+
+      // somebody may still be reading the frame
+      if (bufDescTable[frameNo].pinCnt > 0)
+        throw PagePinnedException(file->filename(), pageNo, frameNo);
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+      // clear the page
+      bufDescTable[frameNo].Clear();
 
-	hashTable->remove(file, pageNo);
+      hashTable->remove(file, pageNo);
+    }
+  }
 
   // deallocate it in the file	
   file->deletePage(pageNo);
 }
 
+void BufMgr::latchPage(const Page* page, const bool exclusive)
+{
+  BufDesc* desc = &bufDescTable[page - bufPool];
+  if (exclusive)
+    desc->latch.lock();
+  else
+    desc->latch.lock_shared();
+}
+
+void BufMgr::unLatchPage(const Page* page, const bool exclusive)
+{
+  BufDesc* desc = &bufDescTable[page - bufPool];
+  if (exclusive)
+    desc->latch.unlock();
+  else
+    desc->latch.unlock_shared();
+}
+
 void BufMgr::printSelf(void) 
 {
   BufDesc* tmpbuf;
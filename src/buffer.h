@@ -9,7 +9,18 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "replacement.h"
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
 
 namespace badgerdb {
 
@@ -18,6 +29,48 @@ namespace badgerdb {
 */
 class BufMgr;
 
+/**
+ * @brief Kinds of memory pages the buffer pool can be backed by.
+ */
+enum PoolPages {
+  SMALL_POOL_PAGES,       /* Base pages of the system, usually 4KB */
+  TRANSPARENT_HUGE_POOL_PAGES, /* Base pages the kernel may back with 2MB pages (transparent huge pages) */
+  HUGETLB_POOL_PAGES      /* Pages from the reserved huge page pool (MAP_HUGETLB); transparent huge pages if none are left */
+};
+
+/**
+ * @brief Where the memory of the buffer pool is placed on a NUMA machine.
+ */
+enum PoolPlacement {
+  FIRST_TOUCH_PLACEMENT,  /* On the node of the thread constructing the buffer manager */
+  INTERLEAVE_PLACEMENT,   /* Spread page by page over all the nodes the process may use */
+  BIND_PLACEMENT          /* All on one node */
+};
+
+/**
+ * @brief How the memory of the buffer pool is allocated.
+ */
+struct PoolMemory {
+  /**
+   * Kind of memory pages backing the pool
+   */
+  PoolPages pages;
+
+  /**
+   * NUMA placement of the pool
+   */
+  PoolPlacement placement;
+
+  /**
+   * Node the pool is bound to with BIND_PLACEMENT
+   */
+  int node;
+
+  PoolMemory(PoolPages pages = TRANSPARENT_HUGE_POOL_PAGES, PoolPlacement placement = FIRST_TOUCH_PLACEMENT,
+             int node = 0)
+    : pages(pages), placement(placement), node(node) {}
+};
+
 /**
 * @brief Class for maintaining information about buffer pool frames
 */
@@ -29,12 +82,12 @@ class BufDesc {
 	/**
    * Pointer to file to which corresponding frame is assigned
 	 */
-  File* file;
+  std::atomic<File*> file;
 
 	/**
    * Page within file to which corresponding frame is assigned
 	 */
-  PageId pageNo;
+  std::atomic<PageId> pageNo;
 
 	/**
    * Frame number of the frame, in the buffer pool, being used
@@ -42,24 +95,45 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * Number of times this page has been pinned.
+   * Only changed while holding the hash table partition latch of the page, or by the thread which
+   * reserved the frame in allocBuf.
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
    * True if page is dirty;  false otherwise
 	 */
-  bool dirty;
+  std::atomic<bool> dirty;
 
 	/**
    * True if page is valid
 	 */
-  bool valid;
+  std::atomic<bool> valid;
+
+	/**
+   * Has this buffer frame been referenced since its page was loaded. The replacement policy keeps
+   * its own account of references.
+	 */
+  std::atomic<bool> refbit;
 
 	/**
-   * Has this buffer frame been reference recently
+   * True while allocBuf writes out and evicts the page held by the frame. The frame then counts
+   * one pin, owned by the evicting thread rather than by a user of the page.
 	 */
-  bool refbit;
+  std::atomic<bool> evicting;
+
+	/**
+   * Number of threads writing the page out through BufMgr::writeBack, each holding one pin on it.
+   * flushFile and disposePage wait for them rather than take their pins for users of the page.
+	 */
+  std::atomic<int> writing;
+
+	/**
+   * Shared/exclusive latch protecting the contents of the frame. Taken by users of the page
+   * through BufMgr::latchPage, never by the buffer manager itself.
+	 */
+  std::shared_mutex latch;
 
 	/**
    * Initialize buffer frame for a new user
@@ -72,6 +146,8 @@ class BufDesc {
     dirty = false;
     refbit = false;
 		valid = false;
+    evicting = false;
+    writing = 0;
   };
 
 	/**
@@ -95,7 +171,7 @@ class BufDesc {
 	{
 		if(file != NULL)
 		{
-			std::cout << "file:" << file->filename() << " ";
+			std::cout << "file:" << file.load()->filename() << " ";
 			std::cout << "pageNo:" << pageNo << " ";
 		}
 		else
@@ -125,17 +201,17 @@ struct BufStats
 	/**
    * Total number of accesses to buffer pool
 	 */
-  int accesses;
+  std::atomic<int> accesses;
 
 	/**
    * Number of pages read from disk (including allocs)
 	 */
-  int diskreads;
+  std::atomic<int> diskreads;
 
 	/**
    * Number of pages written back to disk
 	 */
-  int diskwrites;
+  std::atomic<int> diskwrites;
 
 	/**
    * Clear all values 
@@ -157,14 +233,24 @@ struct BufStats
 
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* The buffer manager may be called from several threads at once. Lookups go through the partitioned
+* hash table, pin counts are atomic, and the choice of victims is serialized by clockLatch. A frame being
+* loaded or evicted is reserved by holding a pin on it, so no other thread can choose it meanwhile.
+* Pinning a page does not latch it: threads sharing a page coordinate through latchPage/unLatchPage.
 */
 class BufMgr 
 {
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Serializes the choice of victims by the replacement policy, and frame table changes made by flushFile
 	 */
-  FrameId clockHand;
+  std::mutex clockLatch;
+
+	/**
+   * Replacement policy choosing the frames allocBuf evicts
+	 */
+  ReplacementPolicy *policy;
 
 	/**
    * Number of frames in the buffer pool
@@ -187,31 +273,158 @@ class BufMgr
   BufStats bufStats;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Size of the memory mapping holding bufPool, a multiple of the huge page size
 	 */
-  void advanceClock()
-  {
-		clockHand = (clockHand + 1) % numBufs;
-  }
+  std::size_t poolBytes;
+
+	/**
+   * Kind of memory pages bufPool actually got
+	 */
+  PoolPages poolPages;
+
+	/**
+   * Maps the memory of the buffer pool and constructs its frames in it.
+   *
+   * @param memory  How to allocate the memory
+   * @throws  std::bad_alloc if the memory cannot be mapped
+	 */
+  void allocPool(const PoolMemory& memory);
+
+	/**
+   * Threads reading pages missed by readPageAsync, and writing out the victims they evict
+	 */
+  IOQueue *ioQueue;
+
+	/**
+   * Pages readAhead has queued or is staging, by file. A page is entered before the latch of the
+   * page pointing to it is released, so a page unlinked from its chain and then disposed of is
+   * never staged after disposePage has gone by.
+	 */
+  std::multiset<std::pair<const File*, PageId> > readingAhead;
+
+	/**
+   * Protects readingAhead
+	 */
+  std::mutex readAheadLatch;
+
+	/**
+   * Signalled when a page leaves readingAhead
+	 */
+  std::condition_variable readAheadDone;
+
+	/**
+   * Background writer thread, if the buffer manager was built with one
+	 */
+  std::thread writer;
+
+	/**
+   * Protects stoppingWriter
+	 */
+  std::mutex writerLatch;
+
+	/**
+   * Signalled when the writer is to stop
+	 */
+  std::condition_variable writerWake;
+
+	/**
+   * Set by the destructor to stop the writer
+	 */
+  bool stoppingWriter;
 
 	/**
 	 * Allocate a free frame.  
+	 * The frame is returned reserved: invalid, absent from the hash table and holding one pin, so
+	 * that no other thread can allocate it. The caller either Set()s it or releases it with releaseBuf.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 * @throws BadgerDbException If writing out the victim fails; it then stays in the buffer pool, dirty
 	 */
   void allocBuf(FrameId & frame);
 
+	/**
+	 * Pin the page if it is in the buffer pool.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file
+	 * @param page  	Set to the pinned page when it is found
+	 * @return  True if the page was found and pinned
+	 */
+  bool pinResident(File* file, const PageId PageNo, Page*& page);
+
+	/**
+	 * Write out the page in a frame if it is dirty, keeping it in the buffer pool. The page is pinned
+	 * and latched shared meanwhile. A write that throws leaves the page dirty, with the pin and latch
+	 * given back, and passes the exception on.
+	 *
+	 * @param frameNo   	Frame holding the page
+	 * @param file   	Only write the page if it belongs to this file; NULL for any file
+	 * @param unpinnedOnly	Leave the page alone if it is pinned or latched exclusively, rather than wait for the latch
+	 * @return  True if the page was written
+	 */
+  bool writeBack(const FrameId frameNo, const File* file, const bool unpinnedOnly);
+
+	/**
+	 * Wait, with the partition latch of a page released meanwhile, until no writeBack holds a pin on it.
+	 *
+	 * @param desc   	Frame of the page
+	 * @param partitionGuard	Guard holding the partition latch of the page
+	 */
+  void waitForWriteBack(BufDesc* desc, std::unique_lock<std::mutex>& partitionGuard);
+
+	/**
+	 * Body of the background writer: every interval, writes out the dirty pages that are not pinned.
+	 *
+	 * @param interval   	Time between two passes over the buffer pool
+	 */
+  void runWriter(const std::chrono::milliseconds interval);
+
+	/**
+	 * Take a page out of readingAhead once readAhead is done with it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file
+	 */
+  void endReadAhead(const File* file, const PageId PageNo);
+
+	/**
+	 * Give back a frame reserved by allocBuf which ended up not being used.
+	 *
+	 * @param frame   	Frame ID of the reserved frame
+	 */
+  void releaseBuf(const FrameId frame);
+
  public:
 	/**
-   * Actual buffer pool from which frames are allocated
+   * Number of pages scans ask readAhead to stage ahead of the page they are on
+	 */
+  static const std::uint32_t READ_AHEAD_PAGES = 8;
+
+	/**
+   * Actual buffer pool from which frames are allocated. It starts on a huge page boundary, and every
+   * frame on a boundary of the base pages of the system.
 	 */
   Page* bufPool;
 
 	/**
    * Constructor of BufMgr class
-	 */
-  BufMgr(std::uint32_t bufs);
+   *
+   * @param bufs    	Number of frames in the buffer pool
+   * @param ioThreads	Number of page reads readPageAsync and readAhead keep in flight at once. At
+   *                  least one: 0 is taken as 1, since nothing else would run the reads they queue.
+   * @param replacement	Replacement policy. CLOCK_REPLACEMENT is cheapest on hits; the others keep
+   *                  pages referenced more than once, such as upper B+ tree nodes, through long scans.
+   * @param writerInterval	Milliseconds between the passes of a background writer thread, which
+   *                  writes out dirty pages that are not pinned so that allocBuf rarely has to write
+   *                  a victim before reusing its frame. 0 for no background writer.
+   * @param memory	Pages backing the pool and their NUMA placement. Huge pages save TLB misses on
+   *                  large pools; interleaving spreads the memory traffic of a pool shared by threads
+   *                  on all sockets, binding keeps it local to threads pinned to one socket. Placement
+   *                  is a hint: without NUMA support the memory stays where it is first touched.
+	 */
+  BufMgr(std::uint32_t bufs, std::uint32_t ioThreads = 4, Replacement replacement = CLOCK_REPLACEMENT,
+         std::uint32_t writerInterval = 0, const PoolMemory& memory = PoolMemory());
 	
 	/**
    * Destructor of BufMgr class
@@ -229,6 +442,43 @@ class BufMgr
 	 */
   void readPage(File* file, const PageId PageNo, Page*& page);
 
+	/**
+	 * Like readPage, but a page missing from the buffer pool is read on a thread of the I/O queue,
+	 * together with the write-back of any dirty page it evicts. The caller may submit several reads
+	 * before waiting for the first one, so they are in flight at the same time. A page already in
+	 * the buffer pool is pinned at once and the future is ready.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @return  Future for the pinned page. Errors of the read, e.g. BufferExceededException, are
+	 *          thrown from its get().
+	 */
+  std::future<Page*> readPageAsync(File* file, const PageId PageNo);
+
+	/**
+	 * Stages the pages that follow the given one in a chain of pages, such as the used pages of a
+	 * PageFile or the leaves of a B+ tree, so that a scan walking the chain finds them in the buffer
+	 * pool. The pages are read in the background, one after the other, on a thread of the I/O queue
+	 * and are left unpinned. Staging is only a hint: it stops early at the end of the chain, or if
+	 * a page cannot be read or the buffer pool is full.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page the scan is on
+	 * @param numPages	Number of pages to stage after it
+	 * @param nextPageNo	Gives the page after a page of the chain, or Page::INVALID_NUMBER at its end.
+	 *                  Called with the page latched shared.
+	 */
+  void readAhead(File* file, const PageId PageNo, const std::uint32_t numPages,
+                 const std::function<PageId(const Page&)>& nextPageNo);
+
+	/**
+	 * Wait until readAhead is done with a page, or with every page of a file.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file, or Page::INVALID_NUMBER for all of its pages
+	 */
+  void waitForReadAhead(const File* file, const PageId PageNo);
+
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
 	 *
@@ -250,7 +500,8 @@ class BufMgr
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk and syncs the file.
+	 * Waits for readAhead to be done with the file first.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
 	 *
@@ -260,20 +511,58 @@ class BufMgr
 	 */
   void flushFile(const File* file);
 
+	/**
+	 * Writes out all dirty pages of the file to disk and syncs the file, leaving them in the buffer pool.
+	 * Unlike flushFile, pages may be pinned; each dirty page is latched shared while it is written, so
+	 * the caller must not hold an exclusive latch on a page of the file. A page changed while it is
+	 * pinned is included once it has been unpinned as dirty.
+	 *
+	 * @param file   	File object
+	 */
+  void checkpointFile(File* file);
+
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
+	 * Waits for readAhead to be done with the page first.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number
+   * @throws  PagePinnedException If the page is pinned in the buffer pool; the page is then left alone
 	 */
   void disposePage(File* file, const PageId PageNo);
 
 	/**
+	 * Latch a pinned page in shared or exclusive mode. Threads reading a page shared with other
+	 * threads hold a shared latch; threads changing it hold an exclusive latch.
+	 *
+	 * @param page   	Page returned by readPage or allocPage, still pinned
+	 * @param exclusive	True for an exclusive latch, false for a shared one
+	 */
+  void latchPage(const Page* page, const bool exclusive);
+
+	/**
+	 * Release a latch taken with latchPage. The page must still be pinned.
+	 *
+	 * @param page   	Latched page
+	 * @param exclusive	Mode the latch was taken in
+	 */
+  void unLatchPage(const Page* page, const bool exclusive);
+
+	/**
    * Print member variable values. 
 	 */
   void  printSelf();
 
+	/**
+   * Get the kind of memory pages the buffer pool got; HUGETLB_POOL_PAGES falls back to
+   * TRANSPARENT_HUGE_POOL_PAGES when the reserved huge page pool is exhausted
+	 */
+  PoolPages getPoolPages() const
+  {
+		return poolPages;
+  }
+
 	/**
    * Get buffer pool usage statistics
 	 */
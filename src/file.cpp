@@ -10,11 +10,21 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <new>
 #include <string>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_format_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
@@ -25,6 +35,91 @@ namespace badgerdb {
 
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+File::LatchMap File::open_latches_;
+File::DescriptorMap File::open_descriptors_;
+std::mutex File::open_files_latch_;
+
+/**
+ * Alignment O_DIRECT asks of file offsets, lengths and memory; the logical
+ * block size of any common device divides it.
+ */
+static const std::size_t DIRECT_IO_BLOCK = 4096;
+
+static_assert(alignof(Page) % DIRECT_IO_BLOCK == 0 && Page::SIZE % DIRECT_IO_BLOCK == 0,
+              "Pages must be whole aligned blocks for direct I/O.");
+
+/**
+ * Reads with pread until length bytes are read; what lies past the end of the
+ * file reads as zeros.
+ *
+ * @throws FileIOException  If a read fails.
+ */
+static void preadFully(const std::string& filename, const int fd, char* data, std::size_t length,
+                       off_t offset) {
+  while (length > 0) {
+    const ssize_t count = pread(fd, data, length, offset);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      throw FileIOException(filename, "pread", errno);
+    }
+    if (count == 0) {
+      // the end of the file
+      std::memset(data, 0, length);
+      return;
+    }
+    data += count;
+    length -= count;
+    offset += count;
+  }
+}
+
+/**
+ * Writes with pwrite until length bytes are written.
+ *
+ * @throws FileIOException  If a write fails or makes no progress.
+ */
+static void pwriteFully(const std::string& filename, const int fd, const char* data,
+                        std::size_t length, off_t offset) {
+  while (length > 0) {
+    const ssize_t count = pwrite(fd, data, length, offset);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      throw FileIOException(filename, "pwrite", errno);
+    }
+    if (count == 0) {
+      // no error given, but retrying would spin
+      throw FileIOException(filename, "pwrite", EIO);
+    }
+    data += count;
+    length -= count;
+    offset += count;
+  }
+}
+
+/**
+ * Allocates whole aligned blocks for direct I/O.
+ *
+ * @throws std::bad_alloc  If there is no memory for them.
+ */
+static std::unique_ptr<char, void (*)(void*)> allocateBlocks(const std::size_t span) {
+  char* blocks = static_cast<char*>(std::aligned_alloc(DIRECT_IO_BLOCK, span));
+  if (blocks == NULL) {
+    throw std::bad_alloc();
+  }
+  return std::unique_ptr<char, void (*)(void*)>(blocks, &std::free);
+}
+
+/**
+ * Returns true if a read or write can be made with O_DIRECT as it is.
+ */
+static bool blockAligned(const void* data, const off_t offset, const std::size_t length) {
+  return reinterpret_cast<std::uintptr_t>(data) % DIRECT_IO_BLOCK == 0 &&
+      offset % DIRECT_IO_BLOCK == 0 && length % DIRECT_IO_BLOCK == 0;
+}
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -40,6 +135,7 @@ bool File::isOpen(const std::string& filename) {
   if (!exists(filename)) {
     return false;
   }
+  std::lock_guard<std::mutex> guard(open_files_latch_);
   return open_counts_.find(filename) != open_counts_.end();
 }
 
@@ -64,21 +160,46 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
-  openIfNeeded(create_new);
+PageId File::getLastPageNo() {
+  const FileHeader& header = readHeader();
+  return header.last_used_page;
+}
+
+PageId File::getNumPages() {
+  const FileHeader& header = readHeader();
+  return header.num_pages;
+}
+
+File::File(const std::string& name, const bool create_new, const FileIO io)
+: filename_(name), fd_(-1) {
+  openIfNeeded(create_new, io);
 
   if (create_new) {
     // File starts with 1 page (the header).
-    FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+    FileHeader header = {FileHeader::MAGIC, FileHeader::VERSION,
+                         1 /* num_pages */, 0 /* first_used_page */,
+                         0 /* last_used_page */, 0 /* num_free_pages */,
+                         0 /* first_free_page */};
     writeHeader(header);
+  } else {
+    // A file of an older layout, or no database file at all, would be read
+    // as garbage pages.
+    const FileHeader header = readHeader();
+    if (header.magic != FileHeader::MAGIC || header.version != FileHeader::VERSION) {
+      close();
+      throw FileFormatException(filename_);
+    }
   }
 }
 
-void File::openIfNeeded(const bool create_new) {
+void File::openIfNeeded(const bool create_new, const FileIO io) {
+  std::lock_guard<std::mutex> guard(open_files_latch_);
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
     stream_ = open_streams_[filename_];
+    latch_ = open_latches_[filename_];
+    const DescriptorMap::const_iterator descriptor = open_descriptors_.find(filename_);
+    fd_ = descriptor == open_descriptors_.end() ? -1 : descriptor->second;
   } else {
     std::ios_base::openmode mode =
         std::fstream::in | std::fstream::out | std::fstream::binary;
@@ -96,52 +217,144 @@ void File::openIfNeeded(const bool create_new) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
+    if (io == DIRECT_IO) {
+      const int flags = O_RDWR | (create_new ? O_CREAT | O_TRUNC : 0);
+      fd_ = ::open(filename_.c_str(), flags | O_DIRECT, 0666);
+      if (fd_ < 0 && errno == EINVAL) {
+        // the filesystem does not support O_DIRECT
+        fd_ = ::open(filename_.c_str(), flags, 0666);
+      }
+      if (fd_ < 0) {
+        throw FileNotFoundException(filename_);
+      }
+      open_descriptors_[filename_] = fd_;
+    } else {
+      stream_.reset(new std::fstream(filename_, mode));
+    }
+    latch_.reset(new std::recursive_mutex());
     open_streams_[filename_] = stream_;
+    open_latches_[filename_] = latch_;
     open_counts_[filename_] = 1;
   }
 }
 
 void File::close() {
+  std::lock_guard<std::mutex> guard(open_files_latch_);
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
   stream_.reset();
+  latch_.reset();
+  fd_ = -1;
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
+    const DescriptorMap::iterator descriptor = open_descriptors_.find(filename_);
+    if (descriptor != open_descriptors_.end()) {
+      ::close(descriptor->second);
+      open_descriptors_.erase(descriptor);
+    }
     open_streams_.erase(filename_);
+    open_latches_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FileHeader header = FileHeader();
+  readAt(0 /* position */, &header, sizeof(FileHeader));
   return header;
 }
 
+void File::sync() const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  if (fd_ >= 0) {
+    // O_DIRECT bypasses the page cache but not the caches of the device
+    if (fsync(fd_) != 0) {
+      throw FileIOException(filename_, "fsync", errno);
+    }
+    return;
+  }
+  // flush reports a failed write of the buffer through badbit alone
+  if (stream_->flush().bad()) {
+    throw FileIOException(filename_, "flush", errno);
+  }
+  // the stream hides its descriptor; fsync through any descriptor of the file
+  // covers every write made to it
+  const int fd = ::open(filename_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw FileIOException(filename_, "open", errno);
+  }
+  if (fsync(fd) != 0) {
+    const int error = errno;
+    ::close(fd);
+    throw FileIOException(filename_, "fsync", error);
+  }
+  ::close(fd);
+}
+
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  writeAt(0 /* position */, &header, sizeof(FileHeader));
+}
+
+void File::readAt(const std::streampos position, void* data,
+                  const std::size_t length) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  if (fd_ < 0) {
+    stream_->seekg(position, std::ios::beg);
+    stream_->read(static_cast<char*>(data), length);
+    return;
+  }
+  const off_t offset = position;
+  if (blockAligned(data, offset, length)) {
+    preadFully(filename_, fd_, static_cast<char*>(data), length, offset);
+    return;
+  }
+  // read the whole blocks holding the bytes into an aligned buffer
+  const off_t begin = offset / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK;
+  const std::size_t span = (offset + length + DIRECT_IO_BLOCK - 1) / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK - begin;
+  std::unique_ptr<char, void (*)(void*)> blocks = allocateBlocks(span);
+  preadFully(filename_, fd_, blocks.get(), span, begin);
+  std::memcpy(data, blocks.get() + (offset - begin), length);
+}
+
+void File::writeAt(const std::streampos position, const void* data,
+                   const std::size_t length) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  if (fd_ < 0) {
+    stream_->seekp(position, std::ios::beg);
+    stream_->write(static_cast<const char*>(data), length);
+    return;
+  }
+  const off_t offset = position;
+  if (blockAligned(data, offset, length)) {
+    pwriteFully(filename_, fd_, static_cast<const char*>(data), length, offset);
+    return;
+  }
+  // rewrite the whole blocks holding the bytes, keeping the rest of their contents
+  const off_t begin = offset / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK;
+  const std::size_t span = (offset + length + DIRECT_IO_BLOCK - 1) / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK - begin;
+  std::unique_ptr<char, void (*)(void*)> blocks = allocateBlocks(span);
+  preadFully(filename_, fd_, blocks.get(), span, begin);
+  std::memcpy(blocks.get() + (offset - begin), data, length);
+  pwriteFully(filename_, fd_, blocks.get(), span, begin);
 }
 
 
 
 
 
-PageFile PageFile::create(const std::string& filename) {
-  return PageFile(filename, true /* create_new */);
+PageFile PageFile::create(const std::string& filename, const FileIO io) {
+  return PageFile(filename, true /* create_new */, io);
 }
 
-PageFile PageFile::open(const std::string& filename) {
-  return PageFile(filename, false /* create_new */);
+PageFile PageFile::open(const std::string& filename, const FileIO io) {
+  return PageFile(filename, false /* create_new */, io);
 }
 
-PageFile::PageFile(const std::string& name, const bool create_new)
-: File(name, create_new)
+PageFile::PageFile(const std::string& name, const bool create_new, const FileIO io)
+: File(name, create_new, io)
 {
 }
 
@@ -158,84 +371,51 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
-  openIfNeeded(false /* create_new */);
+  openIfNeeded(false /* create_new */, rhs.io());
   return *this;
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
   if (header.num_free_pages > 0) {
+    // Reuse the page at the head of the free list.
     new_page = readPage(header.first_free_page, true /* allow_free */);
     new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
     header.first_free_page = new_page.next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
-  }
-	else
-	{
+  } else {
     new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+  new_page_number = new_page.page_number();
+
+  // Link the new page in at the tail of the used list.  Reused pages also go
+  // to the tail, so the used list is in allocation order rather than page
+  // number order.
+  new_page.set_next_page_number(Page::INVALID_NUMBER);
+  new_page.set_prev_page_number(header.last_used_page);
+  if (header.last_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = new_page_number;
+  } else {
+    PageHeader tail_header = readPageHeader(header.last_used_page);
+    tail_header.next_page_number = new_page_number;
+    writePageHeader(header.last_used_page, tail_header);
   }
+  header.last_used_page = new_page_number;
+
+  writePage(new_page_number, new_page.header_, new_page);
   writeHeader(header);
 
   return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
 
 	if (page_number >= header.num_pages)
@@ -246,10 +426,9 @@ Page PageFile::readPage(const PageId page_number) const {
 }
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
+  readAt(pagePosition(page_number), &page, Page::SIZE);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
@@ -258,48 +437,52 @@ Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
 	PageHeader header = readPageHeader(new_page_number);
 	if (header.current_page_number == Page::INVALID_NUMBER)
 	{
 		// Page has been deleted since it was read.
 		throw InvalidPageException(new_page_number, filename_);
 	}
-	// Page on disk may have had its next page pointer updated since it was read;
-	// we don't modify that, but we do keep all the other modifications to the
-	// page header.
+	// Page on disk may have had its next/previous page pointers updated since it
+	// was read; we don't modify those, but we do keep all the other
+	// modifications to the page header.
 	const PageId next_page_number = header.next_page_number;
+	const PageId prev_page_number = header.prev_page_number;
 	header = new_page.header_;
 	header.next_page_number = next_page_number;
+	header.prev_page_number = prev_page_number;
 	writePage(new_page_number, header, new_page);
 }
 
 void PageFile::deletePage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  const PageId prev_page_number = existing_page.prev_page_number();
+  const PageId next_page_number = existing_page.next_page_number();
+  // Unlink the page from the used list by pointing its neighbours (or the
+  // file header, at either end of the list) at each other.
+  if (prev_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    PageHeader prev_header = readPageHeader(prev_page_number);
+    prev_header.next_page_number = next_page_number;
+    writePageHeader(prev_page_number, prev_header);
+  }
+  if (next_page_number == Page::INVALID_NUMBER) {
+    header.last_used_page = prev_page_number;
+  } else {
+    PageHeader next_header = readPageHeader(next_page_number);
+    next_header.prev_page_number = prev_page_number;
+    writePageHeader(next_page_number, next_header);
   }
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
 }
@@ -315,32 +498,36 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  // one write of a whole page, which direct I/O can make in place
+  Page page(new_page);
+  page.header_ = header;
+  writeAt(pagePosition(page_number), &page, Page::SIZE);
+}
+
+void PageFile::writePageHeader(const PageId page_number,
+                               const PageHeader& header) {
+  writeAt(pagePosition(page_number), &header, sizeof(PageHeader));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(pagePosition(page_number), &header, sizeof(PageHeader));
   return header;
 }
 
 
 
 
-BlobFile BlobFile::create(const std::string& filename) {
-  return BlobFile(filename, true /* create_new */);
+BlobFile BlobFile::create(const std::string& filename, const FileIO io) {
+  return BlobFile(filename, true /* create_new */, io);
 }
 
-BlobFile BlobFile::open(const std::string& filename) {
-  return BlobFile(filename, false /* create_new */);
+BlobFile BlobFile::open(const std::string& filename, const FileIO io) {
+  return BlobFile(filename, false /* create_new */, io);
 }
 
-BlobFile::BlobFile(const std::string& name, const bool create_new)
-: File(name, create_new) {
+BlobFile::BlobFile(const std::string& name, const bool create_new, const FileIO io)
+: File(name, create_new, io) {
 }
 
 BlobFile::~BlobFile() {
@@ -356,21 +543,33 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   // same file.
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
-  openIfNeeded(false /* create_new */);
+  openIfNeeded(false /* create_new */, rhs.io());
   return *this;
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
   FileHeader header = readHeader();
 	Page new_page;
 
-	new_page_number = header.num_pages;
+	if (header.num_free_pages > 0) {
+		// Reuse the page at the head of the free list; deletePage left the link
+		// to the next free page where a PageFile page keeps its header.
+		new_page_number = header.first_free_page;
+		header.first_free_page = readPage(new_page_number).next_page_number();
+		--header.num_free_pages;
 
-	if (header.first_used_page == Page::INVALID_NUMBER) {
-		header.first_used_page = header.num_pages;
-	}
+		assert((header.num_free_pages == 0) ==
+		       (header.first_free_page == Page::INVALID_NUMBER));
+	} else {
+		new_page_number = header.num_pages;
+
+		if (header.first_used_page == Page::INVALID_NUMBER) {
+			header.first_used_page = header.num_pages;
+		}
 
-	++header.num_pages;
+		++header.num_pages;
+	}
 
 	writePage(new_page_number, new_page);
 	writeHeader(header);
@@ -380,20 +579,231 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readAt(pagePosition(page_number), &page, Page::SIZE);
 	return page;
 }
 
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	writeAt(pagePosition(new_page_number), &new_page, Page::SIZE);
 }
 
-//delePage should not be called for a blob_file, not supported
 void BlobFile::deletePage(const PageId page_number) {
-	throw InvalidPageException(page_number, filename_);
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  FileHeader header = readHeader();
+
+	// Page 0 holds the file header.
+	if (page_number == 0 || page_number >= header.num_pages)
+	{
+		throw InvalidPageException(page_number, filename_);
+	}
+	// A page deleted twice would go on the free list twice, and be handed out
+	// by two allocations. Free pages are blank but for their free list link
+	// and their own number, which no freshly allocated page carries.
+	const Page existing_page = readPage(page_number);
+	Page free_page;
+	free_page.initialize();
+	free_page.set_page_number(page_number);
+	free_page.set_next_page_number(existing_page.next_page_number());
+	if (std::memcmp(&existing_page, &free_page, Page::SIZE) == 0)
+	{
+		throw InvalidPageException(page_number, filename_);
+	}
+	// Blob pages are raw, so the free list link is written over the start of
+	// the page, where a PageFile page keeps its header.
+	free_page.set_next_page_number(header.first_free_page);
+	header.first_free_page = page_number;
+	++header.num_free_pages;
+	writePage(page_number, free_page);
+	writeHeader(header);
+}
+
+FileMapping::FileMapping(const std::string& filename)
+: fd_(::open(filename.c_str(), O_RDONLY)),
+  base_(NULL),
+  length_(0),
+  pattern_(NORMAL_ACCESS) {
+  if (fd_ < 0) {
+    throw FileNotFoundException(filename);
+  }
+}
+
+FileMapping::~FileMapping() {
+  if (base_ != NULL) {
+    munmap(base_, length_);
+  }
+  ::close(fd_);
+}
+
+void FileMapping::remap() {
+  struct stat st;
+  fstat(fd_, &st);
+  if (base_ != NULL) {
+    munmap(base_, length_);
+    base_ = NULL;
+  }
+  length_ = st.st_size;
+  if (length_ == 0) {
+    return;
+  }
+  void* base = mmap(NULL, length_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (base == MAP_FAILED) {
+    length_ = 0;
+    return;
+  }
+  base_ = static_cast<char*>(base);
+  advise(pattern_);
+}
+
+void FileMapping::advise(const AccessPattern pattern) {
+  pattern_ = pattern;
+  if (base_ == NULL) {
+    return;
+  }
+  switch (pattern_) {
+  case NORMAL_ACCESS:
+    madvise(base_, length_, MADV_NORMAL);
+    break;
+  case SEQUENTIAL_ACCESS:
+    madvise(base_, length_, MADV_SEQUENTIAL);
+    break;
+  case RANDOM_ACCESS:
+    madvise(base_, length_, MADV_RANDOM);
+    break;
+  }
+}
+
+
+
+
+MappedPageFile::MappingMap MappedPageFile::open_mappings_;
+
+MappedPageFile MappedPageFile::create(const std::string& filename) {
+  return MappedPageFile(filename, true /* create_new */);
+}
+
+MappedPageFile MappedPageFile::open(const std::string& filename) {
+  return MappedPageFile(filename, false /* create_new */);
+}
+
+MappedPageFile::MappedPageFile(const std::string& name, const bool create_new)
+: PageFile(name, create_new) {
+  attachMapping();
+}
+
+MappedPageFile::MappedPageFile(const MappedPageFile& other)
+: PageFile(other) {
+  attachMapping();
+}
+
+MappedPageFile& MappedPageFile::operator=(const MappedPageFile& rhs) {
+  PageFile::operator=(rhs);
+  mapping_.reset();
+  attachMapping();
+  return *this;
+}
+
+MappedPageFile::~MappedPageFile() {
+  // the mapping goes first, while the stream latch still exists
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  mapping_.reset();
+}
+
+void MappedPageFile::attachMapping() {
+  {
+    std::lock_guard<std::mutex> guard(open_files_latch_);
+    mapping_ = open_mappings_[filename_].lock();
+    if (!mapping_) {
+      mapping_.reset(new FileMapping(filename_));
+      open_mappings_[filename_] = mapping_;
+    }
+  }
+  // writes through the stream only reach the mapping once they leave its
+  // buffer, so the stream shared by every File open on the file flushes each
+  // write as it is made; reads then copy straight out of the mapping
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  if (stream_) {
+    stream_->setf(std::ios::unitbuf);
+  }
+}
+
+void MappedPageFile::setAccessPattern(const AccessPattern pattern) {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  mapping_->advise(pattern);
+}
+
+void MappedPageFile::readMapped(const PageId page_number,
+                                const std::streampos position,
+                                void* data, const std::size_t length) const {
+  std::lock_guard<std::recursive_mutex> guard(*latch_);
+  // writes through the stream are flushed as they are made (see
+  // attachMapping); direct writes drop the cached pages the mapping would
+  // read stale
+  const std::size_t end = static_cast<std::size_t>(position) + length;
+  if (end > mapping_->length()) {
+    // the file grew through the stream since it was mapped
+    mapping_->remap();
+    if (end > mapping_->length()) {
+      throw InvalidPageException(page_number, filename_);
+    }
+  }
+  std::memcpy(data, mapping_->base() + static_cast<std::size_t>(position), length);
+}
+
+FileHeader MappedPageFile::readHeader() const {
+  FileHeader header;
+  readMapped(0 /* page_number */, 0 /* position */, &header, sizeof(FileHeader));
+  return header;
+}
+
+Page MappedPageFile::readPage(const PageId page_number,
+                              const bool allow_free) const {
+  Page page;
+  readMapped(page_number, pagePosition(page_number), &page, Page::SIZE);
+  if (!allow_free && !page.isUsed()) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return page;
+}
+
+PageHeader MappedPageFile::readPageHeader(const PageId page_number) const {
+  PageHeader header;
+  readMapped(page_number, pagePosition(page_number), &header,
+             sizeof(PageHeader));
+  return header;
+}
+
+IOQueue::IOQueue(const std::uint32_t num_threads)
+: stopping_(false) {
+  for (std::uint32_t i = 0; i < num_threads; ++i) {
+    threads_.push_back(std::thread(&IOQueue::run, this));
+  }
+}
+
+IOQueue::~IOQueue() {
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void IOQueue::run() {
+  while (true) {
+    std::function<void()> request;
+    {
+      std::unique_lock<std::mutex> guard(latch_);
+      ready_.wait(guard, [this]() { return stopping_ || !requests_.empty(); });
+      if (requests_.empty()) {
+        return;
+      }
+      request = std::move(requests_.front());
+      requests_.pop_front();
+    }
+    request();
+  }
 }
 
 }
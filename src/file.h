@@ -7,10 +7,19 @@
 
 #pragma once
 
+#include <cstdint>
 #include <fstream>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include "page.h"
 
@@ -22,6 +31,16 @@ class FileIterator;
  * @brief Header metadata for files on disk which contain pages.
  */
 struct FileHeader {
+  /**
+   * MAGIC in every file written by BadgerDB.
+   */
+  std::uint32_t magic;
+
+  /**
+   * VERSION of the on-disk layout the file was written with.
+   */
+  std::uint32_t version;
+
   /**
    * Number of pages allocated in the file.
    */
@@ -32,6 +51,12 @@ struct FileHeader {
    */
   PageId first_used_page;
 
+  /**
+   * Page number of the last used page in the file.  New pages are linked in
+   * after it, so allocation never has to walk the used list.
+   */
+  PageId last_used_page;
+
   /**
    * Number of free pages (allocated but unused) in the file.
    */
@@ -49,11 +74,33 @@ struct FileHeader {
    * @return  True if the other header is equal to this one.
    */
   bool operator==(const FileHeader& rhs) const {
-    return num_pages == rhs.num_pages &&
+    return magic == rhs.magic &&
+        version == rhs.version &&
+        num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
+        last_used_page == rhs.last_used_page &&
         first_free_page == rhs.first_free_page;
   }
+
+  /**
+   * Value of magic: "BDBF" read as a little-endian number.
+   */
+  static const std::uint32_t MAGIC = 0x46424442;
+
+  /**
+   * Value of version. Version 2 has the header take all of page 0; files of
+   * version 1 put page 1 right after the header, and had no magic or version.
+   */
+  static const std::uint32_t VERSION = 2;
+};
+
+/**
+ * @brief How a file is read and written.
+ */
+enum FileIO {
+  BUFFERED_IO,  /* Through a stream and the kernel's page cache */
+  DIRECT_IO     /* With O_DIRECT, straight between the pages and the disk */
 };
 
 /**
@@ -68,7 +115,22 @@ struct FileHeader {
  * detects this (by looking in the open_streams_ map) and just returns a file object with
  * the already created stream for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * File objects may be used from several threads at once. Every File object sharing a stream also
+ * shares a latch, held for the whole of each operation on the stream, since a seek followed by a
+ * read or write must not be interleaved with another thread's.
+ *
+ * Writes are left to the stream's buffering; sync() marks the points at which they must be durable.
+ *
+ * A file opened with DIRECT_IO is read and written with O_DIRECT instead, so the buffer manager's
+ * pool is the only cache of its pages and none of the memory goes to a second copy in the kernel's
+ * page cache. Such I/O has to be in whole aligned blocks: pages are, since they are aligned in
+ * memory and start at multiples of Page::SIZE in the file, and smaller reads and writes such as
+ * the file header go through an aligned block. The mode is chosen by whoever opens the file first;
+ * File objects opened later on the same file share it, whatever mode they ask for. A filesystem
+ * refusing O_DIRECT still gets the same aligned I/O, through the page cache.
+ *
+ * The file header takes all of page 0, so every page starts on a multiple of Page::SIZE. It begins
+ * with FileHeader::MAGIC and FileHeader::VERSION, and a file without them is not opened.
  */
 
 
@@ -80,12 +142,16 @@ class File {
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param io          How to read and write the file, unless it is open already.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  FileFormatException     If the underlying file exists, create_new
+   *                                  is false, and its header does not carry
+   *                                  FileHeader::MAGIC and FileHeader::VERSION.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new, const FileIO io = BUFFERED_IO);
 
   /**
    * Deletes an existing file.
@@ -150,6 +216,23 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Makes every write to the file so far durable: the stream buffer is handed
+   * to the operating system and the file is fsync'ed. Writes are not flushed
+   * one by one, so this is the only point at which they are known to be on
+   * disk.
+   *
+   * @throws FileIOException  If the flush, the fsync or reopening the file to
+   *                          fsync it fails.
+   */
+  void sync() const;
+
+  /**
+   * Returns how the file is read and written, which is the mode of whoever
+   * opened it first.
+   */
+  FileIO io() const { return fd_ < 0 ? BUFFERED_IO : DIRECT_IO; }
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -164,6 +247,20 @@ class File {
    */
 	PageId getFirstPageNo();
 
+ 	/**
+   * Returns pageid of last used page in the file, the one new pages are linked in after.
+   *
+   * @return  Page number of the tail of the used list.
+   */
+	PageId getLastPageNo();
+
+ 	/**
+   * Returns the number of pages in the file, counting the header page and free pages.
+   *
+   * @return  One more than the highest page number of the file.
+   */
+	PageId getNumPages();
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
@@ -173,7 +270,7 @@ class File {
    * @return  Position of page in file.
    */
   static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+    return static_cast<std::streamoff>(page_number) * Page::SIZE;
   }
 
   /**
@@ -182,12 +279,13 @@ class File {
    * the same filesystem file; otherwise, it reuses the existing stream.
    *
    * @param create_new  Whether to create a new file.
+   * @param io          How to read and write the file if it is not open yet.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  void openIfNeeded(const bool create_new);
+  void openIfNeeded(const bool create_new, const FileIO io);
 
   /**
    * Closes the underlying file stream in <stream_>.
@@ -201,7 +299,7 @@ class File {
    *
    * @return  The file header.
    */
-  FileHeader readHeader() const;
+  virtual FileHeader readHeader() const;
 
   /**
    * Writes the given header to the disk as the header for this file.
@@ -210,8 +308,31 @@ class File {
    */
   void writeHeader(const FileHeader& header);
 
+  /**
+   * Reads bytes from the file. Bytes past the end of a file open with
+   * DIRECT_IO read as zeros.
+   *
+   * @param position  Offset of the first byte in the file.
+   * @param data      Where to put the bytes.
+   * @param length    Number of bytes.
+   * @throws  FileIOException   If a DIRECT_IO read fails.
+   */
+  void readAt(const std::streampos position, void* data, const std::size_t length) const;
+
+  /**
+   * Writes bytes to the file.
+   *
+   * @param position  Offset of the first byte in the file.
+   * @param data      Bytes to write.
+   * @param length    Number of bytes.
+   * @throws  FileIOException   If a DIRECT_IO write fails.
+   */
+  void writeAt(const std::streampos position, const void* data, const std::size_t length);
+
   typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, int> DescriptorMap;
+  typedef std::map<std::string, std::shared_ptr<std::recursive_mutex> > LatchMap;
 
   /**
    * Streams for opened files.
@@ -223,6 +344,21 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * Stream latches for opened files.
+   */
+  static LatchMap open_latches_;
+
+  /**
+   * Descriptors of the files opened with DIRECT_IO, which have no stream.
+   */
+  static DescriptorMap open_descriptors_;
+
+  /**
+   * Guards open_streams_, open_counts_, open_latches_ and open_descriptors_.
+   */
+  static std::mutex open_files_latch_;
+
   /**
    * Name of the file this object represents.
    */
@@ -233,6 +369,18 @@ class File {
    */
   std::shared_ptr<std::fstream> stream_;
 
+  /**
+   * Descriptor the file is read and written through with DIRECT_IO; -1 for
+   * BUFFERED_IO, which goes through stream_.
+   */
+  int fd_;
+
+  /**
+   * Latch serializing operations on stream_ or fd_. Recursive since operations nest,
+   * e.g. allocatePage reads and writes the file header.
+   */
+  std::shared_ptr<std::recursive_mutex> latch_;
+
   friend class FileIterator;
 };
 
@@ -243,9 +391,10 @@ class PageFile : public File {
    * Creates a new file.
    *
    * @param filename  Name of the file.
+   * @param io        How to read and write the file, unless it is open already.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static PageFile create(const std::string& filename);
+  static PageFile create(const std::string& filename, const FileIO io = BUFFERED_IO);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
@@ -255,21 +404,23 @@ class PageFile : public File {
 	 * open_streams_ map.
    *
    * @param filename  Name of the file.
+   * @param io        How to read and write the file, unless it is open already.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static PageFile open(const std::string& filename);
+  static PageFile open(const std::string& filename, const FileIO io = BUFFERED_IO);
 
   /**
    * Constructs a file object representing a file on the filesystem.
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param io          How to read and write the file, unless it is open already.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  PageFile(const std::string& name, const bool create_new);
+  PageFile(const std::string& name, const bool create_new, const FileIO io = BUFFERED_IO);
 
   /**
    * Copy constructor.
@@ -341,7 +492,7 @@ class PageFile : public File {
    */
   FileIterator end();
 
- private:
+ protected:
 
   /**
    * Reads a page from the file.  If <allow_free> is not set, an exception
@@ -356,7 +507,9 @@ class PageFile : public File {
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  virtual Page readPage(const PageId page_number, const bool allow_free) const;
+
+ private:
 
   /**
    * Writes a page into the file at the given page number with the given header.
@@ -377,11 +530,211 @@ class PageFile : public File {
    * @param page_number   Number of page whose header is to be read.
    * @return  Header of page.
    */
-  PageHeader readPageHeader(const PageId page_number) const;
+  virtual PageHeader readPageHeader(const PageId page_number) const;
+
+  /**
+   * Writes only the header of the given page to disk, leaving the record data
+   * and slot table untouched.  Used to relink neighbours in the used list.
+   * No bounds checking is performed.
+   *
+   * @param page_number   Number of page whose header is to be written.
+   * @param header        Header to write.
+   */
+  void writePageHeader(const PageId page_number, const PageHeader& header);
 
   friend class FileIterator;
 };
 
+/**
+ * @brief Expected order of page reads from a MappedPageFile, passed on to the
+ *        kernel through madvise.
+ */
+enum AccessPattern {
+  NORMAL_ACCESS,      /* No particular order */
+  SEQUENTIAL_ACCESS,  /* Pages read in file order, e.g. by a FileScan; read ahead aggressively */
+  RANDOM_ACCESS       /* Pages read in no order, e.g. index lookups; do not read ahead */
+};
+
+/**
+ * @brief Read-only memory mapping of a file, shared by every MappedPageFile
+ *        open on that file.
+ */
+class FileMapping {
+ public:
+  /**
+   * Opens the file for mapping; nothing is mapped until remap is called.
+   *
+   * @param filename  Name of the file.
+   * @throws  FileNotFoundException   If the file cannot be opened.
+   */
+  explicit FileMapping(const std::string& filename);
+
+  /**
+   * Unmaps the file and closes it.
+   */
+  ~FileMapping();
+
+  FileMapping(const FileMapping&) = delete;
+  FileMapping& operator=(const FileMapping&) = delete;
+
+  /**
+   * Maps the file again at its current size, after it has grown.
+   */
+  void remap();
+
+  /**
+   * Sets the access pattern of the mapping, now and after later remaps.
+   *
+   * @param pattern   Expected order of reads.
+   */
+  void advise(const AccessPattern pattern);
+
+  /**
+   * Start of the mapped file, NULL if nothing is mapped.
+   */
+  const char* base() const { return base_; }
+
+  /**
+   * Number of bytes mapped.
+   */
+  std::size_t length() const { return length_; }
+
+ private:
+  /**
+   * Descriptor the file is mapped from.
+   */
+  int fd_;
+
+  /**
+   * Start of the mapping.
+   */
+  char* base_;
+
+  /**
+   * Number of bytes mapped.
+   */
+  std::size_t length_;
+
+  /**
+   * Access pattern given to madvise.
+   */
+  AccessPattern pattern_;
+};
+
+/**
+ * @brief A PageFile whose pages are read through a memory mapping of the file
+ *        instead of the stream.
+ *
+ * Reads are a copy out of the mapping: no seek or read call, and no system
+ * call at all once the page is in the kernel's page cache. The file header
+ * used to bounds check a read is read from the mapping too. Writes still go
+ * through the shared stream, which flushes every write while a
+ * MappedPageFile is open on the file, so a MappedPageFile and PageFile
+ * objects open on the same file always see the same pages. The mapping grows
+ * when a read goes past its end. Meant for relations that are read much more
+ * than they are written, such as the inputs of long scans.
+ */
+class MappedPageFile : public PageFile {
+ public:
+
+  /**
+   * Creates a new file.
+   *
+   * @param filename  Name of the file.
+   * @throws  FileExistsException     If the requested file already exists.
+   */
+  static MappedPageFile create(const std::string& filename);
+
+  /**
+   * Opens the file named fileName and returns the corresponding File object.
+   * The mapping is shared with any other MappedPageFile open on the same file.
+   *
+   * @param filename  Name of the file.
+   * @throws  FileNotFoundException   If the requested file doesn't exist.
+   */
+  static MappedPageFile open(const std::string& filename);
+
+  /**
+   * Constructs a file object representing a file on the filesystem.
+   *
+   * @param name        Name of file.
+   * @param create_new  Whether to create a new file.
+   * @throws  FileExistsException     If the underlying file exists and
+   *                                  create_new is true.
+   * @throws  FileNotFoundException   If the underlying file doesn't exist and
+   *                                  create_new is false.
+   */
+  MappedPageFile(const std::string& name, const bool create_new);
+
+  /**
+   * Copy constructor.
+   *
+   * @param other File object to copy.
+   * @return      A copy of the File object.
+   */
+  MappedPageFile(const MappedPageFile& other);
+
+  /**
+   * Assignment operator.
+   *
+   * @param rhs File object to assign.
+   * @return    Newly assigned file object.
+   */
+  MappedPageFile& operator=(const MappedPageFile& rhs);
+
+  /**
+   * Destructor; the mapping is removed with the last MappedPageFile on the
+   * file.
+   */
+  ~MappedPageFile();
+
+  using PageFile::readPage;
+
+  /**
+   * Tells the kernel in which order pages will be read from the file.
+   *
+   * @param pattern   Expected order of reads.
+   */
+  void setAccessPattern(const AccessPattern pattern);
+
+ protected:
+  FileHeader readHeader() const override;
+  Page readPage(const PageId page_number, const bool allow_free) const override;
+  PageHeader readPageHeader(const PageId page_number) const override;
+
+ private:
+  /**
+   * Finds the mapping of filename_ or sets one up, and has the shared stream
+   * flush every write from now on, until the file is closed.
+   */
+  void attachMapping();
+
+  /**
+   * Copies bytes out of the mapping, growing it first if they lie past its end.
+   *
+   * @param page_number   Page the bytes belong to, for the exception.
+   * @param position      Offset of the first byte in the file.
+   * @param data          Where to copy the bytes.
+   * @param length        Number of bytes.
+   * @throws  InvalidPageException  If the bytes lie past the end of the file.
+   */
+  void readMapped(const PageId page_number, const std::streampos position,
+                  void* data, const std::size_t length) const;
+
+  typedef std::map<std::string, std::weak_ptr<FileMapping> > MappingMap;
+
+  /**
+   * Mappings of the files open as a MappedPageFile, guarded by
+   * open_files_latch_.
+   */
+  static MappingMap open_mappings_;
+
+  /**
+   * Mapping of this file.
+   */
+  std::shared_ptr<FileMapping> mapping_;
+};
+
 class BlobFile : public File {
  public:
 
@@ -389,9 +742,10 @@ class BlobFile : public File {
    * Creates a new BlobFile.
    *
    * @param filename  Name of the file.
+   * @param io        How to read and write the file, unless it is open already.
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static BlobFile create(const std::string& filename);
+  static BlobFile create(const std::string& filename, const FileIO io = BUFFERED_IO);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
@@ -401,9 +755,10 @@ class BlobFile : public File {
 	 * open_streams_ map.
    *
    * @param filename  Name of the file.
+   * @param io        How to read and write the file, unless it is open already.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static BlobFile open(const std::string& filename);
+  static BlobFile open(const std::string& filename, const FileIO io = BUFFERED_IO);
 
   /**
    * Constructs a file object representing a file on the filesystem.
@@ -412,12 +767,13 @@ class BlobFile : public File {
    * @see File::open()
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param io          How to read and write the file, unless it is open already.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  BlobFile(const std::string& name, const bool create_new);
+  BlobFile(const std::string& name, const bool create_new, const FileIO io = BUFFERED_IO);
 
   /**
    * Copy constructor.
@@ -468,11 +824,94 @@ class BlobFile : public File {
   void writePage(const PageId page_number, const Page& new_page) override;
 
   /**
-   * Deletes a page from the file.
+   * Deletes a page from the file.  The page goes on a free list and is handed
+   * out again by a later allocatePage.
    *
    * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException  If the page doesn't exist in the file, is
+   *                                the header page (0) or is already free.
    */
   void deletePage(const PageId page_number) override;
 };
 
+/**
+ * @brief Pool of threads running file reads and writes off the caller's
+ *        thread.
+ *
+ * A request is any callable; submit queues it and returns a future for its
+ * result, or for the exception it throws. Requests run in the order they were
+ * submitted, up to one per thread at a time, so a caller can put several
+ * requests in flight and collect them later. Requests on the same file still
+ * take turns on its stream latch; requests on different files, and the work
+ * between requests, overlap.
+ */
+class IOQueue {
+ public:
+  /**
+   * Starts the threads.
+   *
+   * @param num_threads Number of requests run at once.
+   */
+  explicit IOQueue(const std::uint32_t num_threads);
+
+  /**
+   * Runs the requests still queued, then stops the threads.
+   */
+  ~IOQueue();
+
+  IOQueue(const IOQueue&) = delete;
+  IOQueue& operator=(const IOQueue&) = delete;
+
+  /**
+   * Queues a request.
+   *
+   * @param request Callable run on one of the threads.
+   * @return  Future for the result of the request.
+   */
+  template<class Request>
+  std::future<std::invoke_result_t<Request>> submit(Request request) {
+    typedef std::invoke_result_t<Request> Result;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(request));
+    std::future<Result> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> guard(latch_);
+      requests_.push_back([task]() { (*task)(); });
+    }
+    ready_.notify_one();
+    return result;
+  }
+
+ private:
+  /**
+   * Body of each thread: runs queued requests until the queue is stopped and
+   * empty.
+   */
+  void run();
+
+  /**
+   * Threads running the requests.
+   */
+  std::vector<std::thread> threads_;
+
+  /**
+   * Requests not yet started.
+   */
+  std::deque<std::function<void()>> requests_;
+
+  /**
+   * Protects requests_ and stopping_.
+   */
+  std::mutex latch_;
+
+  /**
+   * Signalled when a request is queued or the queue stops.
+   */
+  std::condition_variable ready_;
+
+  /**
+   * Set by the destructor.
+   */
+  bool stopping_;
+};
+
 }
@@ -5,18 +5,249 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <thread>
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/invalid_page_exception.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+ScanPredicate::ScanPredicate(const int byteOffset, const Operator op, const int value)
+  : byteOffset(byteOffset), type(INTEGER), op(op), intValue(value), doubleValue(0)
+{
+}
+
+ScanPredicate::ScanPredicate(const int byteOffset, const Operator op, const double value)
+  : byteOffset(byteOffset), type(DOUBLE), op(op), intValue(0), doubleValue(value)
+{
+}
+
+ScanPredicate::ScanPredicate(const int byteOffset, const Operator op, const std::string& value)
+  : byteOffset(byteOffset), type(STRING), op(op), intValue(0), doubleValue(0), stringValue(value)
+{
+}
+
+template <class T>
+static bool compare(const T& attribute, const Operator op, const T& constant)
+{
+  switch (op)
+  {
+    case LT:
+      return attribute < constant;
+    case LTE:
+      return attribute <= constant;
+    case GTE:
+      return attribute >= constant;
+    case GT:
+      return attribute > constant;
+  }
+  return false;
+}
+
+bool ScanPredicate::matches(std::string_view record) const
+{
+  const char* attribute = record.data() + byteOffset;
+  switch (type)
+  {
+    case INTEGER:
+    {
+      if (record.size() < byteOffset + sizeof(int))
+        return false;
+      // attributes inside a record need not be aligned
+      int value;
+      memcpy(&value, attribute, sizeof(int));
+      return compare(value, op, intValue);
+    }
+    case DOUBLE:
+    {
+      if (record.size() < byteOffset + sizeof(double))
+        return false;
+      double value;
+      memcpy(&value, attribute, sizeof(double));
+      return compare(value, op, doubleValue);
+    }
+    case STRING:
+      if (record.size() < byteOffset + stringValue.size())
+        return false;
+      return compare(strncmp(attribute, stringValue.c_str(), stringValue.size()), op, 0);
+  }
+  return false;
+}
+
+RecordBatch::RecordBatch(const std::vector<ScanColumn>& attributes)
+  : numRecords(0)
+{
+  for (const ScanColumn& attribute : attributes)
+  {
+    Column column;
+    column.attribute = attribute;
+    columns.push_back(column);
+  }
+}
+
+int RecordBatch::numSelected() const
+{
+  int count = 0;
+  for (int row = 0; row < numRecords; row++)
+    count += selected[row];
+  return count;
+}
+
+void RecordBatch::clear()
+{
+  numRecords = 0;
+  rids.clear();
+  selected.clear();
+  for (Column& column : columns)
+  {
+    column.ints.clear();
+    column.doubles.clear();
+    column.strings.clear();
+  }
+}
+
+void RecordBatch::append(const RecordId& rid, std::string_view record)
 {
-  file = new PageFile(name, false);	//dont create new file
+  for (Column& column : columns)
+  {
+    // copy what the record has of the attribute over zeros
+    const std::size_t offset = column.attribute.byteOffset;
+    const char* attribute = record.data() + offset;
+    const std::size_t available = record.size() > offset ? record.size() - offset : 0;
+    switch (column.attribute.type)
+    {
+      case INTEGER:
+      {
+        int value = 0;
+        memcpy(&value, attribute, std::min(available, sizeof(int)));
+        column.ints.push_back(value);
+        break;
+      }
+      case DOUBLE:
+      {
+        double value = 0;
+        memcpy(&value, attribute, std::min(available, sizeof(double)));
+        column.doubles.push_back(value);
+        break;
+      }
+      case STRING:
+      {
+        const std::size_t length = column.attribute.length;
+        column.strings.resize(column.strings.size() + length, 0);
+        memcpy(&column.strings[column.strings.size() - length], attribute, std::min(available, length));
+        break;
+      }
+    }
+  }
+  rids.push_back(rid);
+  selected.push_back(1);
+  numRecords++;
+}
+
+/**
+ * Clears the selection of the values failing a comparison with a constant. The loops have no
+ * branches, so that the compiler vectorizes them.
+ */
+template <class T>
+static void selectColumn(const T* values, const int numValues, const Operator op, const T constant,
+                         std::uint8_t* selected)
+{
+  switch (op)
+  {
+    case LT:
+      for (int row = 0; row < numValues; row++)
+        selected[row] &= values[row] < constant;
+      break;
+    case LTE:
+      for (int row = 0; row < numValues; row++)
+        selected[row] &= values[row] <= constant;
+      break;
+    case GTE:
+      for (int row = 0; row < numValues; row++)
+        selected[row] &= values[row] >= constant;
+      break;
+    case GT:
+      for (int row = 0; row < numValues; row++)
+        selected[row] &= values[row] > constant;
+      break;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * selectColumn for INTEGER columns, comparing 8 values at a time. It is compiled for AVX2 whatever
+ * the build targets, so it may only be called once the CPU is known to have AVX2.
+ */
+__attribute__((target("avx2")))
+static void selectIntColumnAvx2(const int* values, const int numValues, const Operator op, const int constant,
+                                std::uint8_t* selected)
+{
+  const __m256i constants = _mm256_set1_epi32(constant);
+  int row = 0;
+  for (; row + 8 <= numValues; row += 8)
+  {
+    const __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + row));
+    // LT and GTE compare constant > value, LTE and GT value > constant; GTE and LTE negate
+    const __m256i greater = (op == LT || op == GTE) ? _mm256_cmpgt_epi32(constants, lanes)
+                                                    : _mm256_cmpgt_epi32(lanes, constants);
+    int bits = _mm256_movemask_ps(_mm256_castsi256_ps(greater));
+    if (op == LTE || op == GTE)
+      bits = ~bits;
+    for (int lane = 0; lane < 8; lane++)
+      selected[row + lane] &= (bits >> lane) & 1;
+  }
+  for (; row < numValues; row++)
+    selected[row] &= compare(values[row], op, constant);
+}
+#endif
+
+/**
+ * selectColumn for INTEGER columns: the AVX2 version on CPUs that have it, checked once at run
+ * time, and the vectorized loops of the build's own target on the others.
+ */
+static void selectIntColumn(const int* values, const int numValues, const Operator op, const int constant,
+                            std::uint8_t* selected)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2)
+  {
+    selectIntColumnAvx2(values, numValues, op, constant, selected);
+    return;
+  }
+#endif
+  selectColumn(values, numValues, op, constant, selected);
+}
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const bool mapped)
+  : FileScan(name, bufferMgr, std::vector<ScanPredicate>(), std::vector<ScanAttribute>(), mapped)
+{
+}
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const std::vector<ScanPredicate>& predicates,
+                   const std::vector<ScanAttribute>& projection, const bool mapped)
+  : predicates(predicates), projection(projection)
+{
+  if (mapped)
+  {
+    MappedPageFile* mappedFile = new MappedPageFile(name, false);	//dont create new file
+    mappedFile->setAccessPattern(SEQUENTIAL_ACCESS);
+    file = mappedFile;
+  }
+  else
+    file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
 	curDirtyFlag = false;
   curPage = NULL;
-	filePageIter = file->begin();
+	curPageNo = file->begin().page_number();
+  pagesUntilReadAhead = 0;
 }
 
 FileScan::~FileScan()
@@ -24,84 +255,82 @@ FileScan::~FileScan()
   // generally must unpin last page of the scan
   if (curPage != NULL)
   {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, curPageNo, curDirtyFlag);
     curPage = NULL;
 		curDirtyFlag = false;
-    filePageIter = file->begin();
   }
   bufMgr->flushFile(file);
   delete file;
 }
 
+void FileScan::readCurPage()
+{
+  bufMgr->readPage(file, curPageNo, curPage);
+
+  if (pagesUntilReadAhead == 0)
+  {
+    bufMgr->readAhead(file, curPageNo, BufMgr::READ_AHEAD_PAGES,
+                      [](const Page& page) { return page.next_page_number(); });
+    pagesUntilReadAhead = BufMgr::READ_AHEAD_PAGES / 2;
+  }
+  pagesUntilReadAhead--;
+}
+
 void FileScan::scanNext(RecordId& outRid)
 {
-  std::string rec;
+  // records failing a predicate are skipped where they lie in the pinned page
+  std::string_view record;
+  do
+  {
+    nextRecord();
+    record = pageRecordIter.recordView();
+  } while (!std::all_of(predicates.begin(), predicates.end(),
+                        [&record](const ScanPredicate& predicate) { return predicate.matches(record); }));
+
+	// return rid of the record
+	outRid = pageRecordIter.getCurrentRecord();
+}
 
-  if (filePageIter == file->end())
+void FileScan::nextRecord()
+{
+  if (curPageNo == Page::INVALID_NUMBER)
 	{
 		throw EndOfFileException();
 	}
 
-  // special case of the first record of the first page of the file
   if (curPage == NULL)
   {
-    // need to get the first page of the file
-		filePageIter = file->begin();
-    if(filePageIter == file->end())
-		{
-			throw EndOfFileException();
-		}
-	 
-		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
+		// read the first page of the file and get the first record off it
+    readCurPage();
 		curDirtyFlag = false;
-
-		// get the first record off the page
     pageRecordIter = curPage->begin(); 
-
-		if(pageRecordIter != curPage->end()) 
-		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
-
-			outRid = pageRecordIter.getCurrentRecord();
-			return;
-		}
   }
-
-	// Loop, looking for a record that satisfied the predicate.
-	// First try and get the next record off the current page
-	pageRecordIter++;
+  else
+  {
+	  // First try and get the next record off the current page
+	  pageRecordIter++;
+  }
 
   while (pageRecordIter == curPage->end())
   {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    const PageId nextPageNo = curPage->next_page_number();
+    bufMgr->unPinPage(file, curPageNo, curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
 
-    filePageIter++;
-    if (filePageIter == file->end())
+    curPageNo = nextPageNo;
+    if (curPageNo == Page::INVALID_NUMBER)
     {
-      curPage = NULL;
 			throw EndOfFileException();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    readCurPage();
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
   }
-
-  // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
-
-	// return rid of the record
-	outRid = pageRecordIter.getCurrentRecord();
-	return;
 }
 
 // returns pointer to the current record.  page is left pinned
@@ -111,10 +340,219 @@ std::string FileScan::getRecord()
   return *pageRecordIter;
 }
 
+// returns the current record in place; valid while the page stays pinned
+std::string_view FileScan::getRecordView() const
+{
+  return pageRecordIter.recordView();
+}
+
+bool FileScan::scanNextBatch(RecordBatch& batch)
+{
+  batch.clear();
+  if (curPageNo == Page::INVALID_NUMBER)
+    return false;
+
+  readCurPage();
+
+  // predicates on a decoded attribute wait for the whole column; the others are evaluated here
+  std::vector<int> predicateColumns(predicates.size(), -1);
+  for (std::size_t p = 0; p < predicates.size(); p++)
+  {
+    for (std::size_t c = 0; c < batch.columns.size(); c++)
+    {
+      const ScanColumn& attribute = batch.columns[c].attribute;
+      if (attribute.byteOffset == predicates[p].byteOffset && attribute.type == predicates[p].type &&
+          (attribute.type != STRING || attribute.length >= (int)predicates[p].stringValue.size()))
+        predicateColumns[p] = c;
+    }
+  }
+
+  for (PageIterator iter = curPage->begin(); iter != curPage->end(); ++iter)
+  {
+    const std::string_view record = iter.recordView();
+    batch.append(iter.getCurrentRecord(), record);
+    for (std::size_t p = 0; p < predicates.size(); p++)
+    {
+      if (predicateColumns[p] < 0)
+        batch.selected.back() &= predicates[p].matches(record);
+    }
+  }
+
+  const PageId nextPageNo = curPage->next_page_number();
+  bufMgr->unPinPage(file, curPageNo, false);
+  curPage = NULL;
+  curPageNo = nextPageNo;
+
+  for (std::size_t p = 0; p < predicates.size(); p++)
+  {
+    if (predicateColumns[p] < 0)
+      continue;
+    const ScanPredicate& predicate = predicates[p];
+    const RecordBatch::Column& column = batch.columns[predicateColumns[p]];
+    switch (predicate.type)
+    {
+      case INTEGER:
+        selectIntColumn(column.ints.data(), batch.numRecords, predicate.op, predicate.intValue, batch.selected.data());
+        break;
+      case DOUBLE:
+        selectColumn(column.doubles.data(), batch.numRecords, predicate.op, predicate.doubleValue, batch.selected.data());
+        break;
+      case STRING:
+        for (int row = 0; row < batch.numRecords; row++)
+        {
+          const char* value = &column.strings[row * column.attribute.length];
+          batch.selected[row] &= compare(strncmp(value, predicate.stringValue.c_str(), predicate.stringValue.size()),
+                                         predicate.op, 0);
+        }
+        break;
+    }
+  }
+  return true;
+}
+
+// returns the projected attributes of the current record, gathered into a buffer reused
+// from record to record
+std::string_view FileScan::getProjection()
+{
+  const std::string_view record = pageRecordIter.recordView();
+  if (projection.empty())
+    return record;
+  projected.clear();
+  for (const ScanAttribute& attribute : projection)
+    projected.append(record.substr(attribute.byteOffset, attribute.length));
+  return projected;
+}
+
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
   curDirtyFlag = true;
 }
 
+ParallelFileScan::ParallelFileScan(const std::string &name, BufMgr *bufferMgr, const std::uint32_t numWorkers,
+                                   const std::vector<ScanPredicate>& predicates)
+  : file(new PageFile(name, false)),	//dont create new file
+    bufMgr(bufferMgr),
+    numWorkers(std::max<std::uint32_t>(numWorkers, 1)),
+    predicates(predicates)
+{
+}
+
+ParallelFileScan::~ParallelFileScan()
+{
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void ParallelFileScan::run(const Sink& sink)
+{
+  // deal the morsels out in contiguous shares, so that each worker starts on a region of its own
+  const PageId numPages = file->getNumPages();
+  const PageId numMorsels = (numPages - 1 + MORSEL_PAGES - 1) / MORSEL_PAGES;
+  std::vector<MorselQueue> queues(numWorkers);
+  for (PageId m = 0; m < numMorsels; m++)
+  {
+    const PageId first = 1 + m * MORSEL_PAGES;
+    queues[(std::uint64_t)m * numWorkers / numMorsels].morsels.push_back(
+        std::make_pair(first, std::min(first + MORSEL_PAGES, numPages)));
+  }
+
+  std::exception_ptr error;
+  std::mutex errorLatch;
+  std::vector<std::thread> workers;
+  for (std::uint32_t worker = 0; worker < numWorkers; worker++)
+  {
+    workers.push_back(std::thread([this, worker, &queues, &sink, &error, &errorLatch]() {
+      try
+      {
+        work(worker, queues, sink);
+      }
+      catch(...)
+      {
+        std::lock_guard<std::mutex> errorGuard(errorLatch);
+        if (!error)
+          error = std::current_exception();
+      }
+    }));
+  }
+  for (std::thread& worker : workers)
+    worker.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+bool ParallelFileScan::takeMorsel(const std::uint32_t worker, std::vector<MorselQueue>& queues,
+                                  std::pair<PageId, PageId>& morsel)
+{
+  {
+    std::lock_guard<std::mutex> queueGuard(queues[worker].latch);
+    if (!queues[worker].morsels.empty())
+    {
+      morsel = queues[worker].morsels.front();
+      queues[worker].morsels.pop_front();
+      return true;
+    }
+  }
+  // steal the morsel its owner would reach last
+  for (std::size_t i = 1; i < queues.size(); i++)
+  {
+    MorselQueue& victim = queues[(worker + i) % queues.size()];
+    std::lock_guard<std::mutex> queueGuard(victim.latch);
+    if (!victim.morsels.empty())
+    {
+      morsel = victim.morsels.back();
+      victim.morsels.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ParallelFileScan::work(const std::uint32_t worker, std::vector<MorselQueue>& queues, const Sink& sink)
+{
+  std::pair<PageId, PageId> morsel;
+  while (takeMorsel(worker, queues, morsel))
+  {
+    const PageId end = morsel.second;
+    if (morsel.first + 1 < end)
+    {
+      bufMgr->readAhead(file, morsel.first + 1, MORSEL_PAGES, [end](const Page& page) {
+        const PageId next = page.page_number() + 1;
+        return next < end ? next : static_cast<PageId>(Page::INVALID_NUMBER);
+      });
+    }
+
+    for (PageId pageNo = morsel.first; pageNo < end; pageNo++)
+    {
+      Page* page;
+      try
+      {
+        bufMgr->readPage(file, pageNo, page);
+      }
+      catch(const InvalidPageException &e)
+      {
+        // a free page
+        continue;
+      }
+
+      try
+      {
+        for (PageIterator iter = page->begin(); iter != page->end(); ++iter)
+        {
+          const std::string_view record = iter.recordView();
+          if (std::all_of(predicates.begin(), predicates.end(),
+                          [&record](const ScanPredicate& predicate) { return predicate.matches(record); }))
+            sink(worker, iter.getCurrentRecord(), record);
+        }
+      }
+      catch(...)
+      {
+        bufMgr->unPinPage(file, pageNo, false);
+        throw;
+      }
+      bufMgr->unPinPage(file, pageNo, false);
+    }
+  }
+}
+
 }
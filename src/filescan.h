@@ -8,7 +8,14 @@
 
 #pragma once
 
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
@@ -17,14 +24,205 @@
 
 namespace badgerdb {
 
+/**
+ * @brief A condition on one attribute of the records of a relation: the attribute at a byte
+ * offset in the record, compared by an operator with a constant of the attribute's type. A
+ * STRING attribute is compared on as many bytes as the constant has, like strncmp.
+ */
+class ScanPredicate
+{
+ public:
+  ScanPredicate(const int byteOffset, const Operator op, const int value);
+  ScanPredicate(const int byteOffset, const Operator op, const double value);
+  ScanPredicate(const int byteOffset, const Operator op, const std::string& value);
+
+  /**
+   * Returns true if the record meets the condition; a record too short to hold the attribute
+   * does not.
+   *
+   * @param record  Bytes of the record
+   */
+  bool matches(std::string_view record) const;
+
+ private:
+  /**
+   * Offset of the attribute in the record
+   */
+  int byteOffset;
+
+  /**
+   * Type of the attribute and the constant
+   */
+  Datatype type;
+
+  /**
+   * Comparison of the attribute, on the left, with the constant
+   */
+  Operator op;
+
+  /**
+   * Constant of an INTEGER or DOUBLE attribute
+   */
+  int intValue;
+  double doubleValue;
+
+  /**
+   * Constant of a STRING attribute
+   */
+  std::string stringValue;
+
+  friend class FileScan;
+};
+
+/**
+ * @brief Bytes of an attribute a FileScan projects its records on.
+ */
+struct ScanAttribute
+{
+  /**
+   * Offset of the attribute in the record
+   */
+  int byteOffset;
+
+  /**
+   * Length of the attribute
+   */
+  int length;
+};
+
+/**
+ * @brief An attribute a batch scan decodes into a column.
+ */
+struct ScanColumn
+{
+  /**
+   * Offset of the attribute in the record
+   */
+  int byteOffset;
+
+  /**
+   * Type of the attribute
+   */
+  Datatype type;
+
+  /**
+   * Number of bytes kept of a STRING attribute
+   */
+  int length;
+};
+
+/**
+ * @brief The records of one page of a relation, decoded column by column by FileScan::scanNextBatch.
+ * The batch owns its values, so they stay valid after the scan moves on, until the next batch is
+ * decoded into it.
+ */
+class RecordBatch
+{
+ public:
+  /**
+   * @param columns  Attributes to decode, in the order the columns are numbered
+   */
+  explicit RecordBatch(const std::vector<ScanColumn>& columns);
+
+  /**
+   * Number of records in the batch
+   */
+  int size() const { return numRecords; }
+
+  /**
+   * Ids of the records, one per record
+   */
+  const RecordId* recordIds() const { return rids.data(); }
+
+  /**
+   * Values of an INTEGER column, one per record
+   */
+  const int* intColumn(const int column) const { return columns[column].ints.data(); }
+
+  /**
+   * Values of a DOUBLE column, one per record
+   */
+  const double* doubleColumn(const int column) const { return columns[column].doubles.data(); }
+
+  /**
+   * Values of a STRING column, ScanColumn::length bytes per record, padded with zeros
+   */
+  const char* stringColumn(const int column) const { return columns[column].strings.data(); }
+
+  /**
+   * 1 for each record meeting all the predicates of the scan, 0 for the others
+   */
+  const std::uint8_t* selection() const { return selected.data(); }
+
+  /**
+   * Number of records meeting all the predicates of the scan
+   */
+  int numSelected() const;
+
+ private:
+  /**
+   * Values of one column; only the vector of its type is used
+   */
+  struct Column
+  {
+    ScanColumn attribute;
+    std::vector<int> ints;
+    std::vector<double> doubles;
+    std::vector<char> strings;
+  };
+
+  /**
+   * Empties the batch, keeping the memory of its columns.
+   */
+  void clear();
+
+  /**
+   * Decodes a record into the columns and selects it. Bytes missing from a record too short to
+   * hold an attribute read as zeros.
+   *
+   * @param rid     Id of the record
+   * @param record  Bytes of the record
+   */
+  void append(const RecordId& rid, std::string_view record);
+
+  int numRecords;
+  std::vector<RecordId> rids;
+  std::vector<Column> columns;
+  std::vector<std::uint8_t> selected;
+
+  friend class FileScan;
+};
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
+ *
+ * A scan may be given predicates, which scanNext evaluates on the records in the pinned pages,
+ * returning only the records meeting all of them, and a projection, which getProjection applies
+ * to the current record without copying the others.
  */
 class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * Opens a scan over the records of a relation.
+   * @param name     Name of the relation file
+   * @param bufMgr   Buffer manager the pages are read through
+   * @param mapped   Read the file through a MappedPageFile, advised for sequential access
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, const bool mapped = false);
+
+  /**
+   * Opens a scan over the records of a relation meeting all the given predicates.
+   * @param name       Name of the relation file
+   * @param bufMgr     Buffer manager the pages are read through
+   * @param predicates Conditions the records returned must meet
+   * @param projection Attributes getProjection returns, in order; none for the whole record
+   * @param mapped     Read the file through a MappedPageFile, advised for sequential access
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr, const std::vector<ScanPredicate>& predicates,
+           const std::vector<ScanAttribute>& projection = std::vector<ScanAttribute>(),
+           const bool mapped = false);
 
   ~FileScan();
 
@@ -34,6 +232,31 @@ class FileScan
   //read current record, returning pointer and length
   std::string getRecord();
 
+  /**
+   * Returns the current record where it lies in the pinned frame, without copying it. The view
+   * is valid until the next call to scanNext or the end of the scan, which unpin the page, and
+   * is not NUL terminated.
+   */
+  std::string_view getRecordView() const;
+
+  /**
+   * Returns the attributes of the projection of the current record, one after the other, or the
+   * whole record if the scan has no projection. The view is valid until the next call to scanNext.
+   */
+  std::string_view getProjection();
+
+  /**
+   * Decodes all the records of the next page of the relation into the columns of a batch, in one
+   * pass over the pinned page, and selects those meeting the predicates of the scan. Predicates on
+   * an attribute decoded as a column are evaluated over the whole column at once; the others record
+   * by record as the page is decoded. The page is unpinned before returning. A scan is read either
+   * with scanNext or with scanNextBatch, not both.
+   *
+   * @param batch   Batch to decode into; empty for a page with no records
+   * @return  False once past the last page
+   */
+  bool scanNextBatch(RecordBatch& batch);
+
   //marks current page of scan dirty
   void markDirty();
 
@@ -53,13 +276,150 @@ class FileScan
    */
   Page*         curPage;
 
-  FileIterator  filePageIter;
+  /**
+   * Number of the current page, Page::INVALID_NUMBER once the scan is past the last page.
+   * The scan follows the next page numbers of the pages it reads through the buffer pool.
+   */
+  PageId        curPageNo;
+
+  /**
+   * Pages left to scan before the scan asks the buffer manager to stage the pages ahead of it again.
+   */
+  std::uint32_t pagesUntilReadAhead;
+
   PageIterator  pageRecordIter;
 
   /**
    * True if page has been updated
    */
   bool  	      curDirtyFlag;
+
+  /**
+   * Conditions the records returned must meet
+   */
+  std::vector<ScanPredicate> predicates;
+
+  /**
+   * Attributes getProjection returns
+   */
+  std::vector<ScanAttribute> projection;
+
+  /**
+   * Projection of the current record, reused from record to record
+   */
+  std::string projected;
+
+  /**
+   * Moves to the next record of the relation, whether it meets the predicates or not.
+   *
+   * @throws  EndOfFileException when there are no more records
+   */
+  void nextRecord();
+
+  /**
+   * Reads curPageNo into curPage, staging the pages that follow it every READ_AHEAD_PAGES / 2 pages.
+   */
+  void readCurPage();
+};
+
+/**
+ * @brief Scans the records of a relation with several worker threads.
+ *
+ * The pages of the relation are split by page number into morsels of MORSEL_PAGES consecutive
+ * pages. Each worker starts with its own deque of morsels, covering one share of the file, takes
+ * them from the front and, once its deque is empty, steals morsels from the back of the others'.
+ * A worker stages the pages of a morsel ahead of itself, pins each page through the buffer
+ * manager, and hands the records meeting the predicates to a sink shared by all the workers.
+ * Records come in no particular order. Free pages are skipped; pages allocated once the scan has
+ * started may not be seen. Like FileScan, the scan does not latch the pages it reads.
+ */
+class ParallelFileScan
+{
+ public:
+  /**
+   * Called by the workers with each record found; the record is valid during the call only. Calls
+   * from different workers may overlap, calls from one worker do not.
+   *
+   * @param worker  Number of the calling worker, from 0 to numWorkers - 1
+   * @param rid     Id of the record
+   * @param record  Bytes of the record, in the pinned page
+   */
+  typedef std::function<void(std::uint32_t worker, const RecordId& rid, std::string_view record)> Sink;
+
+  /**
+   * Number of consecutive pages a worker takes at once
+   */
+  static const PageId MORSEL_PAGES = 16;
+
+  /**
+   * Opens a parallel scan over the records of a relation meeting all the given predicates.
+   * @param name       Name of the relation file
+   * @param bufMgr     Buffer manager the pages are read through
+   * @param numWorkers Number of worker threads
+   * @param predicates Conditions the records handed to the sink must meet
+   */
+  ParallelFileScan(const std::string &name, BufMgr *bufMgr, const std::uint32_t numWorkers,
+                   const std::vector<ScanPredicate>& predicates = std::vector<ScanPredicate>());
+
+  ~ParallelFileScan();
+
+  /**
+   * Scans the whole relation, returning once every worker is done.
+   *
+   * @param sink  Receives the records meeting the predicates
+   * @throws  The first exception thrown in a worker, by the sink or otherwise, once all are done
+   */
+  void run(const Sink& sink);
+
+ private:
+  /**
+   * Morsels a worker has left, each a range of page numbers [first, second)
+   */
+  struct MorselQueue
+  {
+    std::mutex latch;
+    std::deque<std::pair<PageId, PageId> > morsels;
+  };
+
+  /**
+   * Takes a morsel off the front of the worker's queue, or steals one off the back of another's.
+   *
+   * @param worker  Number of the worker
+   * @param queues  Queues of all the workers
+   * @param morsel  Set to the morsel taken
+   * @return  False once all the queues are empty
+   */
+  static bool takeMorsel(const std::uint32_t worker, std::vector<MorselQueue>& queues,
+                         std::pair<PageId, PageId>& morsel);
+
+  /**
+   * Scans morsels until none is left.
+   *
+   * @param worker  Number of the worker
+   * @param queues  Queues of all the workers
+   * @param sink    Receives the records meeting the predicates
+   */
+  void work(const std::uint32_t worker, std::vector<MorselQueue>& queues, const Sink& sink);
+
+  /**
+   * File which is being scanned, shared by the workers so that they share its frames.
+   */
+  PageFile *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Number of worker threads
+   */
+  std::uint32_t numWorkers;
+
+  /**
+   * Conditions the records handed to the sink must meet
+   */
+  std::vector<ScanPredicate> predicates;
 };
 
 }
@@ -6,6 +6,10 @@
  */
 
 #include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <cstdio>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
@@ -17,8 +21,15 @@
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/file_format_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -76,13 +87,38 @@ BufMgr * bufMgr = new BufMgr(100);
 void createRelationForward();
 void createRelationBackward();
 void createRelationRandom();
-void intTests();
+void intTests(const BuildMode buildMode = BULK_LOAD, const float fillFactor = 1.0, const int runSize = BULKLOADRUNSIZE);
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int intBatchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, int batchSize);
+void doubleTests();
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+void stringTests();
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
 void indexTests();
 void test1();
 void test2();
 void test3();
+void test4();
 void errorTests();
+void pageFileTests();
+void directIOTests();
+void mappedFileTests();
+void asyncReadTests();
+void replacementTests();
+void hashTableTests();
+void writerTests();
+void poolMemoryTests();
+void filteredScanTests();
+void batchScanTests();
+void parallelScanTests();
+void concurrentScanTests();
+void concurrentIndexTests();
+void cursorTests();
+void parallelIndexScanTests();
+void parallelBuildTests();
+void deleteTests();
+void searchNodeTests();
+void stringNodeTests();
 void deleteRelation();
 
 // For Phil's Test
@@ -159,9 +195,29 @@ int main(int argc, char **argv)
 
 	File::remove(relationName);
 
+	searchNodeTests();
+	pageFileTests();
+	directIOTests();
+	mappedFileTests();
+	asyncReadTests();
+	replacementTests();
+	hashTableTests();
+	writerTests();
+	poolMemoryTests();
+	filteredScanTests();
+	batchScanTests();
+	parallelScanTests();
+	concurrentScanTests();
+	concurrentIndexTests();
+	cursorTests();
+	parallelIndexScanTests();
+	parallelBuildTests();
+	deleteTests();
+	stringNodeTests();
 	test1();
 	test2();
 	test3();
+	test4();
 	errorTests();
 	
     // Phil Tests
@@ -211,6 +267,27 @@ void test3()
 	deleteRelation();
 }
 
+void test4()
+{
+	// Create a relation with tuples valued 0 to relationSize in random order and build the index
+	// with one insertEntry per tuple, then bulk loaded with half full nodes, then bulk loaded from
+	// sorted runs of 512 pairs: ten runs, nine spilled to run files and merged with the one left in memory
+	std::cout << "-----------------------------" << std::endl;
+	std::cout << "createRelationRandom - builds" << std::endl;
+	createRelationRandom();
+	intTests(INSERT_BUILD);
+	File::remove(intIndexName);
+	intTests(BULK_LOAD, 0.5);
+	File::remove(intIndexName);
+	intTests(BULK_LOAD, 1.0, 512);
+	bool runsRemoved = !File::exists(intIndexName + ".run0") && !File::exists(intIndexName + ".run8");
+	checkPassFail(runsRemoved, true)
+	File::remove(intIndexName);
+	intTests(PARALLEL_BULK_LOAD);
+	File::remove(intIndexName);
+	deleteRelation();
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -387,16 +464,34 @@ void indexTests()
   catch(const FileNotFoundException &e)
   {
   }
+
+  doubleTests();
+	try
+	{
+		File::remove(doubleIndexName);
+	}
+  catch(const FileNotFoundException &e)
+  {
+  }
+
+  stringTests();
+	try
+	{
+		File::remove(stringIndexName);
+	}
+  catch(const FileNotFoundException &e)
+  {
+  }
 }
 
 // -----------------------------------------------------------------------------
 // intTests
 // -----------------------------------------------------------------------------
 
-void intTests()
+void intTests(const BuildMode buildMode, const float fillFactor, const int runSize)
 {
   std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, buildMode, fillFactor, runSize);
 
 	// run some tests
 	checkPassFail(intScan(&index,25,GT,40,LT), 14)
@@ -406,6 +501,9 @@ void intTests()
 	checkPassFail(intScan(&index,0,GT,1,LT), 0)
 	checkPassFail(intScan(&index,300,GT,400,LT), 99)
 	checkPassFail(intScan(&index,3000,GTE,4000,LT), 1000)
+	checkPassFail(intBatchScan(&index,25,GT,40,LT,4), 14)
+	checkPassFail(intBatchScan(&index,3000,GTE,4000,LT,64), 1000)
+	checkPassFail(intBatchScan(&index,0,GTE,relationSize,LT,1000), relationSize)
 }
 
 int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
@@ -468,6 +566,211 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 	return numResults;
 }
 
+int intBatchScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp, int batchSize)
+{
+	// Returns -1 if a key is out of order or out of range
+	std::vector<RecordId> scanRids(batchSize);
+	Page *curPage;
+
+	try
+	{
+		index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch(const NoSuchKeyFoundException &e)
+	{
+		return 0;
+	}
+
+	int numResults = 0;
+	int lastKey = lowVal;
+	bool inOrder = true;
+	int numRids;
+	while((numRids = index->scanNextBatch(scanRids.data(), batchSize)) > 0)
+	{
+		for (int i = 0; i < numRids; i++)
+		{
+			bufMgr->readPage(file1, scanRids[i].page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRids[i]).data()));
+			bufMgr->unPinPage(file1, scanRids[i].page_number, false);
+
+			if ((numResults > 0 || lowOp == GT) ? myRec.i <= lastKey : myRec.i < lastKey)
+				inOrder = false;
+			if (highOp == LT ? myRec.i >= highVal : myRec.i > highVal)
+				inOrder = false;
+			lastKey = myRec.i;
+			numResults++;
+		}
+	}
+	index->endScan();
+
+	return inOrder ? numResults : -1;
+}
+
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests()
+{
+  std::cout << "Create a B+ Tree index on the double field" << std::endl;
+  BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE);
+
+	// run some tests
+	checkPassFail(doubleScan(&index,25,GT,40,LT), 14)
+	checkPassFail(doubleScan(&index,20,GTE,35,LTE), 16)
+	checkPassFail(doubleScan(&index,-3,GT,3,LT), 3)
+	checkPassFail(doubleScan(&index,996,GT,1001,LT), 4)
+	checkPassFail(doubleScan(&index,0,GT,1,LT), 0)
+	checkPassFail(doubleScan(&index,300,GT,400,LT), 99)
+	checkPassFail(doubleScan(&index,3000,GTE,4000,LT), 1000)
+	checkPassFail(doubleScan(&index,24.5,GT,25.5,LT), 1)
+}
+
+int doubleScan(BTreeIndex * index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
+  RecordId scanRid;
+	Page *curPage;
+
+  std::cout << "Scan for ";
+  if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
+  std::cout << lowVal << "," << highVal;
+  if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
+  std::cout << std::endl;
+
+  int numResults = 0;
+
+	try
+	{
+  	index->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch(const NoSuchKeyFoundException &e)
+	{
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	while(1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(file1, scanRid.page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+			bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+			if( numResults < 5 )
+			{
+				std::cout << "rid:" << scanRid.page_number << "," << scanRid.slot_number;
+				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" <<std::endl;
+			}
+			else if( numResults == 5 )
+			{
+				std::cout << "..." << std::endl;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+			break;
+		}
+
+		numResults++;
+	}
+
+  if( numResults >= 5 )
+  {
+    std::cout << "Number of results: " << numResults << std::endl;
+  }
+  index->endScan();
+  std::cout << std::endl;
+
+	return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests()
+{
+  std::cout << "Create a B+ Tree index on the string field" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+
+	// run some tests
+	checkPassFail(stringScan(&index,25,GT,40,LT), 14)
+	checkPassFail(stringScan(&index,20,GTE,35,LTE), 16)
+	checkPassFail(stringScan(&index,-3,GT,3,LT), 3)
+	checkPassFail(stringScan(&index,996,GT,1001,LT), 4)
+	checkPassFail(stringScan(&index,0,GT,1,LT), 0)
+	checkPassFail(stringScan(&index,300,GT,400,LT), 99)
+	checkPassFail(stringScan(&index,3000,GTE,4000,LT), 1000)
+}
+
+int stringScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+  RecordId scanRid;
+	Page *curPage;
+
+  // the bounds are formatted like the string field of the records
+  char lowValStr[100];
+  sprintf(lowValStr,"%05d string record",lowVal);
+  char highValStr[100];
+  sprintf(highValStr,"%05d string record",highVal);
+
+  std::cout << "Scan for ";
+  if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
+  std::cout << lowValStr << "," << highValStr;
+  if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
+  std::cout << std::endl;
+
+  int numResults = 0;
+
+	try
+	{
+  	index->startScan(lowValStr, lowOp, highValStr, highOp);
+	}
+	catch(const NoSuchKeyFoundException &e)
+	{
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+		return 0;
+	}
+
+	while(1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+			bufMgr->readPage(file1, scanRid.page_number, curPage);
+			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+			bufMgr->unPinPage(file1, scanRid.page_number, false);
+
+			if( numResults < 5 )
+			{
+				std::cout << "rid:" << scanRid.page_number << "," << scanRid.slot_number;
+				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" <<std::endl;
+			}
+			else if( numResults == 5 )
+			{
+				std::cout << "..." << std::endl;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+			break;
+		}
+
+		numResults++;
+	}
+
+  if( numResults >= 5 )
+  {
+    std::cout << "Number of results: " << numResults << std::endl;
+  }
+  index->endScan();
+  std::cout << std::endl;
+
+	return numResults;
+}
+
 // -----------------------------------------------------------------------------
 // errorTests
 // -----------------------------------------------------------------------------
@@ -582,6 +885,18 @@ void errorTests()
 			std::cout << "BadScanrangeException Test 1 Passed." << std::endl;
 		}
 
+		std::cout << "Open the index as a different type" << std::endl;
+		try
+		{
+			std::string doubleName;
+			BTreeIndex doubleIndex(relationName, doubleName, bufMgr, offsetof(tuple,i), DOUBLE);
+			std::cout << "BadIndexInfoException Test 1 Failed." << std::endl;
+		}
+		catch(const BadIndexInfoException &e)
+		{
+			std::cout << "BadIndexInfoException Test 1 Passed." << std::endl;
+		}
+
 		deleteRelation();
 	}
 
@@ -594,30 +909,1835 @@ void errorTests()
   }
 }
 
-void deleteRelation()
+// -----------------------------------------------------------------------------
+// pageFileTests
+// -----------------------------------------------------------------------------
+
+void pageFileTests()
 {
-	if(file1)
+	std::cout << "Page allocation tests" << std::endl;
+	std::cout << "---------------------" << std::endl;
 	{
-		bufMgr->flushFile(file1);
-		delete file1;
-		file1 = NULL;
+		PageFile new_file = PageFile::create(relationName);
+
+		for (int i = 0; i < 20; ++i)
+		{
+			PageId new_page_number;
+			Page new_page = new_file.allocatePage(new_page_number);
+			sprintf(record1.s, "%05d string record", i);
+			record1.i = i;
+			record1.d = (double)i;
+			std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+			new_page.insertRecord(new_data);
+			new_file.writePage(new_page_number, new_page);
+		}
+
+		// unlink the head, a middle page and the tail of the used list
+		new_file.deletePage(1);
+		new_file.deletePage(10);
+		new_file.deletePage(20);
+		checkPassFail(new_file.getFirstPageNo(), 2)
+		checkPassFail(new_file.getLastPageNo(), 19)
+		checkPassFail(new_file.readPage(2).prev_page_number(), Page::INVALID_NUMBER)
+		checkPassFail(new_file.readPage(9).next_page_number(), 11)
+		checkPassFail(new_file.readPage(11).prev_page_number(), 9)
+		checkPassFail(new_file.readPage(19).next_page_number(), Page::INVALID_NUMBER)
+
+		// two of the three freed pages get reused, the last one freed first, and are linked in at the tail
+		for (int i = 20; i < 22; ++i)
+		{
+			PageId new_page_number;
+			Page new_page = new_file.allocatePage(new_page_number);
+			sprintf(record1.s, "%05d string record", i);
+			record1.i = i;
+			record1.d = (double)i;
+			std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+			new_page.insertRecord(new_data);
+			new_file.writePage(new_page_number, new_page);
+		}
+		checkPassFail(new_file.getNumPages(), 21)
+		checkPassFail(new_file.getLastPageNo(), 10)
+		checkPassFail(new_file.readPage(19).next_page_number(), 20)
+		checkPassFail(new_file.readPage(20).prev_page_number(), 19)
+		checkPassFail(new_file.readPage(20).next_page_number(), 10)
+		checkPassFail(new_file.readPage(10).prev_page_number(), 20)
+		checkPassFail(new_file.readPage(10).next_page_number(), Page::INVALID_NUMBER)
 	}
-	try
+
+	int numRecords = 0;
+	int numViewsMatching = 0;
 	{
-		File::remove(relationName);
+		FileScan fscan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				numRecords++;
+				if (fscan.getRecordView() == fscan.getRecord())
+					numViewsMatching++;
+			}
+		}
+		catch(const EndOfFileException &e)
+		{
+		}
 	}
-	catch(const FileNotFoundException &e)
+	checkPassFail(numRecords, 19)
+	checkPassFail(numViewsMatching, 19)
+
+	// a record view points into the page, and follows the records moved by a delete
 	{
+		Page page;
+		const RecordId firstRid = page.insertRecord("first record");
+		const RecordId secondRid = page.insertRecord("second record");
+		std::string_view view = page.getRecordView(secondRid);
+		const bool onPage = view.data() > (const char*)&page && view.data() < (const char*)(&page + 1);
+		checkPassFail(onPage, true)
+		page.deleteRecord(firstRid);
+		const bool moved = page.getRecordView(secondRid) == "second record";
+		checkPassFail(moved, true)
 	}
-}
 
+	File::remove(relationName);
 
-// Andrey tests
-// =============================================================================
+	// a deleted blob page is handed out again before the file grows
+	{
+		BlobFile new_file = BlobFile::create(relationName);
+		PageId new_page_number;
+		for (int i = 0; i < 4; ++i)
+		{
+			new_file.allocatePage(new_page_number);
+		}
+		new_file.deletePage(2);
+		new_file.allocatePage(new_page_number);
+		checkPassFail(new_page_number, 2)
+		new_file.allocatePage(new_page_number);
+		checkPassFail(new_page_number, 5)
+
+		// neither the header page nor a page already free can be deleted
+		int numThrown = 0;
+		new_file.deletePage(3);
+		const PageId badPages[] = {0, 3, 6};
+		for (PageId badPage : badPages)
+		{
+			try
+			{
+				new_file.deletePage(badPage);
+			}
+			catch(const InvalidPageException &e)
+			{
+				numThrown++;
+			}
+		}
+		checkPassFail(numThrown, 3)
+		new_file.allocatePage(new_page_number);
+		checkPassFail(new_page_number, 3)
+		new_file.allocatePage(new_page_number);
+		checkPassFail(new_page_number, 6)
+	}
 
-// TEST 1
-// Note: record debug print broken, but that's fine
-// Support funcs for testing alternate attr byte offset
+	File::remove(relationName);
+
+	// sync reports a file it can no longer reach instead of passing over it
+	{
+		BlobFile new_file = BlobFile::create(relationName);
+		PageId new_page_number;
+		new_file.allocatePage(new_page_number);
+		new_file.sync();
+		std::remove(relationName.c_str());
+		bool thrown = false;
+		try
+		{
+			new_file.sync();
+		}
+		catch(const FileIOException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+	}
+
+	// a file without the header of this version is refused rather than read as pages
+	{
+		const PageId oldHeader[] = {1, 0, 0, 0, 0};
+		std::ofstream oldFile(relationName, std::ios::binary);
+		oldFile.write(reinterpret_cast<const char*>(oldHeader), sizeof(oldHeader));
+	}
+	const FileIO ios[] = {BUFFERED_IO, DIRECT_IO};
+	for (FileIO io : ios)
+	{
+		int numRefused = 0;
+		try
+		{
+			PageFile::open(relationName, io);
+		}
+		catch(const FileFormatException &e)
+		{
+			numRefused++;
+		}
+		checkPassFail(numRefused, 1)
+		checkPassFail(File::isOpen(relationName), false)
+	}
+	File::remove(relationName);
+}
+
+void directIOTests()
+{
+	// Pages written with DIRECT_IO, whole or through the buffer pool, read back the same through a
+	// stream; the file header and the page headers relinked on their own keep their neighbours
+	std::cout << "Direct I/O tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	{
+		PageFile new_file = PageFile::create(relationName, DIRECT_IO);
+		PageFile same_file = PageFile::open(relationName);
+		const bool shared = new_file.io() == DIRECT_IO && same_file.io() == DIRECT_IO;
+		checkPassFail(shared, true)
+
+		for (int i = 0; i < 21; ++i)
+		{
+			PageId new_page_number;
+			Page new_page = new_file.allocatePage(new_page_number);
+			sprintf(record1.s, "%05d string record", i);
+			record1.i = i;
+			record1.d = (double)i;
+			std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+			new_page.insertRecord(new_data);
+			new_file.writePage(new_page_number, new_page);
+			if (i == 19)
+			{
+				// the page holding 9 is reused for 20
+				new_file.deletePage(10);
+			}
+		}
+
+		BufMgr directMgr(10);
+		Page* page;
+		directMgr.readPage(&same_file, 5, page);
+		RecordId firstRid = page->begin().getCurrentRecord();
+		std::string record = page->getRecord(firstRid);
+		((RECORD*)&record[0])->i = -4;
+		page->updateRecord(firstRid, record);
+		directMgr.unPinPage(&same_file, 5, true);
+		directMgr.flushFile(&same_file);
+	}
+
+	int numRecords = 0;
+	int keySum = 0;
+	{
+		FileScan fscan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				numRecords++;
+				keySum += ((const RECORD*)fscan.getRecord().c_str())->i;
+			}
+		}
+		catch(const EndOfFileException &e)
+		{
+		}
+	}
+	checkPassFail(numRecords, 20)
+	checkPassFail(keySum, 190 - 9 + 20 - 4 - 4)
+
+	// the header page and 20 pages, each at a multiple of the page size
+	std::ifstream written(relationName, std::ios::binary | std::ios::ate);
+	const std::size_t fileSize = written.tellg();
+	checkPassFail(fileSize, 21 * Page::SIZE)
+	written.close();
+
+	File::remove(relationName);
+}
+
+// -----------------------------------------------------------------------------
+// mappedFileTests
+// -----------------------------------------------------------------------------
+
+void mappedFileTests()
+{
+	// Pages read through a mapping match those written through the stream, also once the file grows
+	std::cout << "Mapped file tests" << std::endl;
+	std::cout << "-----------------" << std::endl;
+	createRelationForward();
+
+	int numRecords = 0;
+	{
+		FileScan fscan(relationName, bufMgr, true);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				std::string recordStr = fscan.getRecord();
+				if (*((int *)(recordStr.c_str() + offsetof (RECORD, i))) == numRecords)
+					numRecords++;
+			}
+		}
+		catch(const EndOfFileException &e)
+		{
+		}
+	}
+	checkPassFail(numRecords, relationSize)
+
+	{
+		MappedPageFile mappedFile = MappedPageFile::open(relationName);
+		PageId new_page_number;
+		Page new_page = file1->allocatePage(new_page_number);
+		sprintf(record1.s, "%05d string record", relationSize);
+		record1.i = relationSize;
+		record1.d = (double)relationSize;
+		std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+		RecordId new_rid = new_page.insertRecord(new_data);
+		file1->writePage(new_page_number, new_page);
+
+		Page mapped_page = mappedFile.readPage(new_page_number);
+		RECORD myRec = *(reinterpret_cast<const RECORD*>(mapped_page.getRecord(new_rid).data()));
+		checkPassFail(myRec.i, relationSize)
+
+		// so does a page rewritten within the mapping, which is not remapped
+		record1.i = -relationSize;
+		new_page.updateRecord(new_rid, std::string(reinterpret_cast<char*>(&record1), sizeof(record1)));
+		file1->writePage(new_page_number, new_page);
+		mapped_page = mappedFile.readPage(new_page_number);
+		myRec = *(reinterpret_cast<const RECORD*>(mapped_page.getRecord(new_rid).data()));
+		checkPassFail(myRec.i, -relationSize)
+
+		// and the file header, a write small enough to sit in the stream buffer
+		const PageId numPages = mappedFile.getNumPages();
+		file1->allocatePage(new_page_number);
+		checkPassFail(mappedFile.getNumPages(), numPages + 1)
+	}
+
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// asyncReadTests
+// -----------------------------------------------------------------------------
+
+void asyncReadTests()
+{
+	// Pages read in batches of asynchronous reads hold the records written to them, in order
+	std::cout << "Asynchronous read tests" << std::endl;
+	std::cout << "-----------------------" << std::endl;
+	createRelationForward();
+
+	std::vector<PageId> pageNos;
+	for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+	{
+		pageNos.push_back((*iter).page_number());
+	}
+
+	const std::size_t batchSize = 8;
+	int numRecords = 0;
+	for (std::size_t first = 0; first < pageNos.size(); first += batchSize)
+	{
+		const std::size_t last = std::min(first + batchSize, pageNos.size());
+		std::vector<std::future<Page*>> reads;
+		for (std::size_t i = first; i < last; i++)
+		{
+			reads.push_back(bufMgr->readPageAsync(file1, pageNos[i]));
+		}
+		for (std::size_t i = first; i < last; i++)
+		{
+			Page* page = reads[i - first].get();
+			for (PageIterator iter = page->begin(); iter != page->end(); ++iter)
+			{
+				if (*((int *)((*iter).c_str() + offsetof (RECORD, i))) == numRecords)
+					numRecords++;
+			}
+			bufMgr->unPinPage(file1, pageNos[i], false);
+		}
+	}
+	checkPassFail(numRecords, relationSize)
+
+	// a page already in the buffer pool is pinned at once
+	std::future<Page*> resident = bufMgr->readPageAsync(file1, pageNos.back());
+	checkPassFail((int)(resident.wait_for(std::chrono::seconds(0)) == std::future_status::ready), 1)
+	resident.get();
+	bufMgr->unPinPage(file1, pageNos.back(), false);
+
+	// pages staged by read-ahead are found in the buffer pool
+	bufMgr->flushFile(file1);
+	bufMgr->clearBufStats();
+	Page* page;
+	bufMgr->readPage(file1, pageNos[0], page);
+	bufMgr->readAhead(file1, pageNos[0], 4, [](const Page& page) { return page.next_page_number(); });
+	bufMgr->unPinPage(file1, pageNos[0], false);
+	bufMgr->waitForReadAhead(file1, Page::INVALID_NUMBER);
+	checkPassFail(bufMgr->getBufStats().diskreads, 5)
+	for (int i = 1; i <= 4; i++)
+	{
+		bufMgr->readPage(file1, pageNos[i], page);
+		bufMgr->unPinPage(file1, pageNos[i], false);
+	}
+	checkPassFail(bufMgr->getBufStats().diskreads, 5)
+
+	// a buffer manager asked for no I/O threads still gets one, so reads it queues are run
+	{
+		BufMgr noThreadMgr(50, 0);
+		std::future<Page*> read = noThreadMgr.readPageAsync(file1, pageNos[0]);
+		checkPassFail((int)(read.wait_for(std::chrono::seconds(10)) == std::future_status::ready), 1)
+		read.get();
+		noThreadMgr.unPinPage(file1, pageNos[0], false);
+
+		int numScanned = 0;
+		{
+			FileScan fscan(relationName, &noThreadMgr);
+			try
+			{
+				RecordId scanRid;
+				while (true)
+				{
+					fscan.scanNext(scanRid);
+					numScanned++;
+				}
+			}
+			catch(const EndOfFileException &e)
+			{
+			}
+		}
+		checkPassFail(numScanned, relationSize)
+		noThreadMgr.flushFile(file1);
+	}
+
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// replacementTests
+// -----------------------------------------------------------------------------
+
+int scanWithHotPage(BufMgr* scanMgr, const std::vector<PageId>& pageNos, const int hotEvery)
+{
+	// Read every page but the first once, and the first, hot, page every hotEvery pages; the
+	// number of pages read from disk is returned
+	Page* page;
+	scanMgr->clearBufStats();
+	for (std::size_t i = 1; i < pageNos.size(); i++)
+	{
+		if (hotEvery > 0 && i % hotEvery == 0)
+		{
+			scanMgr->readPage(file1, pageNos[0], page);
+			scanMgr->unPinPage(file1, pageNos[0], false);
+		}
+		scanMgr->readPage(file1, pageNos[i], page);
+		scanMgr->unPinPage(file1, pageNos[i], false);
+	}
+	scanMgr->readPage(file1, pageNos[0], page);
+	scanMgr->unPinPage(file1, pageNos[0], false);
+	return scanMgr->getBufStats().diskreads;
+}
+
+void replacementTests()
+{
+	// A page read often during one scan stays in the buffer pool through a second scan
+	// under the scan resistant policies, and is evicted by it under the clock
+	std::cout << "Replacement policy tests" << std::endl;
+	std::cout << "------------------------" << std::endl;
+	createRelationForward();
+
+	std::vector<PageId> pageNos;
+	for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+	{
+		pageNos.push_back((*iter).page_number());
+	}
+	const int numFrames = 20;
+	const int scanReads = pageNos.size() - 1;
+
+	const Replacement replacements[] = {CLOCK_REPLACEMENT, TWO_Q_REPLACEMENT, LRU_K_REPLACEMENT, ARC_REPLACEMENT};
+	for (const Replacement replacement : replacements)
+	{
+		BufMgr scanMgr(numFrames, 1, replacement);
+		scanWithHotPage(&scanMgr, pageNos, 5);
+		const int hotMisses = scanWithHotPage(&scanMgr, pageNos, 0) - scanReads;
+		const int expectedMisses = replacement == CLOCK_REPLACEMENT ? 1 : 0;
+		checkPassFail(hotMisses, expectedMisses)
+		scanMgr.flushFile(file1);
+	}
+
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// hashTableTests
+// -----------------------------------------------------------------------------
+
+void hashTableTests()
+{
+	// Entries survive the growth of their partitions and the removal of their neighbours
+	std::cout << "Hash table tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	createRelationForward();
+
+	const int numPages = 3000;
+	BufHashTbl table(10);
+	for (int i = 0; i < numPages; i++)
+	{
+		table.insert(file1, i, i);
+	}
+	for (int i = 1; i < numPages; i += 2)
+	{
+		table.remove(file1, i);
+	}
+
+	int numFound = 0;
+	int numCorrect = 0;
+	FrameId frameNo;
+	for (int i = 0; i < numPages; i++)
+	{
+		if (table.lookup(file1, i, frameNo))
+		{
+			numFound++;
+			if (i % 2 == 0 && frameNo == (FrameId)i)
+				numCorrect++;
+		}
+	}
+	checkPassFail(numFound, numPages / 2)
+	checkPassFail(numCorrect, numPages / 2)
+
+	int numDuplicates = 0;
+	try
+	{
+		table.insert(file1, 0, 1);
+	}
+	catch(const HashAlreadyPresentException &e)
+	{
+		numDuplicates++;
+	}
+	checkPassFail(numDuplicates, 1)
+
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// writerTests
+// -----------------------------------------------------------------------------
+
+void changeFirstRecord(BufMgr* writeMgr, const PageId pageNo, const int value, const bool unpin)
+{
+	// Overwrite the key of the first record of a page through the buffer pool; the page is
+	// left pinned unless unpin is set
+	Page* page;
+	writeMgr->readPage(file1, pageNo, page);
+	RecordId firstRid = page->begin().getCurrentRecord();
+	std::string record = page->getRecord(firstRid);
+	((RECORD*)&record[0])->i = value;
+	page->updateRecord(firstRid, record);
+	if (unpin)
+		writeMgr->unPinPage(file1, pageNo, true);
+}
+
+int firstRecordOnDisk(const PageId pageNo)
+{
+	Page page = file1->readPage(pageNo);
+	std::string record = page.getRecord(page.begin().getCurrentRecord());
+	return ((const RECORD*)record.c_str())->i;
+}
+
+void writerTests()
+{
+	// The background writer cleans unpinned dirty pages on its own, and a checkpoint writes
+	// dirty pages out while they are pinned, where flushFile gives up
+	std::cout << "Background writer tests" << std::endl;
+	std::cout << "-----------------------" << std::endl;
+	createRelationForward();
+
+	std::vector<PageId> pageNos;
+	for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+	{
+		pageNos.push_back((*iter).page_number());
+	}
+
+	{
+		BufMgr writeMgr(20, 1, CLOCK_REPLACEMENT, 1);
+		for (int i = 0; i < 10; i++)
+		{
+			changeFirstRecord(&writeMgr, pageNos[i], -1 - i, true);
+		}
+		for (int wait = 0; wait < 2000 && writeMgr.getBufStats().diskwrites < 10; wait++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		checkPassFail(writeMgr.getBufStats().diskwrites, 10)
+		file1->sync();
+		checkPassFail(firstRecordOnDisk(pageNos[9]), -10)
+		writeMgr.flushFile(file1);
+	}
+
+	{
+		BufMgr writeMgr(20);
+		changeFirstRecord(&writeMgr, pageNos[0], -100, true);
+		changeFirstRecord(&writeMgr, pageNos[1], -101, false);
+		Page* page;
+		writeMgr.readPage(file1, pageNos[0], page);
+
+		int numPinned = 0;
+		try
+		{
+			writeMgr.flushFile(file1);
+		}
+		catch(const PagePinnedException &e)
+		{
+			numPinned++;
+		}
+		checkPassFail(numPinned, 1)
+
+		// page 0 was unpinned dirty and is written; the change to page 1 is still in progress
+		writeMgr.checkpointFile(file1);
+		checkPassFail(firstRecordOnDisk(pageNos[0]), -100)
+		checkPassFail(writeMgr.getBufStats().diskwrites, 1)
+
+		writeMgr.unPinPage(file1, pageNos[0], false);
+		writeMgr.unPinPage(file1, pageNos[1], true);
+		writeMgr.checkpointFile(file1);
+		checkPassFail(firstRecordOnDisk(pageNos[1]), -101)
+		writeMgr.flushFile(file1);
+	}
+
+	// a page deleted from the file behind the buffer manager's back cannot be written out; the
+	// background writer survives trying
+	{
+		BufMgr writeMgr(20, 1, CLOCK_REPLACEMENT, 1);
+		changeFirstRecord(&writeMgr, pageNos[2], -102, false);
+		file1->deletePage(pageNos[2]);
+		writeMgr.unPinPage(file1, pageNos[2], true);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		int numInvalid = 0;
+		try
+		{
+			writeMgr.disposePage(file1, pageNos[2]);
+		}
+		catch(const InvalidPageException &e)
+		{
+			numInvalid++;
+		}
+		checkPassFail(numInvalid, 1)
+	}
+
+	// a failed checkpoint leaves the page dirty and unpinned
+	{
+		BufMgr writeMgr(20);
+		changeFirstRecord(&writeMgr, pageNos[3], -103, false);
+		file1->deletePage(pageNos[3]);
+		writeMgr.unPinPage(file1, pageNos[3], true);
+
+		int numInvalid = 0;
+		for (int i = 0; i < 2; i++)
+		{
+			try
+			{
+				writeMgr.checkpointFile(file1);
+			}
+			catch(const InvalidPageException &e)
+			{
+				numInvalid++;
+			}
+		}
+		checkPassFail(numInvalid, 2)
+		checkPassFail(writeMgr.getBufStats().diskwrites, 0)
+
+		int numNotPinned = 0;
+		try
+		{
+			writeMgr.unPinPage(file1, pageNos[3], false);
+		}
+		catch(const PageNotPinnedException &e)
+		{
+			numNotPinned++;
+		}
+		checkPassFail(numNotPinned, 1)
+
+		try
+		{
+			writeMgr.disposePage(file1, pageNos[3]);
+		}
+		catch(const InvalidPageException &e)
+		{
+			numInvalid++;
+		}
+		checkPassFail(numInvalid, 3)
+	}
+
+	// nor can it be written out to evict it: the page stays dirty in the buffer pool, and a flush
+	// reports the failure instead of waiting for the eviction to end
+	{
+		BufMgr writeMgr(3, 1, CLOCK_REPLACEMENT, 0);
+		changeFirstRecord(&writeMgr, pageNos[4], -104, false);
+		file1->deletePage(pageNos[4]);
+		writeMgr.unPinPage(file1, pageNos[4], true);
+
+		int numInvalid = 0;
+		for (int i = 5; i < 20 && numInvalid == 0; i++)
+		{
+			try
+			{
+				Page* page;
+				writeMgr.readPage(file1, pageNos[i], page);
+				writeMgr.unPinPage(file1, pageNos[i], false);
+			}
+			catch(const InvalidPageException &e)
+			{
+				numInvalid++;
+			}
+		}
+		checkPassFail(numInvalid, 1)
+
+		try
+		{
+			writeMgr.flushFile(file1);
+		}
+		catch(const InvalidPageException &e)
+		{
+			numInvalid++;
+		}
+		checkPassFail(numInvalid, 2)
+
+		try
+		{
+			writeMgr.disposePage(file1, pageNos[4]);
+		}
+		catch(const InvalidPageException &e)
+		{
+			numInvalid++;
+		}
+		checkPassFail(numInvalid, 3)
+		writeMgr.flushFile(file1);
+	}
+
+	deleteRelation();
+}
+
+void poolMemoryTests()
+{
+	// Every kind of pool memory gives frames on page boundaries that hold pages like any other
+	std::cout << "Pool memory tests" << std::endl;
+	std::cout << "-----------------" << std::endl;
+	createRelationForward();
+
+	const PoolMemory memories[] = {
+		PoolMemory(SMALL_POOL_PAGES),
+		PoolMemory(TRANSPARENT_HUGE_POOL_PAGES, INTERLEAVE_PLACEMENT),
+		PoolMemory(HUGETLB_POOL_PAGES, BIND_PLACEMENT, 0),
+		PoolMemory(TRANSPARENT_HUGE_POOL_PAGES, BIND_PLACEMENT, 63)
+	};
+	for (const PoolMemory& memory : memories)
+	{
+		BufMgr poolMgr(300, 1, CLOCK_REPLACEMENT, 0, memory);
+		const int hugeOffset = (std::uintptr_t)poolMgr.bufPool % (2 * 1024 * 1024);
+		checkPassFail(hugeOffset, 0)
+		const int frameOffset = (std::uintptr_t)&poolMgr.bufPool[299] % 4096;
+		checkPassFail(frameOffset, 0)
+		const bool pagesKept = poolMgr.getPoolPages() == memory.pages ||
+			(memory.pages == HUGETLB_POOL_PAGES && poolMgr.getPoolPages() == TRANSPARENT_HUGE_POOL_PAGES);
+		checkPassFail(pagesKept, true)
+
+		int numRecords = 0;
+		for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+		{
+			Page* page;
+			poolMgr.readPage(file1, (*iter).page_number(), page);
+			for (PageIterator pageIter = page->begin(); pageIter != page->end(); ++pageIter)
+			{
+				numRecords++;
+			}
+			poolMgr.unPinPage(file1, (*iter).page_number(), false);
+		}
+		checkPassFail(numRecords, relationSize)
+		poolMgr.flushFile(file1);
+	}
+
+	deleteRelation();
+}
+
+int countFilteredScan(const std::vector<ScanPredicate>& predicates, int& keySum)
+{
+	// Number of records a scan with the predicates returns; keySum adds up their projected keys
+	int numRecords = 0;
+	keySum = 0;
+	std::vector<ScanAttribute> projection = {{offsetof(RECORD, i), sizeof(int)}};
+	FileScan fscan(relationName, bufMgr, predicates, projection);
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			fscan.scanNext(scanRid);
+			std::string_view key = fscan.getProjection();
+			if (key.size() == sizeof(int))
+				keySum += *(const int*)key.data();
+			numRecords++;
+		}
+	}
+	catch(const EndOfFileException &e)
+	{
+	}
+	return numRecords;
+}
+
+void filteredScanTests()
+{
+	// Predicates on each type of attribute select the records of a range, and the projection
+	// hands back their keys alone
+	std::cout << "Filtered scan tests" << std::endl;
+	std::cout << "-------------------" << std::endl;
+	createRelationForward();
+
+	int keySum;
+	checkPassFail(countFilteredScan({ScanPredicate(offsetof(RECORD, i), GTE, 25),
+		ScanPredicate(offsetof(RECORD, i), LT, 40)}, keySum), 15)
+	checkPassFail(keySum, (25 + 39) * 15 / 2)
+	checkPassFail(countFilteredScan({ScanPredicate(offsetof(RECORD, d), GT, 4990.5)}, keySum), 9)
+	checkPassFail(keySum, (4991 + 4999) * 9 / 2)
+	checkPassFail(countFilteredScan({ScanPredicate(offsetof(RECORD, s), LTE, std::string("00002"))}, keySum), 3)
+	checkPassFail(countFilteredScan({ScanPredicate(offsetof(RECORD, i), GT, relationSize)}, keySum), 0)
+	checkPassFail(countFilteredScan({}, keySum), relationSize)
+
+	deleteRelation();
+}
+
+int sumBatchScan(const std::vector<ScanColumn>& columns, const std::vector<ScanPredicate>& predicates,
+                 int& numSelected, int& numWrong)
+{
+	// Sum of the i column over the records a batch scan selects; numWrong counts decoded records
+	// whose columns disagree with each other
+	int keySum = 0;
+	numSelected = 0;
+	numWrong = 0;
+	FileScan fscan(relationName, bufMgr, predicates);
+	RecordBatch batch(columns);
+	while (fscan.scanNextBatch(batch))
+	{
+		const int* keys = batch.intColumn(0);
+		for (int row = 0; row < batch.size(); row++)
+		{
+			keySum += batch.selection()[row] ? keys[row] : 0;
+			if (batch.doubleColumn(1)[row] != keys[row])
+				numWrong++;
+		}
+		numSelected += batch.numSelected();
+		if (columns.size() > 2)
+		{
+			for (int row = 0; row < batch.size(); row++)
+			{
+				char expected[8];
+				sprintf(expected, "%05d", keys[row]);
+				if (strncmp(batch.stringColumn(2) + row * 5, expected, 5) != 0)
+					numWrong++;
+			}
+		}
+	}
+	return keySum;
+}
+
+void batchScanTests()
+{
+	// Records are decoded into columns page by page; predicates on decoded columns and on other
+	// attributes select the same records a filtered scan returns
+	std::cout << "Batch scan tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	createRelationForward();
+
+	const std::vector<ScanColumn> numbers = {{offsetof(RECORD, i), INTEGER, 0}, {offsetof(RECORD, d), DOUBLE, 0}};
+	const std::vector<ScanColumn> all = {{offsetof(RECORD, i), INTEGER, 0}, {offsetof(RECORD, d), DOUBLE, 0},
+		{offsetof(RECORD, s), STRING, 5}};
+	int numSelected, numWrong;
+
+	checkPassFail(sumBatchScan(all, {}, numSelected, numWrong), (relationSize - 1) * relationSize / 2)
+	checkPassFail(numSelected, relationSize)
+	checkPassFail(numWrong, 0)
+
+	checkPassFail(sumBatchScan(numbers, {ScanPredicate(offsetof(RECORD, i), GTE, 100),
+		ScanPredicate(offsetof(RECORD, i), LT, 300), ScanPredicate(offsetof(RECORD, s), LTE, std::string("00250"))},
+		numSelected, numWrong), (100 + 250) * 151 / 2)
+	checkPassFail(numSelected, 151)
+
+	// the other two comparisons on an INTEGER column, which CPUs with AVX2 make 8 values at a time
+	checkPassFail(sumBatchScan(numbers, {ScanPredicate(offsetof(RECORD, i), GT, 1234),
+		ScanPredicate(offsetof(RECORD, i), LTE, 2345)}, numSelected, numWrong), (1235 + 2345) * 1111 / 2)
+	checkPassFail(numSelected, 1111)
+	checkPassFail(numWrong, 0)
+	checkPassFail(sumBatchScan(numbers, {ScanPredicate(offsetof(RECORD, i), GTE, -1),
+		ScanPredicate(offsetof(RECORD, i), LT, 1)}, numSelected, numWrong), 0)
+	checkPassFail(numSelected, 1)
+
+	checkPassFail(sumBatchScan(all, {ScanPredicate(offsetof(RECORD, d), GT, 4990.5),
+		ScanPredicate(offsetof(RECORD, s), GTE, std::string("04995"))}, numSelected, numWrong), (4995 + 4999) * 5 / 2)
+	checkPassFail(numSelected, 5)
+
+	deleteRelation();
+}
+
+int countParallelScan(const std::vector<ScanPredicate>& predicates, int& keySum)
+{
+	// Number of records a parallel scan with the predicates hands to its sink; keySum adds up their keys
+	const std::uint32_t numWorkers = 4;
+	std::vector<int> workerCounts(numWorkers, 0);
+	std::atomic<int> atomicKeySum(0);
+	{
+		ParallelFileScan pscan(relationName, bufMgr, numWorkers, predicates);
+		pscan.run([&workerCounts, &atomicKeySum](std::uint32_t worker, const RecordId& rid, std::string_view record) {
+			workerCounts[worker]++;
+			atomicKeySum += ((const RECORD*)record.data())->i;
+		});
+	}
+	keySum = atomicKeySum;
+	int numRecords = 0;
+	for (int count : workerCounts)
+		numRecords += count;
+	return numRecords;
+}
+
+void parallelScanTests()
+{
+	// A parallel scan hands its sink the records a serial scan returns, skipping free pages, and
+	// passes on an exception thrown by the sink
+	std::cout << "Parallel scan tests" << std::endl;
+	std::cout << "-------------------" << std::endl;
+	createRelationForward();
+	file1->deletePage(3);
+
+	int serialKeySum, parallelKeySum;
+	const int numRecords = countFilteredScan({}, serialKeySum);
+	checkPassFail(countParallelScan({}, parallelKeySum), numRecords)
+	checkPassFail(parallelKeySum, serialKeySum)
+
+	const std::vector<ScanPredicate> predicates = {ScanPredicate(offsetof(RECORD, i), LT, 1000)};
+	const int numSelected = countFilteredScan(predicates, serialKeySum);
+	checkPassFail(countParallelScan(predicates, parallelKeySum), numSelected)
+	checkPassFail(parallelKeySum, serialKeySum)
+
+	int numThrown = 0;
+	{
+		ParallelFileScan pscan(relationName, bufMgr, 4);
+		try
+		{
+			pscan.run([](std::uint32_t worker, const RecordId& rid, std::string_view record) {
+				if (((const RECORD*)record.data())->i == 2500)
+					throw EndOfFileException();
+			});
+		}
+		catch(const EndOfFileException &e)
+		{
+			numThrown++;
+		}
+	}
+	checkPassFail(numThrown, 1)
+
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// searchNodeTests
+// -----------------------------------------------------------------------------
+
+void searchNodeTests()
+{
+	// Compare the node search with std::lower_bound/upper_bound on sorted keys with many duplicates,
+	// for every length up to a full leaf
+	std::cout << "Node search tests" << std::endl;
+	std::cout << "-----------------" << std::endl;
+	std::vector<int> keys(INTARRAYLEAFSIZE);
+	int numWrong = 0;
+	srand(1);
+	for (int length = 0; length <= INTARRAYLEAFSIZE; length += (length < 40 ? 1 : 37))
+	{
+		for (int i = 0; i < length; i++)
+			keys[i] = rand() % (length + 1) - length / 2;
+		std::sort(keys.begin(), keys.begin() + length);
+		for (int key = -length / 2 - 1; key <= length / 2 + 1; key++)
+		{
+			int lower = std::lower_bound(keys.begin(), keys.begin() + length, key) - keys.begin();
+			int upper = std::upper_bound(keys.begin(), keys.begin() + length, key) - keys.begin();
+			if (searchNode(keys.data(), length, key, false) != lower || searchNode(keys.data(), length, key, true) != upper)
+				numWrong++;
+		}
+	}
+	checkPassFail(numWrong, 0)
+
+	// STRING separators must fall in (left, right] and stop one character past the common prefix
+	numWrong = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		char left[STRINGSIZE + 1], right[STRINGSIZE + 1];
+		sprintf(left, "%05d rec", rand() % 200);
+		sprintf(right, "%05d rec", rand() % 200);
+		StringKey leftKey(left), rightKey(right);
+		if (rightKey < leftKey)
+			std::swap(leftKey, rightKey);
+		StringKey sep = separatorKey(leftKey, rightKey);
+		if (!(leftKey < sep || leftKey == rightKey) || rightKey < sep)
+			numWrong++;
+		else if (leftKey < rightKey && sep.data[strnlen(sep.data, STRINGSIZE) - 1] == leftKey.data[strnlen(sep.data, STRINGSIZE) - 1])
+			numWrong++;
+	}
+	checkPassFail(numWrong, 0)
+}
+
+// -----------------------------------------------------------------------------
+// concurrentScanTests
+// -----------------------------------------------------------------------------
+
+void countRecords(int *numRecords)
+{
+	FileScan fscan(relationName, bufMgr);
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			fscan.scanNext(scanRid);
+			(*numRecords)++;
+		}
+	}
+	catch(const EndOfFileException &e)
+	{
+	}
+}
+
+void concurrentScanTests()
+{
+	// Several threads scan the same relation at once through the shared buffer manager
+	std::cout << "Concurrent scan tests" << std::endl;
+	std::cout << "---------------------" << std::endl;
+	createRelationForward();
+
+	const int numThreads = 4;
+	int numRecords[numThreads] = {0};
+	std::vector<std::thread> threads;
+	for (int i = 0; i < numThreads; i++)
+	{
+		threads.push_back(std::thread(countRecords, &numRecords[i]));
+	}
+	for (int i = 0; i < numThreads; i++)
+	{
+		threads[i].join();
+	}
+	for (int i = 0; i < numThreads; i++)
+	{
+		checkPassFail(numRecords[i], relationSize)
+	}
+
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// concurrentIndexTests
+// -----------------------------------------------------------------------------
+
+void insertDuplicates(BTreeIndex *index, int writer, int numWriters)
+{
+	// Entries get page number 0, which no record of the relation has
+	for (int key = writer; key < relationSize; key += numWriters)
+	{
+		RecordId dupRid;
+		dupRid.page_number = 0;
+		dupRid.slot_number = writer;
+		index->insertEntry(&key, dupRid);
+	}
+}
+
+void deleteDuplicates(BTreeIndex *index, int writer, int numWriters)
+{
+	for (int key = writer; key < relationSize; key += numWriters)
+	{
+		RecordId dupRid;
+		dupRid.page_number = 0;
+		dupRid.slot_number = writer;
+		index->deleteEntry(&key, dupRid);
+	}
+}
+
+void scanWhileInserting(BTreeIndex *index, std::atomic<bool> *writersDone, int *numScans, int *numBadScans)
+{
+	int lowVal = 0;
+	int highVal = relationSize;
+	do
+	{
+		int numRecords = 0;
+		RecordId scanRid;
+		index->startScan(&lowVal, GTE, &highVal, LT);
+		try
+		{
+			while(1)
+			{
+				index->scanNext(scanRid);
+				if (scanRid.page_number != 0)
+					numRecords++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		index->endScan();
+		(*numScans)++;
+		if (numRecords != relationSize)
+			(*numBadScans)++;
+	} while (!writersDone->load());
+}
+
+void concurrentIndexTests()
+{
+	// Several threads insert into a full, bulk loaded index while another thread scans it.
+	// Every scan must return each record of the relation exactly once.
+	std::cout << "Concurrent index tests" << std::endl;
+	std::cout << "----------------------" << std::endl;
+	createRelationForward();
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		const int numWriters = 3;
+		std::atomic<bool> writersDone(false);
+		int numScans = 0;
+		int numBadScans = 0;
+		std::thread scanner(scanWhileInserting, &index, &writersDone, &numScans, &numBadScans);
+		std::vector<std::thread> writers;
+		for (int i = 0; i < numWriters; i++)
+		{
+			writers.push_back(std::thread(insertDuplicates, &index, i, numWriters));
+		}
+		for (int i = 0; i < numWriters; i++)
+		{
+			writers[i].join();
+		}
+		writersDone = true;
+		scanner.join();
+		checkPassFail(numBadScans, 0)
+
+		// the inserted entries are all reachable as well
+		int lowVal = 0;
+		int highVal = relationSize;
+		int numEntries = 0;
+		RecordId scanRid;
+		index.startScan(&lowVal, GTE, &highVal, LT);
+		try
+		{
+			while(1)
+			{
+				index.scanNext(scanRid);
+				numEntries++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+		checkPassFail(numEntries, 2 * relationSize)
+
+		// the same writers take their entries out again, while the scanner keeps going
+		writersDone = false;
+		numBadScans = 0;
+		std::thread deleteScanner(scanWhileInserting, &index, &writersDone, &numScans, &numBadScans);
+		writers.clear();
+		for (int i = 0; i < numWriters; i++)
+		{
+			writers.push_back(std::thread(deleteDuplicates, &index, i, numWriters));
+		}
+		for (int i = 0; i < numWriters; i++)
+		{
+			writers[i].join();
+		}
+		writersDone = true;
+		deleteScanner.join();
+		checkPassFail(numBadScans, 0)
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), relationSize)
+	}
+
+	File::remove(intIndexName);
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// cursorTests
+// -----------------------------------------------------------------------------
+
+int cursorScan(BTreeIndex::Cursor *cursor, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	int numResults = 0;
+	RecordId scanRid;
+	try
+	{
+		cursor->startScan(&lowVal, lowOp, &highVal, highOp);
+	}
+	catch(const NoSuchKeyFoundException &e)
+	{
+		return 0;
+	}
+	try
+	{
+		while(1)
+		{
+			cursor->scanNext(scanRid);
+			numResults++;
+		}
+	}
+	catch(const IndexScanCompletedException &e)
+	{
+	}
+	cursor->endScan();
+	return numResults;
+}
+
+void countWithCursor(BTreeIndex *index, int *numResults)
+{
+	BTreeIndex::Cursor cursor(index);
+	*numResults = cursorScan(&cursor, 0, GTE, relationSize, LT);
+}
+
+void cursorTests()
+{
+	// Several scans open on one index at the same time, each through its own cursor
+	std::cout << "Cursor tests" << std::endl;
+	std::cout << "------------" << std::endl;
+	createRelationForward();
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		// two scans advanced in turn
+		BTreeIndex::Cursor fromLow(&index);
+		BTreeIndex::Cursor fromMid(&index);
+		int lowVal = 0;
+		int highVal = relationSize;
+		int midVal = relationSize / 2;
+		fromLow.startScan(&lowVal, GTE, &highVal, LT);
+		fromMid.startScan(&midVal, GTE, &highVal, LT);
+		int numFromLow = 0;
+		int numFromMid = 0;
+		RecordId scanRid;
+		try
+		{
+			while(1)
+			{
+				fromLow.scanNext(scanRid);
+				numFromLow++;
+				fromMid.scanNext(scanRid);
+				numFromMid++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		checkPassFail(numFromMid, relationSize - midVal)
+		checkPassFail(numFromLow, relationSize - midVal + 1)
+		fromLow.endScan();
+		fromMid.endScan();
+
+		// index nested loop join of the index with itself: every outer key meets ten inner keys
+		BTreeIndex::Cursor outer(&index);
+		BTreeIndex::Cursor inner(&index);
+		int outerHigh = 100;
+		int numMatches = 0;
+		outer.startScan(&lowVal, GTE, &outerHigh, LT);
+		try
+		{
+			for (int key = lowVal; ; key++)
+			{
+				outer.scanNext(scanRid);
+				numMatches += cursorScan(&inner, key, GTE, key + 10, LT);
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		outer.endScan();
+		checkPassFail(numMatches, 1000)
+
+		// the index's own scan is independent of the cursors
+		BTreeIndex::Cursor other(&index);
+		other.startScan(&lowVal, GTE, &highVal, LT);
+		checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+		int numOther = 0;
+		try
+		{
+			while(1)
+			{
+				other.scanNext(scanRid);
+				numOther++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		other.endScan();
+		checkPassFail(numOther, relationSize)
+
+		// cursors used from several threads at once
+		const int numThreads = 4;
+		int numResults[numThreads] = {0};
+		std::vector<std::thread> threads;
+		for (int i = 0; i < numThreads; i++)
+		{
+			threads.push_back(std::thread(countWithCursor, &index, &numResults[i]));
+		}
+		for (int i = 0; i < numThreads; i++)
+		{
+			threads[i].join();
+		}
+		for (int i = 0; i < numThreads; i++)
+		{
+			checkPassFail(numResults[i], relationSize)
+		}
+	}
+
+	File::remove(intIndexName);
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// parallelIndexScanTests
+// -----------------------------------------------------------------------------
+
+std::vector<RecordId> serialIndexScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	BTreeIndex::Cursor cursor(index);
+	std::vector<RecordId> rids(relationSize);
+	cursor.startScan(&lowVal, lowOp, &highVal, highOp);
+	rids.resize(cursor.scanNextBatch(rids.data(), relationSize));
+	cursor.endScan();
+	return rids;
+}
+
+bool sameAsSerialScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp,
+											int numPartitions, int& numRanges)
+{
+	std::vector<std::vector<RecordId> > partitions = index->parallelScan(&lowVal, lowOp, &highVal, highOp, numPartitions);
+	numRanges = (int)partitions.size();
+	std::vector<RecordId> concatenated;
+	for (const std::vector<RecordId>& rids : partitions)
+	{
+		concatenated.insert(concatenated.end(), rids.begin(), rids.end());
+	}
+	return concatenated == serialIndexScan(index, lowVal, lowOp, highVal, highOp);
+}
+
+void parallelIndexScanTests()
+{
+	// A range cut at the separators of the upper levels and scanned on one thread per sub-range
+	std::cout << "Parallel index scan tests" << std::endl;
+	std::cout << "-------------------------" << std::endl;
+	createRelationForward();
+
+	{
+		// half full leaves, so that the root has a separator every few hundred keys
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, BULK_LOAD, 0.5);
+
+		int numRanges = 0;
+		bool same = sameAsSerialScan(&index, 1000, GTE, 4000, LT, 4, numRanges);
+		checkPassFail(same, true)
+		checkPassFail(numRanges, 4)
+		same = sameAsSerialScan(&index, 0, GT, relationSize, LTE, 64, numRanges);
+		bool cutAtEverySeparator = numRanges > 4 && numRanges < 64;
+		checkPassFail(same, true)
+		checkPassFail(cutAtEverySeparator, true)
+		same = sameAsSerialScan(&index, 1000, GTE, 4000, LT, 1, numRanges);
+		checkPassFail(same, true)
+		checkPassFail(numRanges, 1)
+
+		// a range inside one leaf has no separator to cut it at
+		same = sameAsSerialScan(&index, 10, GT, 20, LTE, 4, numRanges);
+		checkPassFail(same, true)
+		checkPassFail(numRanges, 1)
+
+		// the bounds of the whole range hold for the first and the last sub-range
+		int lowVal = 999;
+		int highVal = 4000;
+		std::vector<std::vector<RecordId> > partitions = index.parallelScan(&lowVal, GT, &highVal, LTE, 4);
+		int numRids = 0;
+		for (const std::vector<RecordId>& rids : partitions)
+		{
+			numRids += (int)rids.size();
+		}
+		checkPassFail(numRids, 3001)
+
+		int numThrown = 0;
+		try
+		{
+			index.parallelScan(&lowVal, LTE, &highVal, LTE, 4);
+		}
+		catch(const BadOpcodesException &e)
+		{
+			numThrown++;
+		}
+		try
+		{
+			index.parallelScan(&highVal, GTE, &lowVal, LTE, 4);
+		}
+		catch(const BadScanrangeException &e)
+		{
+			numThrown++;
+		}
+		lowVal = relationSize;
+		highVal = relationSize + 1000;
+		try
+		{
+			index.parallelScan(&lowVal, GTE, &highVal, LT, 4);
+		}
+		catch(const NoSuchKeyFoundException &e)
+		{
+			numThrown++;
+		}
+		checkPassFail(numThrown, 3)
+	}
+
+	File::remove(intIndexName);
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// parallelBuildTests
+// -----------------------------------------------------------------------------
+
+void parallelBuildTests()
+{
+	// An index bulk loaded on several threads holds the same entries, in the same order, as one loaded on one
+	std::cout << "Parallel build tests" << std::endl;
+	std::cout << "--------------------" << std::endl;
+	createRelationRandom();
+
+	std::vector<RecordId> serialRids;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, BULK_LOAD);
+		serialRids = serialIndexScan(&index, 0, GTE, relationSize, LT);
+	}
+	File::remove(intIndexName);
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, PARALLEL_BULK_LOAD);
+		std::vector<RecordId> parallelRids = serialIndexScan(&index, 0, GTE, relationSize, LT);
+		checkPassFail((int)parallelRids.size(), relationSize)
+		bool same = parallelRids == serialRids;
+		checkPassFail(same, true)
+
+		// the packed tree takes inserts and deletes like any other
+		int key = relationSize;
+		RecordId extraRid = serialRids[0];
+		index.insertEntry(&key, extraRid);
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LTE), relationSize + 1)
+		index.deleteEntry(&key, extraRid);
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LTE), relationSize)
+	}
+	File::remove(intIndexName);
+
+	// runs of 2048 pairs: every worker holds 512 before it spills, so each spills runs of its own
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, PARALLEL_BULK_LOAD, 1.0, 2048);
+		std::vector<RecordId> parallelRids = serialIndexScan(&index, 0, GTE, relationSize, LT);
+		checkPassFail((int)parallelRids.size(), relationSize)
+		bool same = parallelRids == serialRids;
+		checkPassFail(same, true)
+	}
+	bool runsRemoved = !File::exists(intIndexName + ".w0.run0") && !File::exists(intIndexName + ".w3.run0");
+	checkPassFail(runsRemoved, true)
+	File::remove(intIndexName);
+
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING, PARALLEL_BULK_LOAD, 0.5);
+		checkPassFail(stringScan(&index, 25, GT, 40, LT), 14)
+		checkPassFail(stringScan(&index, 996, GT, 1001, LT), 4)
+	}
+	File::remove(stringIndexName);
+
+	deleteRelation();
+}
+
+void deleteRelation()
+{
+	if(file1)
+	{
+		bufMgr->flushFile(file1);
+		delete file1;
+		file1 = NULL;
+	}
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+}
+
+
+// Andrey tests
+// =============================================================================
+
+// TEST 1
+// Note: record debug print broken, but that's fine
+// Support funcs for testing alternate attr byte offset
+
+// -----------------------------------------------------------------------------
+// deleteTests
+// -----------------------------------------------------------------------------
+
+void deleteTests()
+{
+	// Empty an index through deleteEntry, with a scan open across some of the deletes,
+	// then fill it again through insertEntry
+	std::cout << "Delete tests" << std::endl;
+	std::cout << "------------" << std::endl;
+	createRelationRandom();
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		// <key,rid> of every record, in the random order of the relation
+		std::vector<std::pair<int, RecordId> > entries;
+		{
+			FileScan fscan(relationName, bufMgr);
+			try
+			{
+				RecordId scanRid;
+				while(1)
+				{
+					fscan.scanNext(scanRid);
+					std::string recordStr = fscan.getRecord();
+					int key = *((int *)(recordStr.c_str() + offsetof (RECORD, i)));
+					entries.push_back(std::make_pair(key, scanRid));
+				}
+			}
+			catch(const EndOfFileException &e)
+			{
+			}
+		}
+		std::vector<bool> deleted(relationSize, false);
+
+		// keys behind and ahead of an open scan go away; only those ahead are missed
+		BTreeIndex::Cursor cursor(&index);
+		int lowVal = 0;
+		int highVal = relationSize;
+		int numResults = 0;
+		RecordId scanRid;
+		cursor.startScan(&lowVal, GTE, &highVal, LT);
+		for (; numResults < 1000; numResults++)
+			cursor.scanNext(scanRid);
+		for (int i = 0; i < relationSize; i++)
+		{
+			if (entries[i].first >= 500 && entries[i].first < 1500)
+			{
+				index.deleteEntry(&entries[i].first, entries[i].second);
+				deleted[entries[i].first] = true;
+			}
+		}
+		try
+		{
+			while(1)
+			{
+				cursor.scanNext(scanRid);
+				numResults++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		cursor.endScan();
+		checkPassFail(numResults, relationSize - 500)
+
+		// odd keys next
+		for (int i = 0; i < relationSize; i++)
+		{
+			if (entries[i].first % 2 == 1 && !deleted[entries[i].first])
+			{
+				index.deleteEntry(&entries[i].first, entries[i].second);
+				deleted[entries[i].first] = true;
+			}
+		}
+		checkPassFail(intScan(&index,25,GT,40,LT), 7)
+		checkPassFail(intScan(&index,300,GT,1700,LT), 199)
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), (relationSize - 1000) / 2)
+
+		// an entry can only be deleted once
+		int numThrown = 0;
+		try
+		{
+			index.deleteEntry(&entries[0].first, entries[0].second);
+			index.deleteEntry(&entries[0].first, entries[0].second);
+		}
+		catch(const NoSuchKeyFoundException &e)
+		{
+			numThrown++;
+		}
+		checkPassFail(numThrown, 1)
+		deleted[entries[0].first] = true;
+
+		// the rest, until the tree is back to an empty root leaf
+		for (int i = 0; i < relationSize; i++)
+		{
+			if (!deleted[entries[i].first])
+				index.deleteEntry(&entries[i].first, entries[i].second);
+		}
+		checkPassFail(intScan(&index,0,GTE,relationSize,LT), 0)
+
+		// the pages freed by the deletes are reused
+		for (int i = 0; i < relationSize; i++)
+			index.insertEntry(&entries[i].first, entries[i].second);
+		checkPassFail(intScan(&index,25,GT,40,LT), 14)
+		checkPassFail(intBatchScan(&index,0,GTE,relationSize,LT,1000), relationSize)
+
+		// duplicates of one key spread over several leaves, deleted oldest first: each is found by walking
+		// the leaves from the leftmost one holding the key, and the leaves it empties are merged away, so
+		// that inserting the duplicates again reuses their pages
+		const int numDuplicates = 3 * INTARRAYLEAFSIZE;
+		int dupKey = -1;
+		for (int i = 0; i < numDuplicates; i++)
+		{
+			RecordId dupRid = {0, (SlotId)i, 0};
+			index.insertEntry(&dupKey, dupRid);
+		}
+		const PageId numPages = BlobFile(intIndexName, false).getNumPages();
+		for (int i = 0; i < numDuplicates; i++)
+		{
+			RecordId dupRid = {0, (SlotId)i, 0};
+			index.deleteEntry(&dupKey, dupRid);
+		}
+		for (int i = 0; i < numDuplicates; i++)
+		{
+			RecordId dupRid = {0, (SlotId)i, 0};
+			index.insertEntry(&dupKey, dupRid);
+		}
+		checkPassFail(BlobFile(intIndexName, false).getNumPages(), numPages)
+		int numFound = 0;
+		index.startScan(&dupKey, GTE, &dupKey, LTE);
+		try
+		{
+			while(1)
+			{
+				index.scanNext(scanRid);
+				numFound++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		index.endScan();
+		checkPassFail(numFound, numDuplicates)
+		checkPassFail(intBatchScan(&index,0,GTE,relationSize,LT,1000), relationSize)
+	}
+
+	File::remove(intIndexName);
+	deleteRelation();
+}
+
+// -----------------------------------------------------------------------------
+// stringNodeTests
+// -----------------------------------------------------------------------------
+
+// Compare a STRING leaf with the sorted entries it should hold, searching for every key held and for probes
+int checkStringLeaf(const LeafNodeString* leaf, const std::vector<RIDKeyPair<StringKey> >& model,
+		const std::vector<StringKey>& probes)
+{
+	int numWrong = 0;
+	if (leaf->length != (int)model.size())
+		return 1;
+	for (int i = 0; i < leaf->length; i++)
+	{
+		if (!(leaf->key(i) == model[i].key) || !(leaf->rid(i) == model[i].rid))
+			numWrong++;
+	}
+	std::vector<StringKey> keys;
+	for (const RIDKeyPair<StringKey>& pair : model)
+		keys.push_back(pair.key);
+	std::vector<StringKey> searched(probes);
+	searched.insert(searched.end(), keys.begin(), keys.end());
+	for (const StringKey& key : searched)
+	{
+		int lower = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+		int upper = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+		if (leaf->search(key, false) != lower || leaf->search(key, true) != upper)
+			numWrong++;
+	}
+	return numWrong;
+}
+
+void stringNodeTests()
+{
+	// STRING nodes keep their keys prefix compressed, with variable length rests; they must still behave
+	// like sorted arrays of the keys, and hold more keys than fixed width slots would when keys share a prefix
+	std::cout << "STRING node tests" << std::endl;
+	std::cout << "-----------------" << std::endl;
+	srand(1);
+	char str[32];
+	std::vector<StringKey> probes;
+	for (int i = 0; i < 200; i++)
+	{
+		sprintf(str, "%s%d", i % 2 ? "key 0" : "k", rand() % 100000);
+		probes.push_back(StringKey(str));
+	}
+	probes.push_back(StringKey(""));
+	probes.push_back(StringKey("key"));
+	probes.push_back(StringKey("key 0"));
+	probes.push_back(StringKey("zzzzzzzzzz"));
+
+	Page page;
+	LeafNodeString* leaf = (LeafNodeString*)&page;
+	leaf->clear();
+	std::vector<RIDKeyPair<StringKey> > model;
+	int numWrong = 0;
+	// keys sharing "key 0" until the leaf is full, then keys only sharing "k", which shrink the prefix
+	for (int phase = 0; phase < 2; phase++)
+	{
+		while (true)
+		{
+			sprintf(str, "%s%05d", phase == 0 ? "key 0" : "k", rand() % 1000);
+			RIDKeyPair<StringKey> pair;
+			RecordId rid;
+			rid.page_number = rand() % 100000;
+			rid.slot_number = rand() % 100;
+			rid.padding = 0;
+			pair.set(rid, StringKey(str));
+			const int slot = leaf->search(pair.key, true);
+			const bool canInsert = leaf->canInsert(pair.key);
+			if (canInsert != leaf->insert(slot, pair.key, pair.rid))
+				numWrong++;
+			if (!canInsert)
+				break;
+			model.insert(std::upper_bound(model.begin(), model.end(), pair,
+					[](const RIDKeyPair<StringKey>& p1, const RIDKeyPair<StringKey>& p2) { return p1.key < p2.key; }), pair);
+		}
+		numWrong += checkStringLeaf(leaf, model, probes);
+		if (phase == 0)
+		{
+			bool longerThanFixed = leaf->length > STRINGARRAYLEAFSIZE;
+			checkPassFail(longerThanFixed, true)
+		}
+	}
+	checkPassFail(numWrong, 0)
+
+	// removing entries keeps the others in order, and the leaf packed
+	numWrong = 0;
+	while (model.size() > 10)
+	{
+		int entry = rand() % model.size();
+		leaf->remove(entry);
+		model.erase(model.begin() + entry);
+		if (model.size() % 50 == 0)
+			numWrong += checkStringLeaf(leaf, model, probes);
+	}
+	numWrong += checkStringLeaf(leaf, model, probes);
+	checkPassFail(numWrong, 0)
+
+	// a leaf rebuilt from its entries splits into two halves that both fit
+	std::vector<RIDKeyPair<StringKey> > pairs;
+	leaf->clear();
+	for (int i = 0; ; i++)
+	{
+		sprintf(str, "%s%05d", i < 150 ? "a" : "key 0", i);
+		RecordId rid = {(PageId)i, 1, 0};
+		if (!leaf->append(StringKey(str), rid))
+			break;
+	}
+	leaf->entries(pairs);
+	int split = LeafNodeString::splitPoint(pairs.data(), pairs.size());
+	bool halvesFit = split > 0 && split < (int)pairs.size() && LeafNodeString::fits(pairs.data(), split)
+			&& LeafNodeString::fits(pairs.data() + split, pairs.size() - split);
+	checkPassFail(halvesFit, true)
+
+	// non-leaf: child i + 1 follows key i, and keys can be replaced as long as they fit
+	NonLeafNodeString* node = (NonLeafNodeString*)&page;
+	std::vector<StringKey> keys;
+	std::vector<PageId> pageNos(1, 1);
+	node->assign(keys.data(), pageNos.data(), 0);
+	numWrong = 0;
+	for (int i = 0; ; i++)
+	{
+		sprintf(str, "%s%d", i % 2 ? "key 0" : "key 1", rand() % 100000);
+		StringKey key(str);
+		const bool hasRoom = node->hasRoom();
+		const int slot = node->search(key, true);
+		if (!node->insert(slot, key, i + 2))
+		{
+			if (hasRoom)
+				numWrong++;
+			break;
+		}
+		keys.insert(keys.begin() + slot, key);
+		pageNos.insert(pageNos.begin() + slot + 1, i + 2);
+	}
+	for (int i = 0; i <= node->length; i++)
+	{
+		if ((i < node->length && !(node->key(i) == keys[i])) || node->pageNo(i) != pageNos[i])
+			numWrong++;
+	}
+	checkPassFail(numWrong, 0)
+
+	numWrong = 0;
+	for (int i = 1; i < 50; i++)
+	{
+		// a shorter key between the neighbours always fits
+		StringKey key = separatorKey(keys[i - 1], keys[i]);
+		if (!node->setKey(i, key))
+			numWrong++;
+		keys[i] = key;
+		node->remove(i + 1);
+		keys.erase(keys.begin() + i + 1);
+		pageNos.erase(pageNos.begin() + i + 2);
+	}
+	for (int i = 0; i <= node->length; i++)
+	{
+		if ((i < node->length && !(node->key(i) == keys[i])) || node->pageNo(i) != pageNos[i])
+			numWrong++;
+	}
+	checkPassFail(numWrong, 0)
+
+	// a full non-leaf splits around a key that goes up, and both halves fit
+	split = NonLeafNodeString::splitPoint(keys.data(), keys.size());
+	halvesFit = split > 0 && split < (int)keys.size() - 1 && NonLeafNodeString::fits(keys.data(), split)
+			&& NonLeafNodeString::fits(keys.data() + split + 1, keys.size() - split - 1);
+	checkPassFail(halvesFit, true)
+
+	// the same through an index: built by inserts in random order, then emptied and filled again by deletes and inserts
+	createRelationRandom();
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING, INSERT_BUILD);
+		checkPassFail(stringScan(&index,25,GT,40,LT), 14)
+		checkPassFail(stringScan(&index,3000,GTE,4000,LT), 1000)
+		checkPassFail(stringScan(&index,0,GTE,relationSize,LT), relationSize)
+
+		std::vector<std::pair<std::string, RecordId> > entries;
+		{
+			FileScan fscan(relationName, bufMgr);
+			try
+			{
+				RecordId scanRid;
+				while(1)
+				{
+					fscan.scanNext(scanRid);
+					std::string recordStr = fscan.getRecord();
+					entries.push_back(std::make_pair(std::string(recordStr.c_str() + offsetof(RECORD, s)), scanRid));
+				}
+			}
+			catch(const EndOfFileException &e)
+			{
+			}
+		}
+		for (const std::pair<std::string, RecordId>& entry : entries)
+		{
+			if (atoi(entry.first.c_str()) % 2 == 1)
+				index.deleteEntry(entry.first.c_str(), entry.second);
+		}
+		checkPassFail(stringScan(&index,25,GT,40,LT), 7)
+		checkPassFail(stringScan(&index,0,GTE,relationSize,LT), relationSize / 2)
+		for (const std::pair<std::string, RecordId>& entry : entries)
+		{
+			if (atoi(entry.first.c_str()) % 2 == 0)
+				index.deleteEntry(entry.first.c_str(), entry.second);
+		}
+		checkPassFail(stringScan(&index,0,GTE,relationSize,LT), 0)
+		for (const std::pair<std::string, RecordId>& entry : entries)
+			index.insertEntry(entry.first.c_str(), entry.second);
+		checkPassFail(stringScan(&index,300,GT,400,LT), 99)
+		checkPassFail(stringScan(&index,0,GTE,relationSize,LT), relationSize)
+	}
+
+	File::remove(stringIndexName);
+	deleteRelation();
+}
 
 // -----------------------------------------------------------------------------
 // createAltRelationRandom
@@ -39,7 +39,7 @@
  *
  * To build and run the system, you need the following packages:
  * <ul>
- *   <li>A modern C++ compiler (GCC >= 4.6, any recent version of clang)
+ *   <li>A modern C++ compiler with C++17 support (GCC >= 7, clang >= 5)
  *   <li>Doxygen 1.6 or higher (for generating documentation only)
  * </ul>
  *
@@ -6,6 +6,7 @@
  */
 
 #include <cassert>
+#include <cstring>
 
 #include <iostream>
 #include "exceptions/insufficient_space_exception.h"
@@ -29,6 +30,7 @@ void Page::initialize() {
   header_.num_free_slots = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
+  header_.prev_page_number = INVALID_NUMBER;
   //data_.assign(DATA_SIZE, char());
 	memset(data_, '\0', DATA_SIZE);
 }
@@ -44,11 +46,13 @@ RecordId Page::insertRecord(const std::string& record_data) {
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  return std::string(getRecordView(record_id));
+}
+
+std::string_view Page::getRecordView(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
-
-	return retStr;
+  return std::string_view(data_ + slot.item_offset, slot.item_length);
 }
 
 void Page::updateRecord(const RecordId& record_id,
@@ -99,10 +103,7 @@ void Page::deleteRecord(const RecordId& record_id,
   }
   // If we have data to move, shift it to the right.
   if (move_bytes > 0) {
-    const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
-
-		for(std::uint16_t i = 0; i < move_bytes; i++)
-			data_[i + move_offset + slot->item_length] = data_to_move[i];
+    std::memmove(data_ + move_offset + slot->item_length, data_ + move_offset, move_bytes);
 
     //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
   }
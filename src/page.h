@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <memory>
 #include <string>
+#include <string_view>
 
 //#include <gtest/gtest.h>
 #include "types.h"
@@ -58,6 +59,12 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * Number of the previous used page in the file.  Lets a page be unlinked
+   * from the used list without walking the list to find its predecessor.
+   */
+  PageId prev_page_number;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -68,7 +75,8 @@ struct PageHeader {
     return num_slots == rhs.num_slots &&
         num_free_slots == rhs.num_free_slots &&
         current_page_number == rhs.current_page_number &&
-        next_page_number == rhs.next_page_number;
+        next_page_number == rhs.next_page_number &&
+        prev_page_number == rhs.prev_page_number;
   }
 };
 
@@ -103,9 +111,12 @@ class PageIterator;
  * slots and identified by a RecordId.  Although a record's actual contents may
  * be moved on the page, accessing a record by its slot is consistent.
  *
+ * Pages are aligned to 4KB, the block size direct I/O needs, so files open
+ * with DIRECT_IO read and write them in place.
+ *
  * @warning This class is not threadsafe.
  */
-class Page {
+class alignas(4096) Page {
  public:
   /**
    * Page size in bytes.  If this is changed, database files created with a
@@ -151,6 +162,17 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the bytes of the record with the given ID where they lie on the
+   * page, without copying them. The view is valid until the record is changed
+   * or moved by an update or a delete on the page, and for a page in the
+   * buffer pool only while the page stays pinned.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  The record.
+   */
+  std::string_view getRecordView(const RecordId& record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -200,6 +222,13 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the number of the previous used page before this page in its file.
+   *
+   * @return  Page number of previous used page in file.
+   */
+  PageId prev_page_number() const { return header_.prev_page_number; }
+
   /**
    * Returns an iterator at the first record in the page.
    *
@@ -239,6 +268,15 @@ class Page {
     header_.next_page_number = new_next_page_number;
   }
 
+  /**
+   * Sets the number of the previous used page before this page in its file.
+   *
+   * @param prev_page_number  Page number of previous used page in file.
+   */
+  void set_prev_page_number(const PageId new_prev_page_number) {
+    header_.prev_page_number = new_prev_page_number;
+  }
+
   /**
    * Deletes the record with the given ID.  Page is compacted upon delete to
    * ensure that data of all records is contiguous.  Slot array is compacted if
@@ -336,6 +374,7 @@ class Page {
   friend class File;
   friend class PageFile;
   friend class BlobFile;
+  friend class MappedPageFile;
   friend class PageIterator;
 };
 
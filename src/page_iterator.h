@@ -101,6 +101,15 @@ class PageIterator {
 		return page_->getRecord(current_record_); 
 	}
 
+  /**
+   * Returns the current record where it lies on the page, without copying it.
+   *
+   * @return  Record in page, valid as long as Page::getRecordView's.
+   */
+	inline std::string_view recordView() const {
+		return page_->getRecordView(current_record_);
+	}
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.
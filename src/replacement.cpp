@@ -0,0 +1,334 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "replacement.h"
+
+namespace badgerdb {
+
+ReplacementPolicy* ReplacementPolicy::create(const Replacement replacement, const std::uint32_t numFrames)
+{
+  switch (replacement)
+  {
+    case TWO_Q_REPLACEMENT:
+      return new TwoQPolicy(numFrames);
+    case LRU_K_REPLACEMENT:
+      return new LruKPolicy(numFrames);
+    case ARC_REPLACEMENT:
+      return new ArcPolicy(numFrames);
+    case CLOCK_REPLACEMENT:
+    default:
+      return new ClockPolicy(numFrames);
+  }
+}
+
+//----------------------------------------
+// ClockPolicy
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(const std::uint32_t numFrames)
+  : numFrames(numFrames),
+    refbits(new std::atomic<bool>[numFrames]),
+    clockHand(numFrames - 1)
+{
+  for (FrameId i = 0; i < numFrames; i++)
+    refbits[i] = false;
+}
+
+void ClockPolicy::loaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  refbits[frame] = true;
+}
+
+void ClockPolicy::accessed(const FrameId frame)
+{
+  refbits[frame] = true;
+}
+
+void ClockPolicy::evicted(const FrameId frame, const File* file, const PageId pageNo)
+{
+}
+
+bool ClockPolicy::chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame)
+{
+  //Need to scan twice: the first pass may only clear reference bits
+  for (std::uint32_t numScanned = 0; numScanned < 2*numFrames; numScanned++)
+  {
+    // advance the clock
+    clockHand = (clockHand + 1) % numFrames;
+
+    // has been referenced, clear the bit
+    if (refbits[clockHand].exchange(false))
+      continue;
+
+    if (reserve(clockHand))
+    {
+      frame = clockHand;
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------
+// ListPolicy
+//----------------------------------------
+
+ListPolicy::ListPolicy(const std::uint32_t numFrames, const int numLists)
+  : lists(numLists),
+    frameList(numFrames, FREE_LIST),
+    framePos(numFrames),
+    framePage(numFrames, PageKey(NULL, static_cast<PageId>(Page::INVALID_NUMBER)))
+{
+  for (FrameId i = 0; i < numFrames; i++)
+    framePos[i] = lists[FREE_LIST].insert(lists[FREE_LIST].end(), i);
+}
+
+void ListPolicy::moveTo(const FrameId frame, const int list)
+{
+  lists[list].splice(lists[list].end(), lists[frameList[frame]], framePos[frame]);
+  frameList[frame] = list;
+}
+
+bool ListPolicy::reserveFrom(const int list, const std::function<bool(FrameId)>& reserve, FrameId& frame)
+{
+  for (FrameList::iterator it = lists[list].begin(); it != lists[list].end(); ++it)
+  {
+    if (reserve(*it))
+    {
+      frame = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------
+// GhostList
+//----------------------------------------
+
+void GhostList::push(const PageKey& page)
+{
+  positions[page] = order.insert(order.end(), page);
+}
+
+bool GhostList::remove(const PageKey& page)
+{
+  std::map<PageKey, std::list<PageKey>::iterator>::iterator it = positions.find(page);
+  if (it == positions.end())
+    return false;
+  order.erase(it->second);
+  positions.erase(it);
+  return true;
+}
+
+void GhostList::popOldest()
+{
+  positions.erase(order.front());
+  order.pop_front();
+}
+
+//----------------------------------------
+// TwoQPolicy
+//----------------------------------------
+
+TwoQPolicy::TwoQPolicy(const std::uint32_t numFrames)
+  : ListPolicy(numFrames, 3),
+    maxA1in(std::max<std::size_t>(numFrames / 4, 1)),
+    maxA1out(std::max<std::size_t>(numFrames / 2, 1))
+{
+}
+
+void TwoQPolicy::loaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  framePage[frame] = PageKey(file, pageNo);
+  // read again soon after leaving A1in: the page is hot
+  moveTo(frame, a1out.remove(framePage[frame]) ? AM : A1IN);
+}
+
+void TwoQPolicy::accessed(const FrameId frame)
+{
+  // references while on A1in are taken as one correlated burst
+  std::lock_guard<std::mutex> guard(latch);
+  if (frameList[frame] == AM)
+    moveTo(frame, AM);
+}
+
+void TwoQPolicy::evicted(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (frameList[frame] != A1IN)
+    return;
+  a1out.push(PageKey(file, pageNo));
+  if (a1out.size() > maxA1out)
+    a1out.popOldest();
+}
+
+bool TwoQPolicy::chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (reserveFrom(FREE_LIST, reserve, frame))
+    return true;
+  if (listSize(A1IN) > maxA1in)
+    return reserveFrom(A1IN, reserve, frame) || reserveFrom(AM, reserve, frame);
+  return reserveFrom(AM, reserve, frame) || reserveFrom(A1IN, reserve, frame);
+}
+
+//----------------------------------------
+// LruKPolicy
+//----------------------------------------
+
+LruKPolicy::LruKPolicy(const std::uint32_t numFrames)
+  : ListPolicy(numFrames, 2),
+    now(0),
+    frameHistory(numFrames, History{0, 0}),
+    maxRetained(numFrames)
+{
+}
+
+void LruKPolicy::loaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  framePage[frame] = PageKey(file, pageNo);
+  History history = {0, 0};
+  std::map<PageKey, History>::iterator it = retained.find(framePage[frame]);
+  if (it != retained.end())
+  {
+    history = it->second;
+    retained.erase(it);
+    retainedOrder.remove(framePage[frame]);
+  }
+  if (frameList[frame] == RESIDENT)
+    ranked.erase(rankOf(frame));
+  frameHistory[frame].previous = history.last;
+  frameHistory[frame].last = ++now;
+  moveTo(frame, RESIDENT);
+  ranked.insert(rankOf(frame));
+}
+
+void LruKPolicy::accessed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  const bool resident = frameList[frame] == RESIDENT;
+  if (resident)
+    ranked.erase(rankOf(frame));
+  frameHistory[frame].previous = frameHistory[frame].last;
+  frameHistory[frame].last = ++now;
+  if (resident)
+    ranked.insert(rankOf(frame));
+}
+
+void LruKPolicy::evicted(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  const PageKey page(file, pageNo);
+  retainedOrder.remove(page);
+  retainedOrder.push(page);
+  retained[page] = frameHistory[frame];
+  if (retainedOrder.size() > maxRetained)
+  {
+    retained.erase(retainedOrder.oldest());
+    retainedOrder.popOldest();
+  }
+}
+
+bool LruKPolicy::chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (reserveFrom(FREE_LIST, reserve, frame))
+    return true;
+
+  for (std::set<Rank>::const_iterator it = ranked.begin(); it != ranked.end(); ++it)
+  {
+    if (reserve(std::get<2>(*it)))
+    {
+      frame = std::get<2>(*it);
+      return true;
+    }
+  }
+  return false;
+}
+
+LruKPolicy::Rank LruKPolicy::rankOf(const FrameId frame) const
+{
+  // a page referenced once has a previous time of 0 and goes before any page referenced twice
+  return Rank(frameHistory[frame].previous, frameHistory[frame].last, frame);
+}
+
+//----------------------------------------
+// ArcPolicy
+//----------------------------------------
+
+ArcPolicy::ArcPolicy(const std::uint32_t numFrames)
+  : ListPolicy(numFrames, 3),
+    numFrames(numFrames),
+    target(0)
+{
+}
+
+void ArcPolicy::loaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  framePage[frame] = PageKey(file, pageNo);
+  const PageKey& page = framePage[frame];
+  if (b1.remove(page))
+  {
+    // evicted from T1 too early: give T1 more room
+    target = std::min(numFrames, target + std::max<std::size_t>(b2.size() / (b1.size() + 1), 1));
+    moveTo(frame, T2);
+  }
+  else if (b2.remove(page))
+  {
+    // evicted from T2 too early: give T2 more room
+    const std::size_t step = std::max<std::size_t>(b1.size() / (b2.size() + 1), 1);
+    target = target > step ? target - step : 0;
+    moveTo(frame, T2);
+  }
+  else
+  {
+    moveTo(frame, T1);
+  }
+}
+
+void ArcPolicy::accessed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (frameList[frame] != FREE_LIST)
+    moveTo(frame, T2);
+}
+
+void ArcPolicy::evicted(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  const PageKey page(file, pageNo);
+  if (frameList[frame] == T1)
+  {
+    b1.push(page);
+    // T1 and B1 together hold at most as many pages as there are frames
+    if (listSize(T1) + b1.size() > numFrames)
+      b1.popOldest();
+  }
+  else if (frameList[frame] == T2)
+  {
+    b2.push(page);
+    if (listSize(T1) + listSize(T2) + b1.size() + b2.size() > 2 * numFrames)
+      b2.popOldest();
+  }
+}
+
+bool ArcPolicy::chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  if (reserveFrom(FREE_LIST, reserve, frame))
+    return true;
+  if (listSize(T1) > 0 && listSize(T1) > target)
+    return reserveFrom(T1, reserve, frame) || reserveFrom(T2, reserve, frame);
+  return reserveFrom(T2, reserve, frame) || reserveFrom(T1, reserve, frame);
+}
+
+}
@@ -0,0 +1,402 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Replacement policies the buffer manager can be built with.
+ */
+enum Replacement {
+  CLOCK_REPLACEMENT,  /* One reference bit per frame, swept by a clock hand */
+  TWO_Q_REPLACEMENT,  /* 2Q: pages seen once queue FIFO in A1in; pages seen again in A1out go to an LRU list */
+  LRU_K_REPLACEMENT,  /* LRU-2: evict the page whose second most recent reference is oldest */
+  ARC_REPLACEMENT     /* ARC: recency and frequency LRU lists, balanced by hits on pages recently evicted */
+};
+
+/**
+* @brief Chooses the frame the buffer manager evicts when it needs a free one.
+*
+* The buffer manager reports the life of each frame: a page loaded into it, the page pinned again
+* while it stays, the page evicted from it. A policy keeps what it needs of this history and ranks
+* frames by it. chooseVictim offers the frames in that order to a reserve callback until one is
+* taken, so the buffer manager keeps deciding which frames are in use and how they are reserved.
+*
+* chooseVictim is called by one thread at a time; the other calls may come from any thread, at any
+* time, but never with a hash table partition latch held, since reserve takes those latches.
+* Frames of pages removed from the buffer pool by flushFile or disposePage are not reported; they
+* keep their rank until they come up as victims, and then cost nothing to reserve.
+*/
+class ReplacementPolicy {
+ public:
+  /**
+   * Builds a policy.
+   *
+   * @param replacement Policy to build
+   * @param numFrames   Number of frames in the buffer pool
+   * @return  New policy, owned by the caller
+   */
+  static ReplacementPolicy* create(const Replacement replacement, const std::uint32_t numFrames);
+
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * A page was read or allocated into the frame, which is pinned by the caller.
+   *
+   * @param frame   Frame holding the page
+   * @param file    File of the page
+   * @param pageNo  Number of the page
+   */
+  virtual void loaded(const FrameId frame, const File* file, const PageId pageNo) = 0;
+
+  /**
+   * The page in the frame was found in the buffer pool and pinned again.
+   *
+   * @param frame   Frame holding the page
+   */
+  virtual void accessed(const FrameId frame) = 0;
+
+  /**
+   * The page in the frame was written out if need be and evicted; the frame is reserved by the caller.
+   *
+   * @param frame   Frame that held the page
+   * @param file    File of the page
+   * @param pageNo  Number of the page
+   */
+  virtual void evicted(const FrameId frame, const File* file, const PageId pageNo) = 0;
+
+  /**
+   * Offers frames to reserve, best victim first, until it takes one.
+   *
+   * @param reserve Reserves the frame and returns true, or returns false if the frame is pinned
+   * @param frame   Set to the frame reserved
+   * @return  False if reserve took no frame
+   */
+  virtual bool chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame) = 0;
+};
+
+/**
+* @brief The clock algorithm. A reference sets the bit of a frame; the hand clears it on its way round
+* and takes the first frame whose bit was already clear. One pass of a long scan sets the bits of all
+* the frames it reads, so it evicts hot pages just like cold ones.
+*/
+class ClockPolicy : public ReplacementPolicy {
+ public:
+  explicit ClockPolicy(const std::uint32_t numFrames);
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo) override;
+  void accessed(const FrameId frame) override;
+  void evicted(const FrameId frame, const File* file, const PageId pageNo) override;
+  bool chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame) override;
+
+ private:
+  /**
+   * Number of frames
+   */
+  std::uint32_t numFrames;
+
+  /**
+   * Reference bit of each frame
+   */
+  std::unique_ptr<std::atomic<bool>[]> refbits;
+
+  /**
+   * Current position of the clock hand
+   */
+  FrameId clockHand;
+};
+
+/**
+* @brief Helpers shared by the policies keeping frames and evicted pages in LRU lists.
+*
+* One latch guards all the state of such a policy, and accessed takes it on every hit in the buffer
+* pool, so threads hitting the pool at once queue on it where the clock only stores a reference bit.
+* This is the price of ranking the frames exactly: the latch is held for a few list splices, or a
+* set update for LRU-2, which is short next to the hash table lookup and pin of the same hit. A
+* workload of hits on many threads is better served by the clock.
+*/
+class ListPolicy : public ReplacementPolicy {
+ protected:
+  /**
+   * A page of a file, remembered after its eviction
+   */
+  typedef std::pair<const File*, PageId> PageKey;
+
+  /**
+   * LRU list of frames, least recently used first
+   */
+  typedef std::list<FrameId> FrameList;
+
+  /**
+   * Lists of frames a policy keeps. Every frame is on exactly one of them.
+   */
+  enum { FREE_LIST = 0 };
+
+  /**
+   * Puts every frame on the free list.
+   *
+   * @param numFrames   Number of frames
+   * @param numLists    Number of frame lists the policy keeps, including the free list
+   */
+  ListPolicy(const std::uint32_t numFrames, const int numLists);
+
+  /**
+   * Moves a frame to the most recently used end of a list.
+   *
+   * @param frame   Frame to move
+   * @param list    List to move it to
+   */
+  void moveTo(const FrameId frame, const int list);
+
+  /**
+   * Offers the frames of a list to reserve, least recently used first.
+   *
+   * @param list    List to take the frame from
+   * @param reserve Reservation callback of chooseVictim
+   * @param frame   Set to the frame reserved
+   * @return  False if no frame of the list was reserved
+   */
+  bool reserveFrom(const int list, const std::function<bool(FrameId)>& reserve, FrameId& frame);
+
+  /**
+   * Number of frames on a list.
+   *
+   * @param list    List
+   */
+  std::size_t listSize(const int list) const { return lists[list].size(); }
+
+  /**
+   * Frame lists, indexed by list number.
+   */
+  std::vector<FrameList> lists;
+
+  /**
+   * List each frame is on.
+   */
+  std::vector<int> frameList;
+
+  /**
+   * Position of each frame on its list.
+   */
+  std::vector<FrameList::iterator> framePos;
+
+  /**
+   * Page held by each frame, as reported by loaded.
+   */
+  std::vector<PageKey> framePage;
+
+  /**
+   * Protects all the state of the policy.
+   */
+  std::mutex latch;
+};
+
+/**
+* @brief FIFO list of pages evicted recently, bounded in length, for the policies that act on a
+* page coming back soon after its eviction.
+*/
+class GhostList {
+ public:
+  typedef std::pair<const File*, PageId> PageKey;
+
+  /**
+   * Adds a page at the recent end.
+   *
+   * @param page    Evicted page
+   */
+  void push(const PageKey& page);
+
+  /**
+   * Removes a page if present.
+   *
+   * @param page    Page to look for
+   * @return  True if the page was on the list
+   */
+  bool remove(const PageKey& page);
+
+  /**
+   * The least recently evicted page. The list must not be empty.
+   */
+  const PageKey& oldest() const { return order.front(); }
+
+  /**
+   * Drops the least recently evicted page.
+   */
+  void popOldest();
+
+  /**
+   * Number of pages on the list.
+   */
+  std::size_t size() const { return order.size(); }
+
+ private:
+  /**
+   * Pages, least recently evicted first.
+   */
+  std::list<PageKey> order;
+
+  /**
+   * Position of each page on order.
+   */
+  std::map<PageKey, std::list<PageKey>::iterator> positions;
+};
+
+/**
+* @brief The full 2Q algorithm of Johnson and Shasha. A page read for the first time goes on the
+* FIFO queue A1in, which takes the evictions while it is longer than a quarter of the buffer pool.
+* Its number is then kept on the ghost queue A1out, half the buffer pool long; a page read again
+* while there goes on the LRU list Am. Pages read once by a scan never reach Am.
+*/
+class TwoQPolicy : public ListPolicy {
+ public:
+  explicit TwoQPolicy(const std::uint32_t numFrames);
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo) override;
+  void accessed(const FrameId frame) override;
+  void evicted(const FrameId frame, const File* file, const PageId pageNo) override;
+  bool chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame) override;
+
+ private:
+  enum { A1IN = 1, AM = 2 };
+
+  /**
+   * Length of A1in past which it gives up its pages first.
+   */
+  std::size_t maxA1in;
+
+  /**
+   * Length of A1out.
+   */
+  std::size_t maxA1out;
+
+  /**
+   * Pages evicted from A1in.
+   */
+  GhostList a1out;
+};
+
+/**
+* @brief LRU-K with K = 2, after O'Neil, O'Neil and Weikum. Each page keeps the times of its last two
+* references. The victim is the page whose second most recent reference is the oldest; pages
+* referenced only once come first, least recently used first. The reference times of evicted pages
+* are kept for as many pages as there are frames, so a page read again soon after its eviction keeps
+* its history.
+*/
+class LruKPolicy : public ListPolicy {
+ public:
+  explicit LruKPolicy(const std::uint32_t numFrames);
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo) override;
+  void accessed(const FrameId frame) override;
+  void evicted(const FrameId frame, const File* file, const PageId pageNo) override;
+  bool chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame) override;
+
+ private:
+  enum { RESIDENT = 1 };
+
+  /**
+   * Times of the last two references to a page; 0 for a reference that never happened.
+   */
+  struct History {
+    std::uint64_t last;
+    std::uint64_t previous;
+  };
+
+  /**
+   * Logical clock, advanced by every reference.
+   */
+  std::uint64_t now;
+
+  /**
+   * Ranks a frame by the second most recent reference to its page, then by the most recent one.
+   */
+  typedef std::tuple<std::uint64_t, std::uint64_t, FrameId> Rank;
+
+  /**
+   * Rank of a frame from its history.
+   *
+   * @param frame   Frame
+   */
+  Rank rankOf(const FrameId frame) const;
+
+  /**
+   * History of the page in each frame.
+   */
+  std::vector<History> frameHistory;
+
+  /**
+   * Resident frames, best victim first.
+   */
+  std::set<Rank> ranked;
+
+  /**
+   * History of evicted pages.
+   */
+  std::map<PageKey, History> retained;
+
+  /**
+   * Pages of retained, in order of eviction.
+   */
+  GhostList retainedOrder;
+
+  /**
+   * Number of evicted pages whose history is kept.
+   */
+  std::size_t maxRetained;
+};
+
+/**
+* @brief ARC, the adaptive replacement cache of Megiddo and Modha. Pages referenced once since they
+* were loaded are on the LRU list T1, pages referenced again on T2. Evicted pages are remembered on
+* the ghost lists B1 and B2. A page coming back through B1 grows the target length of T1, one
+* coming back through B2 shrinks it, and the victim comes from T1 while T1 is longer than its target.
+* A scan only ever fills T1.
+*/
+class ArcPolicy : public ListPolicy {
+ public:
+  explicit ArcPolicy(const std::uint32_t numFrames);
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo) override;
+  void accessed(const FrameId frame) override;
+  void evicted(const FrameId frame, const File* file, const PageId pageNo) override;
+  bool chooseVictim(const std::function<bool(FrameId)>& reserve, FrameId& frame) override;
+
+ private:
+  enum { T1 = 1, T2 = 2 };
+
+  /**
+   * Number of frames
+   */
+  std::size_t numFrames;
+
+  /**
+   * Target length of T1
+   */
+  std::size_t target;
+
+  /**
+   * Pages evicted from T1 and T2.
+   */
+  GhostList b1;
+  GhostList b2;
+};
+
+}
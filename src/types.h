@@ -9,6 +9,28 @@
 
 namespace badgerdb {
 
+/**
+ * @brief Datatype enumeration type.
+ */
+enum Datatype
+{
+	INTEGER = 0,
+	DOUBLE = 1,
+	STRING = 2
+};
+
+/**
+ * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method and
+ * to the predicates of a FileScan.
+ */
+enum Operator
+{ 
+	LT, 	/* Less Than */
+	LTE,	/* Less Than or Equal to */
+	GTE,	/* Greater Than or Equal to */
+	GT		/* Greater Than */
+};
+
 /**
  * @brief Identifier for a page in a file.
  */